@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Runs Nova programs with the JIT, with --no-jit and with --interp, and
+# fails if their output, errors or exit status differ.
+#
+# Usage: benchmarks/differential.sh [file.nv ...]   (default: benchmarks/jit_edge_cases.nv)
+#        SUPERNOVA=path/to/supernova benchmarks/differential.sh ...
+
+SUPERNOVA="${SUPERNOVA:-./build/supernova}"
+if [ $# -eq 0 ]; then
+    set -- benchmarks/jit_edge_cases.nv
+fi
+
+failed=0
+for file in "$@"; do
+    same=1
+    expected=$("$SUPERNOVA" --no-cache "$file" 2>&1; echo "exit $?")
+    for mode in --no-jit --interp; do
+        actual=$("$SUPERNOVA" --no-cache $mode "$file" 2>&1; echo "exit $?")
+        if [ "$actual" != "$expected" ]; then
+            echo "DIFFERENT: $file with $mode"
+            diff <(echo "$expected") <(echo "$actual")
+            same=0
+            failed=1
+        fi
+    done
+    if [ $same -eq 1 ]; then
+        echo "same: $file"
+    fi
+done
+exit $failed
@@ -0,0 +1,133 @@
+// Benchmark of libnova: runs of one compiled rule per second on 1, 2, 4,
+// ... threads up to one per core, each thread with a NovaContext of its own.
+// Every run's output is checked against the first one.
+//
+// Build: ./build.sh bench (or link build/libnova.a)
+// Usage: build/embedding [--runs <n>] [source-file]
+
+#include "nova.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// A pricing rule as a service might run it per request.
+static const char* DEFAULT_RULE =
+    "fun:float discount total:float count:num start\n"
+    "  if count > 10 start\n"
+    "    return total * 0.1\n"
+    "  end\n"
+    "  return 0.0\n"
+    "end\n"
+    "total:float = 0.0\n"
+    "i:num = 0\n"
+    "while i < count start\n"
+    "  total = total + price\n"
+    "  i = i + 1\n"
+    "end\n"
+    "total = total - discount total:total count:count\n"
+    "if total > limit start\n"
+    "  show \"over \" + customer\n"
+    "end\n"
+    "show total\n";
+
+// The inputs of the runs. Each thread makes its own, so that no string is
+// shared between threads.
+static std::vector<std::vector<Value>> makeRequests() {
+    std::vector<std::vector<Value>> requests;
+    for (int r = 0; r < 16; ++r) {
+        requests.push_back({ Value(1.5f + r), Value(r * 2), Value(100.0f), Value(std::string("customer ") + std::to_string(r)) });
+    }
+    return requests;
+}
+
+class StringSink : public OutputSink {
+public:
+    std::string text;
+    void write(const char* data, size_t length) override { text.append(data, length); }
+};
+
+int main(int argc, char** argv) {
+    size_t runs = 100000;
+    std::string source = DEFAULT_RULE;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::stringstream text;
+            if (!(text << file.rdbuf())) {
+                std::fprintf(stderr, "Error: cannot read '%s'\n", argv[i]);
+                return 1;
+            }
+            source = text.str();
+        }
+    }
+
+    std::vector<InputDecl> inputs = {
+        { "price", TokenType::KEYWORD_FLOAT },
+        { "count", TokenType::KEYWORD_NUM },
+        { "limit", TokenType::KEYWORD_FLOAT },
+        { "customer", TokenType::KEYWORD_STRING },
+    };
+    auto compile_start = std::chrono::steady_clock::now();
+    NovaProgram program(source, inputs);
+    double compile_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compile_start).count();
+    std::printf("compiled in %.3f ms, %zu runs per thread\n", compile_ms, runs);
+
+    // Every thread runs the same requests, so their outputs must agree
+    std::vector<std::string> expected;
+    {
+        NovaContext context(program);
+        for (const auto& request : makeRequests()) {
+            StringSink sink;
+            context.run(request, sink);
+            expected.push_back(sink.text);
+        }
+    }
+
+    size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    double single = 0.0;
+    for (size_t threads = 1;; threads = std::min(threads * 2, cores)) {
+        std::atomic<size_t> mismatches(0);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&]() {
+                NovaContext context(program);
+                std::vector<std::vector<Value>> requests = makeRequests();
+                StringSink sink;
+                for (size_t r = 0; r < runs; ++r) {
+                    sink.text.clear();
+                    context.run(requests[r % requests.size()], sink);
+                    if (sink.text != expected[r % expected.size()]) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double rate = threads * runs / seconds;
+        if (threads == 1) {
+            single = rate;
+        }
+        std::printf("%3zu threads: %10.0f runs/s  (%.2fx)  %.2f us/run%s\n", threads, rate, rate / single,
+                    1e6 * seconds / runs, mismatches ? "  OUTPUT MISMATCH" : "");
+        if (mismatches) {
+            return 1;
+        }
+        if (threads == cores) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,324 @@
+// Phase timings for Nova workloads. Every workload runs in a forked child so
+// its peak RSS is measured on its own; each repetition re-lexes, re-parses,
+// re-compiles and re-executes the source and times the phases separately.
+//
+//   nova_bench [--runs N] [--interp] [--no-jit] [--threads N | --scaling] [workload...]
+//
+// A workload is a .nv file or one of the generated sources @large,
+// @many_functions and @many_variables. With no workloads given, every
+// benchmark below runs.
+// Program output is discarded. --scaling runs each workload with 1, 2, 4, ...
+// threads up to one per core, to measure how parallel loops scale. Each
+// phase also reports the heap allocations its last run made.
+
+#include "allocation_counter.hpp"
+#include "compiler.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "optimizer.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "source_file.hpp"
+#include "type_checker.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const DEFAULT_WORKLOADS[] = {
+    "benchmarks/arithmetic_loop.nv",
+    "benchmarks/fibonacci.nv",
+    "benchmarks/factorial.nv",
+    "benchmarks/string_building.nv",
+    "benchmarks/array_reduction.nv",
+    "benchmarks/parallel_primes.nv",
+    "benchmarks/tasks.nv",
+    "@large",
+    "@many_functions",
+    "@many_variables",
+};
+
+typedef std::chrono::steady_clock Clock;
+
+struct Samples {
+    std::vector<double> lex, parse, compile, exec;
+    AllocationCount lex_allocations, parse_allocations, compile_allocations, exec_allocations; // of the last run
+};
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// ~200k lines of straight-line declarations and arithmetic: front-end bound.
+std::string generateLarge() {
+    std::string source = "total:num = 0\n";
+    for (int i = 0; i < 50000; ++i) {
+        std::string n = std::to_string(i);
+        source += "v" + n + ":num = " + n + " * 3 + (" + n + " - 1) / 2\n";
+        source += "total = total + v" + n + " - " + n + " * 3\n";
+        source += "if total > 1000000 start\n    total = total - 1000000\nend\n";
+    }
+    source += "show total\n";
+    return source;
+}
+
+// Thousands of small functions with named and default arguments.
+std::string generateManyFunctions() {
+    std::string source;
+    const int count = 5000;
+    for (int i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        source += "fun:num f" + n + " a:num b:num = " + n + " start\n";
+        source += "    return a * 2 + b\nend\n";
+    }
+    source += "total:num = 0\n";
+    for (int i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        source += "total = total + f" + n + " a:" + n + "\n";
+        source += "total = total - f" + n + " b:1 a:" + n + "\n";
+    }
+    source += "show total\n";
+    return source;
+}
+
+// More top-level variables and functions than a 16-bit slot or name index
+// could address, as generated scripts have.
+std::string generateManyVariables() {
+    std::string source = "total:num = 0\n";
+    const int variables = 100000;
+    const int functions = 70000;
+    for (int i = 0; i < variables; ++i) {
+        std::string n = std::to_string(i);
+        source += "w" + n + ":num = " + n + "\n";
+    }
+    for (int i = 0; i < functions; ++i) {
+        source += "fun:num g" + std::to_string(i) + " a:num start\n    return a / 1000\nend\n";
+    }
+    for (int i = 0; i < variables; ++i) {
+        std::string n = std::to_string(i);
+        if (i < functions) {
+            source += "total = total + g" + n + " a:w" + n + "\n";
+        } else {
+            source += "total = total + w" + n + " / 1000\n";
+        }
+    }
+    source += "show total\n";
+    return source;
+}
+
+bool loadWorkload(const std::string& name, std::string& source) {
+    if (name == "@large") {
+        source = generateLarge();
+        return true;
+    }
+    if (name == "@many_functions") {
+        source = generateManyFunctions();
+        return true;
+    }
+    if (name == "@many_variables") {
+        source = generateManyVariables();
+        return true;
+    }
+    SourceFile file;
+    std::string error;
+    if (!file.open(name, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    source.assign(file.data(), file.size());
+    return true;
+}
+
+void runOnce(const std::string& source, bool use_interpreter, bool use_jit, ThreadPool& pool, Output& output,
+             Samples& samples) {
+    AllocationCount allocations = allocationCount();
+    Clock::time_point start = Clock::now();
+    Lexer lexer(source);
+    std::vector<Token> tokens = lexer.tokenize();
+    samples.lex.push_back(millisecondsSince(start));
+    samples.lex_allocations = allocationCount() - allocations;
+
+    allocations = allocationCount();
+    start = Clock::now();
+    Parser parser(tokens);
+    Program program = parser.parse();
+    samples.parse.push_back(millisecondsSince(start));
+    samples.parse_allocations = allocationCount() - allocations;
+
+    allocations = allocationCount();
+    start = Clock::now();
+    Optimizer optimizer(program);
+    optimizer.optimize();
+    Resolver resolver(program);
+    resolver.resolve();
+    TypeChecker checker(program);
+    checker.check();
+    CompiledProgram compiled;
+    if (!use_interpreter) {
+        Compiler compiler(program);
+        compiled = compiler.compile();
+    }
+    samples.compile.push_back(millisecondsSince(start));
+    samples.compile_allocations = allocationCount() - allocations;
+
+    allocations = allocationCount();
+    start = Clock::now();
+    if (use_interpreter) {
+        Interpreter interpreter(program, output);
+        interpreter.setThreadPool(&pool);
+        interpreter.run();
+    } else {
+        VM vm(compiled, output);
+        vm.setJitEnabled(use_jit);
+        vm.setThreadPool(&pool);
+        vm.run();
+    }
+    output.flush();
+    samples.exec.push_back(millisecondsSince(start));
+    samples.exec_allocations = allocationCount() - allocations;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(fraction * values.size() + 0.999999);
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void printPhase(const char* phase, const std::vector<double>& values, const AllocationCount& allocations) {
+    std::printf("  %-8s median %10.3f ms   p99 %10.3f ms   %9llu allocations\n", phase,
+                percentile(values, 0.5), percentile(values, 0.99),
+                static_cast<unsigned long long>(allocations.allocations));
+}
+
+// Runs in the forked child; the exit status tells the parent whether it worked.
+int benchmarkWorkload(const std::string& name, int runs, bool use_interpreter, bool use_jit, size_t threads) {
+    std::string source;
+    if (!loadWorkload(name, source)) {
+        return 1;
+    }
+    FILE* sink = std::fopen("/dev/null", "w");
+    if (!sink) {
+        std::perror("/dev/null");
+        return 1;
+    }
+
+    Samples samples;
+    try {
+        Output output(sink);
+        ThreadPool pool(threads);
+        for (int run = 0; run < runs; ++run) {
+            runOnce(source, use_interpreter, use_jit, pool, output, samples);
+        }
+    } catch (const RuntimeError& e) {
+        std::cerr << name << ": Runtime Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::fclose(sink);
+
+    std::printf("%s (%zu bytes, %d runs, %s, %zu thread%s)\n", name.c_str(), source.size(), runs,
+                use_interpreter ? "interpreter" : use_jit ? "vm" : "vm, no jit", threads, threads == 1 ? "" : "s");
+    printPhase("lex", samples.lex, samples.lex_allocations);
+    printPhase("parse", samples.parse, samples.parse_allocations);
+    printPhase(use_interpreter ? "resolve" : "compile", samples.compile, samples.compile_allocations);
+    printPhase("exec", samples.exec, samples.exec_allocations);
+    std::fflush(stdout);
+    return 0;
+}
+
+void printUsage() {
+    std::cout << "Usage: nova_bench [--runs N] [--interp] [--no-jit] [--threads N | --scaling] [workload...]\n"
+              << "  --runs N    repetitions per workload (default 10)\n"
+              << "  --interp    execute with the tree-walking interpreter instead of the VM\n"
+              << "  --no-jit    keep hot loops and functions in the VM\n"
+              << "  --threads N run parallel loops on N threads (default: one per core)\n"
+              << "  --scaling   run every workload with 1, 2, 4, ... threads up to one per core\n"
+              << "  workload    a .nv file, @large, @many_functions or @many_variables (default: all benchmarks)\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int runs = 10;
+    bool use_interpreter = false;
+    bool use_jit = true;
+    size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<size_t> thread_counts(1, cores);
+    std::vector<std::string> workloads;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) {
+            runs = std::atoi(argv[++i]);
+        } else if (arg == "--interp") {
+            use_interpreter = true;
+        } else if (arg == "--no-jit") {
+            use_jit = false;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            int threads = std::atoi(argv[++i]);
+            if (threads < 1) {
+                printUsage();
+                return 1;
+            }
+            thread_counts.assign(1, static_cast<size_t>(threads));
+        } else if (arg == "--scaling") {
+            thread_counts.clear();
+            for (size_t threads = 1; threads < cores; threads *= 2) {
+                thread_counts.push_back(threads);
+            }
+            thread_counts.push_back(cores);
+        } else if (arg.empty() || arg[0] == '-') {
+            printUsage();
+            return 1;
+        } else {
+            workloads.push_back(arg);
+        }
+    }
+    if (runs < 1) {
+        printUsage();
+        return 1;
+    }
+    if (workloads.empty()) {
+        workloads.assign(std::begin(DEFAULT_WORKLOADS), std::end(DEFAULT_WORKLOADS));
+    }
+
+    int failures = 0;
+    for (const std::string& name : workloads) {
+        for (size_t threads : thread_counts) {
+            std::fflush(stdout);
+            pid_t child = fork();
+            if (child < 0) {
+                std::perror("fork");
+                return 1;
+            }
+            if (child == 0) {
+                std::_Exit(benchmarkWorkload(name, runs, use_interpreter, use_jit, threads));
+            }
+
+            int status = 0;
+            struct rusage usage;
+            if (wait4(child, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                ++failures;
+                continue;
+            }
+#ifdef __APPLE__
+            long peak_kib = usage.ru_maxrss / 1024; // bytes on macOS
+#else
+            long peak_kib = usage.ru_maxrss;        // KiB on Linux
+#endif
+            std::printf("  peak RSS %8ld KiB\n\n", peak_kib);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// Microbenchmark: arithmetic-loop throughput of the tagged Value against the
+// original layout that carried every payload side by side.
+//
+// Build: g++ -O2 -std=c++11 -Isrc benchmarks/value_layout.cpp src/value.cpp -o build/value_layout
+
+#include "value.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The Value struct as it was before the tagged representation.
+struct LegacyValue {
+    ValueType type;
+    int i_value;
+    std::string s_value;
+    bool b_value;
+    float f_value;
+    char c_value;
+
+    LegacyValue() : type(ValueType::NONE), i_value(0), b_value(false), f_value(0.0f), c_value('\0') {}
+    explicit LegacyValue(int i) : type(ValueType::NUMBER), i_value(i), b_value(false), f_value(0.0f), c_value('\0') {}
+    explicit LegacyValue(bool b) : type(ValueType::BOOLEAN), i_value(0), b_value(b), f_value(0.0f), c_value('\0') {}
+};
+
+// Runs the stack traffic the VM generates for
+//     while i < n start total = total + i * 2  i = i + 1 end
+// with slots 0 (i) and 1 (total) at the bottom of the value stack.
+template <typename V>
+static int runLoop(int n) {
+    std::vector<V> stack;
+    stack.reserve(64);
+    stack.push_back(V(0));
+    stack.push_back(V(0));
+    const V constants[] = { V(n), V(2), V(1) };
+
+    for (;;) {
+        stack.push_back(stack[0]);          // GET_LOCAL i
+        stack.push_back(constants[0]);      // CONSTANT n
+        V rhs = stack.back(); stack.pop_back();
+        stack.back() = V(stack.back().i_value < rhs.i_value); // LESS
+        V condition = stack.back(); stack.pop_back();
+        if (!condition.b_value) break;      // LOOP_IF_FALSE
+
+        stack.push_back(stack[1]);          // GET_LOCAL total
+        stack.push_back(stack[0]);          // GET_LOCAL i
+        stack.push_back(constants[1]);      // CONSTANT 2
+        rhs = stack.back(); stack.pop_back();
+        stack.back().i_value *= rhs.i_value; // MULTIPLY
+        rhs = stack.back(); stack.pop_back();
+        stack.back().i_value += rhs.i_value; // ADD
+        stack[1] = stack.back(); stack.pop_back(); // SET_LOCAL total
+
+        stack.push_back(stack[0]);          // GET_LOCAL i
+        stack.push_back(constants[2]);      // CONSTANT 1
+        rhs = stack.back(); stack.pop_back();
+        stack.back().i_value += rhs.i_value; // ADD
+        stack[0] = stack.back(); stack.pop_back(); // SET_LOCAL i
+    }
+    return stack[1].i_value;
+}
+
+template <typename V>
+static void report(const char* name, int n, int repeats) {
+    double best = 1e30;
+    int result = 0;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        result = runLoop<V>(n);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    std::printf("%-8s sizeof=%2zu  %8.1f M iterations/s  (checksum %d)\n",
+                name, sizeof(V), n / best / 1e6, result);
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? std::stoi(argv[1]) : 10000000;
+    report<LegacyValue>("legacy", n, 5);
+    report<Value>("tagged", n, 5);
+    return 0;
+}
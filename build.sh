@@ -1,10 +1,19 @@
 #!/bin/bash
 
+# Usage: ./build.sh          build the Supernova compiler
+#        ./build.sh lib      also build the embeddable library (build/libnova.a)
+#        ./build.sh bench    also build the library and the benchmarks (build/nova_bench, ...)
+
 # Create the build directory if it doesn't exist
 mkdir -p build
 
+SOURCES="src/lexer.cpp src/parser.cpp src/optimizer.cpp src/operations.cpp src/arrays.cpp src/resolver.cpp src/type_checker.cpp src/interpreter.cpp src/compiler.cpp src/vm.cpp src/jit.cpp src/c_emitter.cpp src/program_cache.cpp src/source_file.cpp src/output.cpp src/memo_cache.cpp src/profiler.cpp src/parallel.cpp src/tasks.cpp src/value.cpp src/allocators.cpp src/nova.cpp"
+# The command line on top of them; the library leaves these out
+CLI_SOURCES="src/driver.cpp src/server.cpp"
+CXXFLAGS="-std=c++11 -O2 -pthread"
+
 # Compile the Supernova compiler
-g++ src/main.cpp src/lexer.cpp src/parser.cpp -o build/supernova -std=c++11
+g++ src/main.cpp src/allocation_counter.cpp $CLI_SOURCES $SOURCES -o build/supernova $CXXFLAGS
 
 # Check if compilation was successful
 if [ $? -eq 0 ]; then
@@ -12,4 +21,32 @@ if [ $? -eq 0 ]; then
     echo "You can now run Nova source files using: ./build/supernova <your-file.nv>"
 else
     echo "Error: Supernova compiler failed to build."
-fi
\ No newline at end of file
+    exit 1
+fi
+
+if [ "$1" == "lib" ] || [ "$1" == "bench" ]; then
+    mkdir -p build/lib
+    rm -f build/lib/*.o build/libnova.a
+    for source in $SOURCES; do
+        g++ -c "$source" -o "build/lib/$(basename "${source%.cpp}").o" $CXXFLAGS || exit 1
+    done
+    ar rcs build/libnova.a build/lib/*.o
+    if [ $? -eq 0 ]; then
+        echo "Library built: ./build/libnova.a (include src/nova.hpp)"
+    else
+        echo "Error: libnova failed to build."
+        exit 1
+    fi
+fi
+
+if [ "$1" == "bench" ]; then
+    g++ benchmarks/harness.cpp src/allocation_counter.cpp $SOURCES -Isrc -o build/nova_bench $CXXFLAGS &&
+    g++ benchmarks/value_layout.cpp src/value.cpp -Isrc -o build/value_layout $CXXFLAGS &&
+    g++ benchmarks/embedding.cpp build/libnova.a -Isrc -o build/embedding $CXXFLAGS
+    if [ $? -eq 0 ]; then
+        echo "Benchmarks built: ./build/nova_bench, ./build/value_layout, ./build/embedding"
+    else
+        echo "Error: benchmarks failed to build."
+        exit 1
+    fi
+fi
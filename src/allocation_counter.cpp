@@ -0,0 +1,65 @@
+#include "allocation_counter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+
+static void* allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    // malloc(0) may return null; operator new must not
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+AllocationCount allocationCount() {
+    AllocationCount count;
+    count.allocations = allocations.load(std::memory_order_relaxed);
+    count.bytes = allocated_bytes.load(std::memory_order_relaxed);
+    return count;
+}
+
+void printAllocationStats(FILE* stream, const AllocationCount& compiling, const AllocationCount& running) {
+    std::fprintf(stream, "Allocations: %llu (%llu bytes) compiling, %llu (%llu bytes) running\n",
+                 static_cast<unsigned long long>(compiling.allocations),
+                 static_cast<unsigned long long>(compiling.bytes),
+                 static_cast<unsigned long long>(running.allocations),
+                 static_cast<unsigned long long>(running.bytes));
+}
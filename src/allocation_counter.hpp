@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+// Counts every heap allocation the process makes through operator new, so
+// that `--alloc-stats` and the benchmark harness can show how many a phase
+// of a run made. The counting replaces the global operator new and delete
+// in allocation_counter.cpp; only executables that link that file count,
+// and they pay one relaxed atomic add per allocation.
+
+struct AllocationCount {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    AllocationCount operator+(const AllocationCount& other) const {
+        AllocationCount count;
+        count.allocations = allocations + other.allocations;
+        count.bytes = bytes + other.bytes;
+        return count;
+    }
+
+    AllocationCount operator-(const AllocationCount& earlier) const {
+        AllocationCount count;
+        count.allocations = allocations - earlier.allocations;
+        count.bytes = bytes - earlier.bytes;
+        return count;
+    }
+};
+
+// Allocations made so far.
+AllocationCount allocationCount();
+
+// One line: allocations and bytes of each phase.
+void printAllocationStats(FILE* stream, const AllocationCount& compiling, const AllocationCount& running);
@@ -0,0 +1,77 @@
+#include "allocators.hpp"
+#include <algorithm>
+#include <cstdint>
+
+Arena::~Arena() {
+    for (const Block& block : block_list) {
+        ::operator delete(block.data);
+    }
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    for (;;) {
+        if (cursor) {
+            uintptr_t address = reinterpret_cast<uintptr_t>(cursor);
+            char* start = cursor + ((alignment - address % alignment) % alignment);
+            if (start + size <= limit) {
+                cursor = start + size;
+                return start;
+            }
+        }
+        // Move on to the next block kept from before a rewind, or add one
+        size_t next = cursor ? current + 1 : 0;
+        if (next == block_list.size()) {
+            Block block;
+            block.size = std::max(block_size, size + alignment);
+            block.data = static_cast<char*>(::operator new(block.size));
+            block_list.push_back(block);
+        }
+        current = next;
+        cursor = block_list[current].data;
+        limit = cursor + block_list[current].size;
+    }
+}
+
+void Arena::rewind() {
+    current = 0;
+    cursor = nullptr;
+    limit = nullptr;
+}
+
+SmallObjectPool::~SmallObjectPool() {
+    for (char* slab : slabs) {
+        ::operator delete(slab);
+    }
+}
+
+void* SmallObjectPool::allocate(size_t size) {
+    if (size == 0 || size > MAX_SIZE) {
+        return ::operator new(size);
+    }
+    size_t size_class = (size - 1) / GRANULE;
+    if (FreeBlock* block = free_lists[size_class]) {
+        free_lists[size_class] = block->next;
+        return block;
+    }
+    size_t bytes = (size_class + 1) * GRANULE;
+    if (!cursor || cursor + bytes > limit) {
+        // The rest of the old slab, smaller than this block, is left unused
+        slabs.push_back(static_cast<char*>(::operator new(SLAB_SIZE)));
+        cursor = slabs.back();
+        limit = cursor + SLAB_SIZE;
+    }
+    void* memory = cursor;
+    cursor += bytes;
+    return memory;
+}
+
+void SmallObjectPool::deallocate(void* memory, size_t size) {
+    if (size == 0 || size > MAX_SIZE) {
+        ::operator delete(memory);
+        return;
+    }
+    size_t size_class = (size - 1) / GRANULE;
+    FreeBlock* block = static_cast<FreeBlock*>(memory);
+    block->next = free_lists[size_class];
+    free_lists[size_class] = block;
+}
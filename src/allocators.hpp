@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Allocators for the two kinds of objects that used to cost a malloc each:
+//
+// - Arena: syntax tree nodes, which are made one by one while parsing and
+//   released together once their statement is compiled. They are bumped out
+//   of large blocks, and the blocks are reused once every node is gone.
+// - SmallObjectPool: memo cache entries and similar small objects that come
+//   and go in any order. Freed blocks go on a free list per size and are
+//   handed out again, so a cache that evicts as fast as it stores does not
+//   allocate at all.
+//
+// Neither is thread-safe; each belongs to one owner at a time.
+
+class Arena {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 32 * 1024;
+
+    explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE) : block_size(block_size) {}
+    ~Arena(); // every object must have been destroyed
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        live++;
+        return object;
+    }
+
+    // Once no object is left the arena starts over from its first block.
+    template <typename T>
+    void destroy(T* object) {
+        object->~T();
+        if (--live == 0) {
+            rewind();
+        }
+    }
+
+    // Blocks allocated so far, whether in use or kept for reuse.
+    size_t blocks() const { return block_list.size(); }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    size_t block_size;
+    std::vector<Block> block_list;
+    size_t current = 0; // block the cursor is in
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t live = 0;
+
+    void* allocate(size_t size, size_t alignment);
+    void rewind();
+};
+
+// Deleter of the unique_ptrs that own arena objects.
+template <typename T>
+struct ArenaDeleter {
+    Arena* arena = nullptr;
+
+    ArenaDeleter() {}
+    explicit ArenaDeleter(Arena* arena) : arena(arena) {}
+
+    void operator()(T* object) const { arena->destroy(object); }
+};
+
+class SmallObjectPool {
+public:
+    // Larger requests go straight to operator new.
+    static const size_t MAX_SIZE = 256;
+
+    SmallObjectPool() {}
+    ~SmallObjectPool(); // every object must have been returned
+    SmallObjectPool(const SmallObjectPool&) = delete;
+    SmallObjectPool& operator=(const SmallObjectPool&) = delete;
+
+    void* allocate(size_t size);
+    void deallocate(void* memory, size_t size);
+
+private:
+    static const size_t GRANULE = 16; // sizes are rounded up to this, which also aligns them
+    static const size_t SLAB_SIZE = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    FreeBlock* free_lists[MAX_SIZE / GRANULE] = {};
+    std::vector<char*> slabs;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+};
+
+// Standard allocator over a SmallObjectPool, for the nodes of std::list and
+// the unordered containers.
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    SmallObjectPool* pool;
+
+    explicit PoolAllocator(SmallObjectPool* pool) : pool(pool) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(pool->allocate(count * sizeof(T))); }
+    void deallocate(T* memory, size_t count) { pool->deallocate(memory, count * sizeof(T)); }
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+    return a.pool == b.pool;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) {
+    return a.pool != b.pool;
+}
@@ -0,0 +1,490 @@
+#include "arrays.hpp"
+#include "error.hpp"
+#include "operations.hpp"
+#include <cstdint>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+namespace {
+
+// One side of an element-wise kernel: the elements of an array, or a single
+// number standing for every element.
+template <typename T>
+struct Operand {
+    const T* data;
+    bool broadcast;
+
+    T at(size_t i) const { return broadcast ? data[0] : data[i]; }
+};
+
+#if defined(__SSE2__)
+inline __m128i load(const Operand<int>& operand, size_t i) {
+    return operand.broadcast ? _mm_set1_epi32(operand.data[0])
+                             : _mm_loadu_si128(reinterpret_cast<const __m128i*>(operand.data + i));
+}
+
+inline __m128 load(const Operand<float>& operand, size_t i) {
+    return operand.broadcast ? _mm_set1_ps(operand.data[0]) : _mm_loadu_ps(operand.data + i);
+}
+
+inline __m128i loadInts(const int* data) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+// Low 32 bits of each product; SSE2 only multiplies the even lanes.
+inline __m128i multiply(__m128i a, __m128i b) {
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+inline void store(int* out, __m128i lanes) { _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lanes); }
+inline void store(float* out, __m128 lanes) { _mm_storeu_ps(out, lanes); }
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+struct Add {
+    int operator()(int a, int b) const { return wrappingAdd(a, b); }
+    float operator()(float a, float b) const { return a + b; }
+#if defined(__SSE2__)
+    __m128i operator()(__m128i a, __m128i b) const { return _mm_add_epi32(a, b); }
+    __m128 operator()(__m128 a, __m128 b) const { return _mm_add_ps(a, b); }
+#endif
+};
+
+struct Subtract {
+    int operator()(int a, int b) const { return wrappingSubtract(a, b); }
+    float operator()(float a, float b) const { return a - b; }
+#if defined(__SSE2__)
+    __m128i operator()(__m128i a, __m128i b) const { return _mm_sub_epi32(a, b); }
+    __m128 operator()(__m128 a, __m128 b) const { return _mm_sub_ps(a, b); }
+#endif
+};
+
+struct Multiply {
+    int operator()(int a, int b) const { return wrappingMultiply(a, b); }
+    float operator()(float a, float b) const { return a * b; }
+#if defined(__SSE2__)
+    __m128i operator()(__m128i a, __m128i b) const { return multiply(a, b); }
+    __m128 operator()(__m128 a, __m128 b) const { return _mm_mul_ps(a, b); }
+#endif
+};
+
+struct Divide {
+    float operator()(float a, float b) const { return a / b; }
+#if defined(__SSE2__)
+    __m128 operator()(__m128 a, __m128 b) const { return _mm_div_ps(a, b); }
+#endif
+};
+
+template <typename T, typename Kernel>
+void elementwise(Kernel kernel, Operand<T> a, Operand<T> b, T* out, size_t count) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        store(out + i, kernel(load(a, i), load(b, i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = kernel(a.at(i), b.at(i));
+    }
+}
+
+template <typename T>
+void checkDivisors(Operand<T> divisor, size_t count) {
+    for (size_t i = 0; i < (divisor.broadcast ? 1 : count); ++i) {
+        if (divisor.data[i] == 0) {
+            throw RuntimeError("Division by zero.");
+        }
+    }
+}
+
+// No integer division in SSE2; division checks every divisor before writing
+// anything, so a failed division leaves an array updated in place unchanged.
+void apply(TokenType op, Operand<int> a, Operand<int> b, int* out, size_t count) {
+    switch (op) {
+        case TokenType::PLUS: elementwise(Add(), a, b, out, count); break;
+        case TokenType::MINUS: elementwise(Subtract(), a, b, out, count); break;
+        case TokenType::STAR: elementwise(Multiply(), a, b, out, count); break;
+        default:
+            checkDivisors(b, count);
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = wrappingDivide(a.at(i), b.at(i));
+            }
+    }
+}
+
+void apply(TokenType op, Operand<float> a, Operand<float> b, float* out, size_t count) {
+    switch (op) {
+        case TokenType::PLUS: elementwise(Add(), a, b, out, count); break;
+        case TokenType::MINUS: elementwise(Subtract(), a, b, out, count); break;
+        case TokenType::STAR: elementwise(Multiply(), a, b, out, count); break;
+        default:
+            checkDivisors(b, count);
+            elementwise(Divide(), a, b, out, count);
+    }
+}
+
+// Integer reductions wrap around like the scalar operators.
+int sum(const int* data, size_t count) {
+    uint32_t total = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i lanes = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        lanes = _mm_add_epi32(lanes, loadInts(data + i));
+    }
+    uint32_t partial[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(partial), lanes);
+    total = partial[0] + partial[1] + partial[2] + partial[3];
+#endif
+    for (; i < count; ++i) {
+        total += static_cast<uint32_t>(data[i]);
+    }
+    return static_cast<int>(total);
+}
+
+// Float sums keep four partial sums, so they may round differently from
+// adding the elements one by one.
+float sum(const float* data, size_t count) {
+    float total = 0.0f;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128 lanes = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        lanes = _mm_add_ps(lanes, _mm_loadu_ps(data + i));
+    }
+    float partial[4];
+    _mm_storeu_ps(partial, lanes);
+    total = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+    for (; i < count; ++i) {
+        total += data[i];
+    }
+    return total;
+}
+
+int dot(const int* a, const int* b, size_t count) {
+    uint32_t total = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i lanes = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        lanes = _mm_add_epi32(lanes, multiply(loadInts(a + i), loadInts(b + i)));
+    }
+    uint32_t partial[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(partial), lanes);
+    total = partial[0] + partial[1] + partial[2] + partial[3];
+#endif
+    for (; i < count; ++i) {
+        total += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+    }
+    return static_cast<int>(total);
+}
+
+float dot(const float* a, const float* b, size_t count) {
+    float total = 0.0f;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128 lanes = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        lanes = _mm_add_ps(lanes, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float partial[4];
+    _mm_storeu_ps(partial, lanes);
+    total = (partial[0] + partial[1]) + (partial[2] + partial[3]);
+#endif
+    for (; i < count; ++i) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+// Smallest element, or the largest when `largest` is set; `count` > 0.
+int extreme(const int* data, size_t count, bool largest) {
+    int best = data[0];
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i lanes = _mm_set1_epi32(best);
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = loadInts(data + i);
+        __m128i better = largest ? _mm_cmpgt_epi32(x, lanes) : _mm_cmplt_epi32(x, lanes);
+        lanes = select(better, x, lanes);
+    }
+    int partial[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(partial), lanes);
+    for (int lane = 0; lane < 4; ++lane) {
+        if (largest ? partial[lane] > best : partial[lane] < best) best = partial[lane];
+    }
+#endif
+    for (; i < count; ++i) {
+        if (largest ? data[i] > best : data[i] < best) best = data[i];
+    }
+    return best;
+}
+
+float extreme(const float* data, size_t count, bool largest) {
+    float best = data[0];
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128 lanes = _mm_set1_ps(best);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(data + i);
+        lanes = largest ? _mm_max_ps(x, lanes) : _mm_min_ps(x, lanes);
+    }
+    float partial[4];
+    _mm_storeu_ps(partial, lanes);
+    for (int lane = 0; lane < 4; ++lane) {
+        if (largest ? partial[lane] > best : partial[lane] < best) best = partial[lane];
+    }
+#endif
+    for (; i < count; ++i) {
+        if (largest ? data[i] > best : data[i] < best) best = data[i];
+    }
+    return best;
+}
+
+bool isNumeric(const Value& value) {
+    return value.type == ValueType::NUMBER || value.type == ValueType::FLOAT;
+}
+
+const ArrayObject& requireArray(const Value& value, const char* what) {
+    if (value.type != ValueType::ARRAY) {
+        throw RuntimeError(std::string(what) + " can only be used on arrays.");
+    }
+    return *value.array_object;
+}
+
+// The elements of `array`, copied first if another value shares them.
+ArrayObject& own(Value& array, const char* what) {
+    requireArray(array, what);
+    if (array.array_object->refs.load(std::memory_order_acquire) != 1) {
+        array = Value(new ArrayObject(*array.array_object));
+    }
+    return *array.array_object;
+}
+
+void checkElement(const Value& element) {
+    if (!isNumeric(element)) {
+        throw RuntimeError("Array elements must be numbers or floats.");
+    }
+}
+
+int asInt(const Value& value) {
+    return value.type == ValueType::NUMBER ? value.i_value : static_cast<int>(value.f_value);
+}
+
+float asFloat(const Value& value) {
+    return value.type == ValueType::NUMBER ? static_cast<float>(value.i_value) : value.f_value;
+}
+
+ValueType elementType(const Value& value) {
+    return value.type == ValueType::ARRAY ? value.array_object->element_type : value.type;
+}
+
+size_t checkedIndex(const ArrayObject& array, const Value& index) {
+    if (index.type != ValueType::NUMBER) {
+        throw RuntimeError("Array index must be a number.");
+    }
+    if (index.i_value < 0 || static_cast<size_t>(index.i_value) >= array.size()) {
+        throw RuntimeError("Array index " + std::to_string(index.i_value) + " is out of range for length "
+                           + std::to_string(array.size()) + ".");
+    }
+    return static_cast<size_t>(index.i_value);
+}
+
+size_t commonLength(const Value& lhs, const Value& rhs) {
+    if (lhs.type != ValueType::ARRAY) return rhs.array_object->size();
+    if (rhs.type != ValueType::ARRAY) return lhs.array_object->size();
+    size_t a = lhs.array_object->size();
+    size_t b = rhs.array_object->size();
+    if (a != b) {
+        throw RuntimeError("Array lengths differ: " + std::to_string(a) + " and " + std::to_string(b) + ".");
+    }
+    return a;
+}
+
+Operand<int> intOperand(const Value& value) {
+    if (value.type == ValueType::ARRAY) {
+        return Operand<int>{ value.array_object->nums.data(), false };
+    }
+    return Operand<int>{ &value.i_value, true };
+}
+
+// Num elements and numbers are widened into `widened`.
+Operand<float> floatOperand(const Value& value, std::vector<float>& widened) {
+    if (value.type != ValueType::ARRAY) {
+        widened.assign(1, asFloat(value));
+        return Operand<float>{ widened.data(), true };
+    }
+    const ArrayObject& array = *value.array_object;
+    if (array.element_type == ValueType::FLOAT) {
+        return Operand<float>{ array.floats.data(), false };
+    }
+    widened.assign(array.nums.begin(), array.nums.end());
+    return Operand<float>{ widened.data(), false };
+}
+
+// Computes `lhs op rhs` into `target`, which may be the elements of `lhs`.
+void combine(TokenType op, const Value& lhs, const Value& rhs, ArrayObject& target, size_t count) {
+    if (target.element_type == ValueType::NUMBER) {
+        target.nums.resize(count);
+        apply(op, intOperand(lhs), intOperand(rhs), target.nums.data(), count);
+        return;
+    }
+    std::vector<float> widened_lhs;
+    std::vector<float> widened_rhs;
+    Operand<float> a = floatOperand(lhs, widened_lhs);
+    Operand<float> b = floatOperand(rhs, widened_rhs);
+    target.floats.resize(count);
+    apply(op, a, b, target.floats.data(), count);
+}
+
+ValueType resultType(const Value& lhs, const Value& rhs) {
+    bool floats = elementType(lhs) == ValueType::FLOAT || elementType(rhs) == ValueType::FLOAT;
+    return floats ? ValueType::FLOAT : ValueType::NUMBER;
+}
+
+} // namespace
+
+Value makeArray(const Value* elements, size_t count) {
+    ValueType type = ValueType::NUMBER;
+    for (size_t i = 0; i < count; ++i) {
+        checkElement(elements[i]);
+        if (elements[i].type == ValueType::FLOAT) type = ValueType::FLOAT;
+    }
+    Value array(new ArrayObject(type));
+    ArrayObject& object = *array.array_object;
+    for (size_t i = 0; i < count; ++i) {
+        if (type == ValueType::NUMBER) {
+            object.nums.push_back(elements[i].i_value);
+        } else {
+            object.floats.push_back(asFloat(elements[i]));
+        }
+    }
+    return array;
+}
+
+Value arrayIndex(const Value& array, const Value& index) {
+    const ArrayObject& object = requireArray(array, "Indexing");
+    size_t i = checkedIndex(object, index);
+    return object.element_type == ValueType::NUMBER ? Value(object.nums[i]) : Value(object.floats[i]);
+}
+
+void arrayStore(Value& array, const Value& index, const Value& element) {
+    checkedIndex(requireArray(array, "Indexing"), index);
+    checkElement(element);
+    ArrayObject& object = own(array, "Indexing");
+    size_t i = static_cast<size_t>(index.i_value);
+    if (object.element_type == ValueType::NUMBER) {
+        object.nums[i] = asInt(element);
+    } else {
+        object.floats[i] = asFloat(element);
+    }
+}
+
+void arrayAppend(Value& array, const Value& element) {
+    requireArray(array, "'.append'");
+    checkElement(element);
+    ArrayObject& object = own(array, "'.append'");
+    if (object.element_type == ValueType::NUMBER) {
+        object.nums.push_back(asInt(element));
+    } else {
+        object.floats.push_back(asFloat(element));
+    }
+}
+
+Value arrayLength(const Value& array) {
+    return Value(static_cast<int>(requireArray(array, "'.length'").size()));
+}
+
+Value arraySum(const Value& array) {
+    const ArrayObject& object = requireArray(array, "'.sum'");
+    if (object.element_type == ValueType::NUMBER) {
+        return Value(sum(object.nums.data(), object.nums.size()));
+    }
+    return Value(sum(object.floats.data(), object.floats.size()));
+}
+
+static Value extremeOf(const Value& array, bool largest) {
+    const ArrayObject& object = requireArray(array, largest ? "'.max'" : "'.min'");
+    if (object.size() == 0) {
+        throw RuntimeError(std::string("Cannot take the ") + (largest ? "max" : "min") + " of an empty array.");
+    }
+    if (object.element_type == ValueType::NUMBER) {
+        return Value(extreme(object.nums.data(), object.nums.size(), largest));
+    }
+    return Value(extreme(object.floats.data(), object.floats.size(), largest));
+}
+
+Value arrayMin(const Value& array) {
+    return extremeOf(array, false);
+}
+
+Value arrayMax(const Value& array) {
+    return extremeOf(array, true);
+}
+
+Value arrayDot(const Value& lhs, const Value& rhs) {
+    const ArrayObject& a = requireArray(lhs, "'.dot'");
+    if (rhs.type != ValueType::ARRAY) {
+        throw RuntimeError("The argument of '.dot' must be an array.");
+    }
+    size_t count = commonLength(lhs, rhs);
+    const ArrayObject& b = *rhs.array_object;
+    if (a.element_type == ValueType::NUMBER && b.element_type == ValueType::NUMBER) {
+        return Value(dot(a.nums.data(), b.nums.data(), count));
+    }
+    std::vector<float> widened_a;
+    std::vector<float> widened_b;
+    return Value(dot(floatOperand(lhs, widened_a).data, floatOperand(rhs, widened_b).data, count));
+}
+
+Value arrayArithmetic(TokenType op, const Value& lhs, const Value& rhs) {
+    size_t count = commonLength(lhs, rhs);
+    Value result(new ArrayObject(resultType(lhs, rhs)));
+    combine(op, lhs, rhs, *result.array_object, count);
+    return result;
+}
+
+void arrayArithmeticInPlace(TokenType op, Value& lhs, const Value& rhs) {
+    if (lhs.type == ValueType::ARRAY && lhs.array_object->refs.load(std::memory_order_acquire) == 1
+        && lhs.array_object->element_type == resultType(lhs, rhs)) {
+        combine(op, lhs, rhs, *lhs.array_object, commonLength(lhs, rhs));
+        return;
+    }
+    lhs = arrayArithmetic(op, lhs, rhs);
+}
+
+bool convertArray(ValueType element_type, const Value& value, Value& converted) {
+    if (value.type != ValueType::ARRAY) {
+        return false;
+    }
+    const ArrayObject& array = *value.array_object;
+    if (array.element_type == element_type) {
+        converted = value;
+        return true;
+    }
+    Value result(new ArrayObject(element_type));
+    if (element_type == ValueType::NUMBER) {
+        result.array_object->nums.assign(array.floats.begin(), array.floats.end());
+    } else {
+        result.array_object->floats.assign(array.nums.begin(), array.nums.end());
+    }
+    converted = std::move(result);
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "lexer.hpp"
+#include "value.hpp"
+
+// Runtime semantics of num[] and float[] arrays, shared by every execution
+// engine. Elements are stored unboxed, so whole-array arithmetic and the
+// reductions run as tight kernels (SSE2 where the target has it) instead of
+// one dispatched instruction per element.
+//
+// Arrays are values: copies share the elements, and changing an array that
+// is shared copies it first, so no other variable sees the change.
+
+// Array literal: num[] when every element is a num, float[] when any is a
+// float. An empty literal is a num[].
+Value makeArray(const Value* elements, size_t count);
+
+// `array[index]`.
+Value arrayIndex(const Value& array, const Value& index);
+
+// `array[index] = element` and `array.append(element)`; the element is
+// converted to the element type like a declaration.
+void arrayStore(Value& array, const Value& index, const Value& element);
+void arrayAppend(Value& array, const Value& element);
+
+// `.length`, `.sum`, `.min`, `.max` and `.dot(other)`.
+Value arrayLength(const Value& array);
+Value arraySum(const Value& array);
+Value arrayMin(const Value& array);
+Value arrayMax(const Value& array);
+Value arrayDot(const Value& lhs, const Value& rhs);
+
+// Element-wise `+ - * /` where either operand is an array and the other an
+// array of the same length or a number; float if either side is.
+Value arrayArithmetic(TokenType op, const Value& lhs, const Value& rhs);
+
+// Same as `lhs = arrayArithmetic(op, lhs, rhs)`, writing into the elements
+// of `lhs` when it owns them exclusively and keeps its element type.
+void arrayArithmeticInPlace(TokenType op, Value& lhs, const Value& rhs);
+
+// Converts a whole array to `element_type` (NUMBER or FLOAT) for a
+// `num[]` or `float[]` declaration; false if `value` is not an array.
+bool convertArray(ValueType element_type, const Value& value, Value& converted);
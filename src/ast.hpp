@@ -0,0 +1,176 @@
+#pragma once
+#include "allocators.hpp"
+#include "lexer.hpp"
+#include "value.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Syntax tree produced once by Parser and walked by the Interpreter.
+// Nodes are plain tagged structs: every pass switches on `kind`. They are
+// allocated in the Program's arena.
+
+struct Expr;
+struct Stmt;
+typedef std::unique_ptr<Expr, ArenaDeleter<Expr>> ExprPtr;
+typedef std::unique_ptr<Stmt, ArenaDeleter<Stmt>> StmtPtr;
+
+enum class ExprKind {
+    LITERAL,
+    VARIABLE,
+    BINARY,
+    CALL,
+    ARRAY,  // `[a, b, ...]`
+    INDEX,  // `array[index]`
+    METHOD, // `value.name` or `value.name(argument)`
+    CHANNEL // `channel(capacity)`
+};
+
+// Built-in operations on arrays and channels.
+enum class Method : uint8_t {
+    LENGTH,
+    SUM,
+    MIN,
+    MAX,
+    DOT,     // takes another array
+    APPEND,  // takes an element; only as a statement, see StmtKind::APPEND
+    SEND,    // takes a value to send; only as a statement
+    RECEIVE
+};
+
+// How a `parallel` loop combines the results its chunks computed for a
+// variable of the enclosing scope.
+enum class Reduction : uint8_t {
+    SUM,
+    MIN,
+    MAX
+};
+
+struct Argument {
+    std::string name;
+    ExprPtr value;
+};
+
+// Slot value of a variable read that no declaration reaches.
+const int UNRESOLVED_SLOT = -1;
+
+struct ReductionClause {
+    std::string name;
+    Reduction kind = Reduction::SUM;
+    int slot = UNRESOLVED_SLOT;
+};
+
+// Callee of a call whose name has several declarations; bound by name at runtime.
+const size_t DYNAMIC_FUNCTION = static_cast<size_t>(-1);
+
+// Entries of Expr::bindings for parameters that no argument names.
+const int DEFAULT_ARGUMENT = -1;
+const int MISSING_ARGUMENT = -2;
+
+// Type the TypeChecker proved an expression has whenever it is evaluated;
+// DYNAMIC when it depends on the run.
+enum class StaticType : uint8_t {
+    DYNAMIC,
+    NUM,
+    FLOAT,
+    BOOL,
+    STRING,
+    CHAR,
+    NUM_ARRAY,
+    FLOAT_ARRAY,
+    CHANNEL
+};
+
+struct Expr {
+    ExprKind kind;
+    uint32_t line = 0;          // source line of the expression's first token
+    Value literal;              // LITERAL
+    std::string name;           // VARIABLE, CALL
+    int slot = UNRESOLVED_SLOT; // VARIABLE: frame slot assigned by the Resolver
+    TokenType op = TokenType::UNKNOWN; // BINARY
+    ExprPtr lhs;                // BINARY, INDEX: the array, METHOD: the array or channel
+    ExprPtr rhs;                // BINARY, INDEX: the index, METHOD: the argument of DOT or SEND, CHANNEL: the capacity
+    std::vector<ExprPtr> elements; // ARRAY
+    Method method = Method::LENGTH; // METHOD
+    std::vector<Argument> args; // CALL
+    size_t function = DYNAMIC_FUNCTION; // CALL: index into Program::functions
+    std::vector<int> bindings;  // CALL: argument index for each parameter of `function`
+    bool in_order = false;      // CALL: arguments already match the parameter list
+    uint32_t call_site = 0;     // CALL to DYNAMIC_FUNCTION: index of the call's inline cache
+    StaticType static_type = StaticType::DYNAMIC; // set by the TypeChecker
+
+    explicit Expr(ExprKind kind) : kind(kind) {}
+};
+
+enum class StmtKind {
+    SHOW,
+    VAR_DECL,
+    ASSIGN,
+    IF,
+    WHILE,
+    FUN_DECL,
+    RETURN,
+    EXPRESSION,
+    STORE_INDEX, // `name[index] = expr`
+    APPEND,      // `name.append(expr)`
+    PARALLEL,    // `parallel name = expr to limit ... start body end`
+    SPAWN,       // `spawn f ...`: expr is the call, run as a new task
+    BLOCK // statements in their own scope, left by the Optimizer in place of a decided `if`
+};
+
+struct Stmt {
+    StmtKind kind;
+    uint32_t line = 0;             // source line of the statement's first token
+    std::string name;              // VAR_DECL, ASSIGN, STORE_INDEX, APPEND, PARALLEL: the index
+    int slot = UNRESOLVED_SLOT;    // VAR_DECL, ASSIGN, STORE_INDEX, APPEND, PARALLEL: frame slot assigned by the Resolver;
+                                   // PARALLEL: the next slot holds the end of the running chunk
+    bool in_place = false;         // ASSIGN: `name = name op ...`, updates the slot in place
+    TokenType type = TokenType::UNKNOWN; // VAR_DECL: type annotation keyword
+    ExprPtr expr;                  // value, condition, returned expression, first index or spawned call
+    ExprPtr index;                 // STORE_INDEX; PARALLEL: the limit, excluded
+    std::vector<ReductionClause> reductions; // PARALLEL
+    std::vector<StmtPtr> body;     // IF, WHILE, BLOCK, PARALLEL
+    std::vector<StmtPtr> else_body; // IF
+    bool has_else = false;         // IF
+    size_t function = 0;           // FUN_DECL: index into Program::functions
+
+    explicit Stmt(StmtKind kind) : kind(kind) {}
+};
+
+struct ParameterDecl {
+    std::string name;
+    TokenType type = TokenType::IDENTIFIER; // annotation keyword, IDENTIFIER for other type names
+    ExprPtr default_value; // null when the parameter is required
+};
+
+// Variable of the script that an embedding host sets before each run, see
+// nova.hpp. Inputs take the first slots of the script's frame, in order.
+struct InputDecl {
+    std::string name;
+    TokenType type; // like ParameterDecl::type
+
+    InputDecl(std::string name, TokenType type = TokenType::IDENTIFIER) : name(std::move(name)), type(type) {}
+};
+
+struct FunctionDecl {
+    std::string name;
+    uint32_t line = 0;
+    TokenType return_type = TokenType::IDENTIFIER; // like ParameterDecl::type
+    std::vector<ParameterDecl> parameters;
+    std::vector<StmtPtr> body;
+    size_t slot_count = 0; // frame size; parameters occupy the first slots
+    bool is_pure = false;  // set by the Resolver: results depend only on the arguments
+};
+
+struct Program {
+    // Holds the nodes, so it is declared first and destroyed last
+    std::unique_ptr<Arena> arena{new Arena()};
+    std::vector<StmtPtr> statements;
+    size_t slot_count = 0; // frame size of the top-level script
+    size_t call_sites = 0; // calls bound by name, numbered by the Resolver
+    std::vector<std::unique_ptr<FunctionDecl>> functions;
+    // Name of every function declaration in source order, known before
+    // parsing starts; function i is named function_names[i].
+    std::vector<std::string> function_names;
+    std::vector<InputDecl> inputs; // set before resolving
+};
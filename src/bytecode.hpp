@@ -0,0 +1,124 @@
+#pragma once
+#include "lexer.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Instruction set of the Supernova virtual machine. Operands follow the
+// opcode byte and are little-endian. Frame slots, names and functions are
+// 32-bit indices, so generated scripts are not limited to 65536 of each.
+enum class OpCode : uint8_t {
+    CONSTANT,          // u16 constant index
+    CONSTANT_LONG,     // u32 constant index, for chunks with more than 65536 constants
+    GET_LOCAL,         // u32 frame slot
+    SET_LOCAL,         // u32 frame slot; pops the new value
+    DECLARE_LOCAL,     // u32 frame slot, u8 TokenType of the annotation; pops
+    UNDEFINED_VARIABLE, // u32 name index; raises "Undefined variable"
+    UPDATE_LOCAL,      // u32 frame slot, u8 TokenType operator; pops rhs, slot = slot op rhs
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    EQUAL,
+    NOT_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    // Typed forms of the ten operators above, in the same order, for operands
+    // the TypeChecker proved to be nums or floats; they never check tags
+    ADD_NUM,
+    SUBTRACT_NUM,
+    MULTIPLY_NUM,
+    DIVIDE_NUM,
+    EQUAL_NUM,
+    NOT_EQUAL_NUM,
+    GREATER_NUM,
+    GREATER_EQUAL_NUM,
+    LESS_NUM,
+    LESS_EQUAL_NUM,
+    ADD_FLOAT,
+    SUBTRACT_FLOAT,
+    MULTIPLY_FLOAT,
+    DIVIDE_FLOAT,
+    EQUAL_FLOAT,
+    NOT_EQUAL_FLOAT,
+    GREATER_FLOAT,
+    GREATER_EQUAL_FLOAT,
+    LESS_FLOAT,
+    LESS_EQUAL_FLOAT,
+    CONCAT,            // `+` of two strings
+    NUM_TO_FLOAT,      // converts the num on top
+    FLOAT_TO_NUM,      // converts the float on top, truncating like a declaration
+    UPDATE_LOCAL_NUM,  // operands as UPDATE_LOCAL; a num slot updated by a num
+    UPDATE_LOCAL_FLOAT, // operands as UPDATE_LOCAL; a float slot updated by a float
+    SHOW,              // pops and prints
+    POP,
+    JUMP,              // u32 forward offset
+    JUMP_IF_FALSE,     // u32 forward offset; pops, `if` truthiness
+    JUMP_IF_FALSE_BOOL, // u32 forward offset; pops a bool, for `if` and `while`
+    LOOP_IF_FALSE,     // u32 forward offset; pops, `while` truthiness
+    LOOP,              // u32 backward offset, u32 loop index (counts iterations for the JIT)
+    DEFINE_FUNCTION,   // u32 function index; pops one value per defaulted parameter
+    CALL,              // u32 name index, u8 argc, u32 call site, then argc u32 argument name indices
+    CALL_DIRECT,       // u32 function index, u8 argc; arguments already in parameter order
+    CALL_BIND,         // u32 function index, u8 argc, then one u8 binding per parameter
+    RETURN,            // pops the result
+    RETURN_NONE,
+    COUNT_LINE,        // u32 source line; counts a statement, emitted only when profiling
+    ARRAY,             // u32 element count; pops the elements, pushes the array
+    INDEX,             // pops index and array, pushes the element
+    ARRAY_LENGTH,      // replaces the array on top with its length
+    ARRAY_SUM,
+    ARRAY_MIN,
+    ARRAY_MAX,
+    ARRAY_DOT,         // pops the argument and the array, pushes their dot product
+    STORE_INDEX,       // u32 frame slot; pops the element and the index
+    APPEND,            // u32 frame slot; pops the element
+    // u32 index slot, u8 reduction count, then per reduction a u32 slot and
+    // a u8 Reduction, then u32 forward offset past the body; pops the limit
+    // and the first index. The body follows: a loop from the index slot to
+    // the end of the chunk in the slot after it, then PARALLEL_END
+    PARALLEL,
+    PARALLEL_END,      // ends the run of one chunk
+    SPAWN,             // prefix of a CALL, CALL_DIRECT or CALL_BIND whose call starts a new task
+    CHANNEL,           // pops the capacity, pushes a new channel
+    SEND,              // pops the value and the channel; waits while the channel is full
+    RECEIVE,           // replaces the channel on top with its oldest value; waits while it is empty
+    PAUSE              // ends the part of the script compiled so far, see VM::resume
+};
+
+// CALL_BIND entries for parameters that no argument names.
+const uint8_t BIND_DEFAULT = 0xff;
+const uint8_t BIND_MISSING = 0xfe;
+
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+};
+
+struct CompiledParameter {
+    uint32_t name;
+    bool has_default_value;
+    TokenType type; // annotation, see ParameterDecl::type
+};
+
+struct CompiledFunction {
+    uint32_t name;
+    uint32_t line = 0; // of the declaration
+    bool is_pure = false; // see Resolver; calls may be memoized
+    std::vector<CompiledParameter> parameters;
+    size_t slot_count; // frame size; parameters occupy the first slots
+    Chunk chunk;
+};
+
+// Output of the Compiler. Every identifier is interned once in `names` and
+// referred to by index from the bytecode.
+struct CompiledProgram {
+    CompiledFunction script;
+    std::vector<CompiledFunction> functions;
+    std::vector<std::string> names;
+    size_t call_sites = 0; // CALL instructions, each with its own inline cache in the VM
+    size_t loop_count = 0; // LOOP instructions
+};
@@ -0,0 +1,1270 @@
+#include "c_emitter.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Runtime of an emitted program: the dynamic value type and the operations
+// of operations.cpp, `show` formatting of output.cpp and the call depth
+// checks. The script runs on a thread with a large stack since Nova calls
+// recurse natively here.
+static const char* const RUNTIME_HEAD = R"(#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace nv {
+
+struct Error {
+    std::string message;
+};
+
+[[noreturn]] inline void fail(const std::string& message) {
+    throw Error{ message };
+}
+
+enum class Type : unsigned char { NUMBER, STRING, BOOLEAN, FLOAT, CHAR, NONE };
+
+struct Value {
+    Type type = Type::NONE;
+    int i = 0;
+    float f = 0.0f;
+    bool b = false;
+    char c = 0;
+    std::string s;
+
+    Value() {}
+    explicit Value(int value) : type(Type::NUMBER), i(value) {}
+    explicit Value(float value) : type(Type::FLOAT), f(value) {}
+    explicit Value(bool value) : type(Type::BOOLEAN), b(value) {}
+    explicit Value(char value) : type(Type::CHAR), c(value) {}
+    explicit Value(std::string value) : type(Type::STRING), s(std::move(value)) {}
+};
+
+// Integer arithmetic wraps like the VM's
+inline int add(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) + static_cast<unsigned>(b)); }
+inline int sub(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) - static_cast<unsigned>(b)); }
+inline int mul(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b)); }
+
+inline int divide(int a, int b) {
+    if (b == 0) fail("Division by zero.");
+    return b == -1 ? sub(0, a) : a / b;
+}
+
+inline float divide(float a, float b) {
+    if (b == 0.0f) fail("Division by zero.");
+    return a / b;
+}
+
+inline float floatFromBits(unsigned bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline bool isNumeric(const Value& value) {
+    return value.type == Type::NUMBER || value.type == Type::FLOAT;
+}
+
+inline float asFloat(const Value& value) {
+    return value.type == Type::NUMBER ? static_cast<float>(value.i) : value.f;
+}
+
+// op is one of + - * /
+inline Value binary(char op, const Value& lhs, const Value& rhs) {
+    if (op == '*' || op == '/') {
+        if (!isNumeric(lhs) || !isNumeric(rhs)) {
+            fail("Arithmetic operations can only be performed on numbers or floats.");
+        }
+        if (lhs.type == Type::FLOAT || rhs.type == Type::FLOAT) {
+            return op == '*' ? Value(asFloat(lhs) * asFloat(rhs)) : Value(divide(asFloat(lhs), asFloat(rhs)));
+        }
+        return op == '*' ? Value(mul(lhs.i, rhs.i)) : Value(divide(lhs.i, rhs.i));
+    }
+    if (lhs.type == Type::NUMBER && rhs.type == Type::NUMBER) {
+        return Value(op == '+' ? add(lhs.i, rhs.i) : sub(lhs.i, rhs.i));
+    }
+    if (isNumeric(lhs) && isNumeric(rhs)) {
+        return Value(op == '+' ? asFloat(lhs) + asFloat(rhs) : asFloat(lhs) - asFloat(rhs));
+    }
+    if (op == '+') {
+        if (lhs.type == Type::STRING && rhs.type == Type::STRING) {
+            return Value(lhs.s + rhs.s);
+        }
+        fail("Invalid operands for + operator.");
+    }
+    fail("Invalid operands for - operator.");
+}
+
+// op is one of = ! > g < l for == != > >= < <=
+template <typename T>
+inline bool compareAs(char op, T a, T b) {
+    switch (op) {
+        case '=': return a == b;
+        case '!': return a != b;
+        case '>': return a > b;
+        case 'g': return a >= b;
+        case '<': return a < b;
+        default: return a <= b;
+    }
+}
+
+inline bool compare(char op, const Value& lhs, const Value& rhs) {
+    if (!isNumeric(lhs) || !isNumeric(rhs)) {
+        fail("Comparison can only be performed on numbers or floats.");
+    }
+    if (lhs.type == Type::NUMBER && rhs.type == Type::NUMBER) {
+        return compareAs<int>(op, lhs.i, rhs.i);
+    }
+    return compareAs<float>(op, asFloat(lhs), asFloat(rhs));
+}
+
+inline bool truthy(int value) { return value != 0; }
+inline bool truthy(bool value) { return value; }
+inline bool truthy(const std::string& value) { return !value.empty(); }
+inline bool truthy(float) { return false; }
+inline bool truthy(char) { return false; }
+inline bool truthy(const Value& value) {
+    switch (value.type) {
+        case Type::BOOLEAN: return value.b;
+        case Type::NUMBER: return value.i != 0;
+        case Type::STRING: return !value.s.empty();
+        default: return false;
+    }
+}
+
+[[noreturn]] inline void badCondition() {
+    fail("Condition must be a boolean, number, or string.");
+}
+
+inline bool loopCondition(int value) { return value != 0; }
+inline bool loopCondition(bool value) { return value; }
+inline bool loopCondition(const std::string& value) { return !value.empty(); }
+inline bool loopCondition(float) { badCondition(); }
+inline bool loopCondition(char) { badCondition(); }
+inline bool loopCondition(const Value& value) {
+    if (value.type != Type::BOOLEAN && value.type != Type::NUMBER && value.type != Type::STRING) {
+        badCondition();
+    }
+    return truthy(value);
+}
+
+inline int toNum(const Value& value) {
+    if (value.type == Type::NUMBER) return value.i;
+    if (value.type == Type::FLOAT) return static_cast<int>(value.f);
+    fail("Error: cannot convert to num");
+}
+
+inline float toFloat(const Value& value) {
+    if (value.type == Type::FLOAT) return value.f;
+    if (value.type == Type::NUMBER) return static_cast<float>(value.i);
+    fail("Error: cannot convert to float");
+}
+
+inline bool toBool(const Value& value) {
+    if (value.type == Type::BOOLEAN) return value.b;
+    fail("Error: cannot convert to bool");
+}
+
+inline std::string toString(const Value& value) {
+    if (value.type == Type::STRING) return value.s;
+    fail("Error: cannot convert to string");
+}
+
+inline char toChar(const Value& value) {
+    if (value.type == Type::CHAR) return value.c;
+    fail("Error: cannot convert to char");
+}
+
+inline Value undefinedVariable(const char* name) {
+    fail(std::string("Undefined variable '") + name + "'");
+}
+
+template <typename T>
+inline T undefinedFunction(const char* name) {
+    fail(std::string("Undefined function '") + name + "'");
+}
+
+template <typename T>
+inline T missingArgument(bool defined, const char* function, const char* parameter) {
+    if (!defined) undefinedFunction<T>(function);
+    fail(std::string("Missing argument for parameter '") + parameter + "' in function '" + function + "'");
+}
+
+// Output of `show`, buffered like the VM's
+struct Output {
+    std::string buffer;
+    bool line_buffered = false;
+
+    void write(const char* data, size_t length) {
+        buffer.append(data, length);
+        if (buffer.size() >= (1 << 16)) flush();
+    }
+    void endLine() {
+        write("\n", 1);
+        if (line_buffered) flush();
+    }
+    void flush() {
+        if (!buffer.empty()) {
+            std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+            buffer.clear();
+        }
+        std::fflush(stdout);
+    }
+};
+
+inline Output& output() {
+    static Output instance;
+    return instance;
+}
+
+inline void show(int value) {
+    char digits[16];
+    int length = std::snprintf(digits, sizeof(digits), "%d", value);
+    output().write(digits, static_cast<size_t>(length));
+    output().endLine();
+}
+
+inline void show(float value) {
+    char digits[32];
+    int length = std::snprintf(digits, sizeof(digits), "%g", static_cast<double>(value));
+    output().write(digits, static_cast<size_t>(length));
+    output().endLine();
+}
+
+inline void show(bool value) {
+    if (value) output().write("true", 4);
+    else output().write("false", 5);
+    output().endLine();
+}
+
+inline void show(char value) {
+    output().write(&value, 1);
+    output().endLine();
+}
+
+inline void show(const std::string& value) {
+    output().write(value.data(), value.size());
+    output().endLine();
+}
+
+inline void show(const Value& value) {
+    switch (value.type) {
+        case Type::NUMBER: show(value.i); break;
+        case Type::FLOAT: show(value.f); break;
+        case Type::BOOLEAN: show(value.b); break;
+        case Type::CHAR: show(value.c); break;
+        case Type::STRING: show(value.s); break;
+        case Type::NONE: break;
+    }
+}
+
+const size_t STACK_SIZE = size_t(1) << 30;
+const size_t STACK_RESERVE = size_t(1) << 20; // kept free below the deepest call
+)";
+
+static const char* const RUNTIME_TAIL = R"(
+struct CallState {
+    size_t depth = 0;
+    const char* stack_origin = nullptr;
+    size_t stack_budget = 0;
+};
+
+inline CallState& calls() {
+    static CallState state;
+    return state;
+}
+
+// Counts one nested call for as long as it runs.
+struct CallGuard {
+    CallGuard() {
+        CallState& state = calls();
+        if (state.depth >= MAX_CALL_DEPTH) {
+            fail("Maximum call depth of " + std::to_string(MAX_CALL_DEPTH) + " exceeded.");
+        }
+        char marker;
+        if (static_cast<size_t>(state.stack_origin - &marker) > state.stack_budget) {
+            fail("Maximum call depth exceeded: ran out of native stack at depth " + std::to_string(state.depth) + ".");
+        }
+        state.depth++;
+    }
+    ~CallGuard() { calls().depth--; }
+};
+
+} // namespace nv
+
+static void script();
+)";
+
+static const char* const RUNTIME_MAIN = R"(
+static void* runScript(void* status) {
+    char origin;
+    nv::calls().stack_origin = &origin;
+    try {
+        script();
+    } catch (const nv::Error& e) {
+        // Everything shown before the error goes out first
+        nv::output().flush();
+        std::fprintf(stderr, "Runtime Error: %s\n", e.message.c_str());
+        *static_cast<int*>(status) = 1;
+    }
+    return nullptr;
+}
+
+int main() {
+    nv::output().line_buffered = isatty(STDOUT_FILENO) != 0;
+    int status = 0;
+    pthread_attr_t attributes;
+    pthread_t thread;
+    pthread_attr_init(&attributes);
+    nv::calls().stack_budget = nv::STACK_SIZE - nv::STACK_RESERVE;
+    if (pthread_attr_setstacksize(&attributes, nv::STACK_SIZE) == 0
+        && pthread_create(&thread, &attributes, runScript, &status) == 0) {
+        pthread_join(thread, nullptr);
+    } else {
+        nv::calls().stack_budget = 4 * nv::STACK_RESERVE; // the main thread's stack is at least 8 MiB
+        runScript(&status);
+    }
+    nv::output().flush();
+    return status;
+}
+)";
+
+static bool isArithmetic(TokenType op) {
+    return op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR || op == TokenType::SLASH;
+}
+
+static char operatorCode(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS: return '+';
+        case TokenType::MINUS: return '-';
+        case TokenType::STAR: return '*';
+        case TokenType::SLASH: return '/';
+        case TokenType::EQUAL_EQUAL: return '=';
+        case TokenType::NOT_EQUAL: return '!';
+        case TokenType::GREATER: return '>';
+        case TokenType::GREATER_EQUAL: return 'g';
+        case TokenType::LESS: return '<';
+        default: return 'l';
+    }
+}
+
+static const char* comparisonOperator(TokenType op) {
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: return "==";
+        case TokenType::NOT_EQUAL: return "!=";
+        case TokenType::GREATER: return ">";
+        case TokenType::GREATER_EQUAL: return ">=";
+        case TokenType::LESS: return "<";
+        default: return "<=";
+    }
+}
+
+// A C++ string literal with the exact bytes of `text`.
+static std::string quote(const std::string& text) {
+    std::string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\' || c == '?') {
+            quoted += '\\';
+            quoted += static_cast<char>(c);
+        } else if (c >= 0x20 && c < 0x7f) {
+            quoted += static_cast<char>(c);
+        } else {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            quoted += escape;
+        }
+    }
+    return quoted + "\"";
+}
+
+CEmitter::CEmitter(const Program& program, size_t max_call_depth)
+    : program(program), max_call_depth(max_call_depth), frames(program.function_names.size() + 1),
+      script(program.function_names.size()), dynamic_calls(program.call_sites, std::make_pair(nullptr, 0)) {
+    frames[script].slots.assign(program.slot_count, Type::UNSET);
+    frames[script].names.resize(program.slot_count);
+}
+
+CEmitter::Type CEmitter::join(Type a, Type b) {
+    if (a == Type::UNSET) return b;
+    if (b == Type::UNSET || a == b) return a;
+    return Type::DYNAMIC;
+}
+
+std::string CEmitter::cType(Type type) {
+    switch (type) {
+        case Type::NUM: return "int";
+        case Type::FLOAT: return "float";
+        case Type::BOOL: return "bool";
+        case Type::STRING: return "std::string";
+        case Type::CHAR: return "char";
+        default: return "nv::Value";
+    }
+}
+
+bool CEmitter::alwaysReturns(const std::vector<StmtPtr>& body) {
+    for (const auto& stmt : body) {
+        if (stmt->kind == StmtKind::RETURN
+            || (stmt->kind == StmtKind::IF && stmt->has_else && alwaysReturns(stmt->body) && alwaysReturns(stmt->else_body))
+            || (stmt->kind == StmtKind::BLOCK && alwaysReturns(stmt->body))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CEmitter::nameSlot(size_t frame, int slot, const std::string& name) {
+    std::string& slot_name = frames[frame].names[slot];
+    if (slot_name.empty()) {
+        slot_name = "l" + std::to_string(slot) + "_" + name;
+    }
+}
+
+static bool isArrayAnnotation(TokenType type) {
+    return type == TokenType::KEYWORD_NUM_ARRAY || type == TokenType::KEYWORD_FLOAT_ARRAY;
+}
+
+[[noreturn]] static void arraysUnsupported() {
+    throw RuntimeError("--emit-c and --build do not support arrays yet.");
+}
+
+[[noreturn]] static void parallelLoopsUnsupported() {
+    throw RuntimeError("--emit-c and --build do not support parallel loops yet.");
+}
+
+[[noreturn]] static void tasksUnsupported() {
+    throw RuntimeError("--emit-c and --build do not support tasks and channels yet.");
+}
+
+// Finds the declared functions, names every slot and records the calls bound by name.
+void CEmitter::collect(const std::vector<StmtPtr>& body, size_t frame) {
+    for (const auto& stmt : body) {
+        if (stmt->kind == StmtKind::STORE_INDEX || stmt->kind == StmtKind::APPEND
+            || (stmt->kind == StmtKind::VAR_DECL && isArrayAnnotation(stmt->type))) {
+            arraysUnsupported();
+        }
+        if (stmt->kind == StmtKind::PARALLEL) {
+            parallelLoopsUnsupported();
+        }
+        if (stmt->kind == StmtKind::SPAWN || (stmt->kind == StmtKind::VAR_DECL && stmt->type == TokenType::KEYWORD_CHANNEL)) {
+            tasksUnsupported();
+        }
+        if (stmt->kind == StmtKind::VAR_DECL || stmt->kind == StmtKind::ASSIGN) {
+            nameSlot(frame, stmt->slot, stmt->name);
+        }
+        if (stmt->kind == StmtKind::FUN_DECL) {
+            const FunctionDecl& decl = *program.functions[stmt->function];
+            if (isArrayAnnotation(decl.return_type)) {
+                arraysUnsupported();
+            }
+            if (decl.return_type == TokenType::KEYWORD_CHANNEL) {
+                tasksUnsupported();
+            }
+            for (const auto& param : decl.parameters) {
+                if (isArrayAnnotation(param.type)) arraysUnsupported();
+                if (param.type == TokenType::KEYWORD_CHANNEL) tasksUnsupported();
+            }
+            Frame& function = frames[stmt->function];
+            function.declared = true;
+            function.slots.assign(decl.slot_count, Type::UNSET);
+            function.names.resize(decl.slot_count);
+            function.defaults.assign(decl.parameters.size(), Type::UNSET);
+            function.incoming.assign(decl.parameters.size(), Type::UNSET);
+            for (size_t i = 0; i < decl.parameters.size(); ++i) {
+                nameSlot(stmt->function, static_cast<int>(i), decl.parameters[i].name);
+                if (decl.parameters[i].default_value) {
+                    collectExpression(*decl.parameters[i].default_value, frame);
+                }
+            }
+            std::vector<size_t>& same_name = declarations[decl.name];
+            if (same_name.empty()) {
+                size_t id = name_ids.size();
+                name_ids[decl.name] = id;
+            }
+            same_name.push_back(stmt->function);
+            collect(decl.body, stmt->function);
+        }
+        if (stmt->expr) {
+            collectExpression(*stmt->expr, frame);
+        }
+        collect(stmt->body, frame);
+        collect(stmt->else_body, frame);
+    }
+}
+
+void CEmitter::collectExpression(const Expr& expr, size_t frame) {
+    if (expr.kind == ExprKind::BINARY) {
+        collectExpression(*expr.lhs, frame);
+        collectExpression(*expr.rhs, frame);
+    } else if (expr.kind == ExprKind::CALL) {
+        for (const auto& arg : expr.args) {
+            collectExpression(*arg.value, frame);
+        }
+        if (expr.function == DYNAMIC_FUNCTION) {
+            dynamic_calls[expr.call_site] = std::make_pair(&expr, frame);
+        }
+    } else if (expr.kind == ExprKind::CHANNEL
+               || (expr.kind == ExprKind::METHOD && (expr.method == Method::SEND || expr.method == Method::RECEIVE))) {
+        tasksUnsupported();
+    } else if (expr.kind != ExprKind::LITERAL && expr.kind != ExprKind::VARIABLE) {
+        arraysUnsupported();
+    }
+}
+
+void CEmitter::widen(Type& type, Type with) {
+    Type joined = join(type, with);
+    if (joined != type) {
+        type = joined;
+        changed = true;
+    }
+}
+
+CEmitter::Type CEmitter::slotType(size_t frame, int slot) const {
+    Type type = frames[frame].slots[slot];
+    return settle && type == Type::UNSET ? Type::DYNAMIC : type;
+}
+
+CEmitter::Type CEmitter::callType(const Expr& call) const {
+    Type type = Type::UNSET;
+    if (call.function != DYNAMIC_FUNCTION) {
+        type = frames[call.function].declared ? frames[call.function].result : Type::DYNAMIC;
+    } else {
+        auto found = declarations.find(call.name);
+        if (found == declarations.end()) {
+            return Type::DYNAMIC;
+        }
+        for (size_t function : found->second) {
+            type = join(type, frames[function].result);
+        }
+    }
+    return settle && type == Type::UNSET ? Type::DYNAMIC : type;
+}
+
+CEmitter::Type CEmitter::typeOf(const Expr& expr, size_t frame) const {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            switch (expr.literal.type) {
+                case ValueType::NUMBER: return Type::NUM;
+                case ValueType::FLOAT: return Type::FLOAT;
+                case ValueType::BOOLEAN: return Type::BOOL;
+                case ValueType::STRING: return Type::STRING;
+                case ValueType::CHAR: return Type::CHAR;
+                case ValueType::NONE:
+                case ValueType::ARRAY:
+                case ValueType::CHANNEL: return Type::DYNAMIC;
+            }
+            return Type::DYNAMIC;
+        case ExprKind::VARIABLE:
+            return expr.slot == UNRESOLVED_SLOT ? Type::DYNAMIC : slotType(frame, expr.slot);
+        case ExprKind::BINARY: {
+            Type lhs = typeOf(*expr.lhs, frame);
+            Type rhs = typeOf(*expr.rhs, frame);
+            if (lhs == Type::UNSET || rhs == Type::UNSET) return Type::UNSET;
+            if (!isArithmetic(expr.op)) return Type::BOOL;
+            bool numeric = (lhs == Type::NUM || lhs == Type::FLOAT) && (rhs == Type::NUM || rhs == Type::FLOAT);
+            if (numeric) return lhs == Type::NUM && rhs == Type::NUM ? Type::NUM : Type::FLOAT;
+            if (expr.op == TokenType::PLUS && lhs == Type::STRING && rhs == Type::STRING) return Type::STRING;
+            return Type::DYNAMIC;
+        }
+        case ExprKind::CALL:
+            return callType(expr);
+        case ExprKind::ARRAY:
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            arraysUnsupported(); // rejected by collect()
+        case ExprKind::CHANNEL:
+            tasksUnsupported(); // rejected by collect()
+    }
+    return Type::DYNAMIC;
+}
+
+// Index of the argument a call passes to `parameter`: the last one naming it.
+int CEmitter::matchArgument(const Expr& call, const std::string& parameter) const {
+    for (size_t a = call.args.size(); a-- > 0;) {
+        if (call.args[a].name == parameter) {
+            return static_cast<int>(a);
+        }
+    }
+    return MISSING_ARGUMENT;
+}
+
+void CEmitter::analyzeExpression(const Expr& expr, size_t frame) {
+    if (expr.kind == ExprKind::BINARY) {
+        analyzeExpression(*expr.lhs, frame);
+        analyzeExpression(*expr.rhs, frame);
+        return;
+    }
+    if (expr.kind != ExprKind::CALL) {
+        return;
+    }
+    for (const auto& arg : expr.args) {
+        analyzeExpression(*arg.value, frame);
+    }
+    if (expr.function != DYNAMIC_FUNCTION) {
+        Frame& callee = frames[expr.function];
+        if (!callee.declared) return;
+        for (size_t i = 0; i < expr.bindings.size(); ++i) {
+            if (expr.bindings[i] >= 0) {
+                widen(callee.incoming[i], typeOf(*expr.args[expr.bindings[i]].value, frame));
+            }
+        }
+        return;
+    }
+    auto found = declarations.find(expr.name);
+    if (found == declarations.end()) return;
+    for (size_t function : found->second) {
+        const FunctionDecl& decl = *program.functions[function];
+        for (size_t i = 0; i < decl.parameters.size(); ++i) {
+            int arg = matchArgument(expr, decl.parameters[i].name);
+            if (arg >= 0) {
+                widen(frames[function].incoming[i], typeOf(*expr.args[arg].value, frame));
+            }
+        }
+    }
+}
+
+void CEmitter::analyzeStatement(const Stmt& stmt, size_t frame) {
+    switch (stmt.kind) {
+        case StmtKind::VAR_DECL:
+        case StmtKind::ASSIGN: {
+            analyzeExpression(*stmt.expr, frame);
+            Type value = typeOf(*stmt.expr, frame);
+            widen(frames[frame].slots[stmt.slot], stmt.kind == StmtKind::VAR_DECL ? declaredType(stmt.type, value) : value);
+            break;
+        }
+        case StmtKind::IF:
+            analyzeExpression(*stmt.expr, frame);
+            analyzeBlock(stmt.body, frame);
+            analyzeBlock(stmt.else_body, frame);
+            break;
+        case StmtKind::WHILE:
+            analyzeExpression(*stmt.expr, frame);
+            analyzeBlock(stmt.body, frame);
+            break;
+        case StmtKind::BLOCK:
+            analyzeBlock(stmt.body, frame);
+            break;
+        case StmtKind::FUN_DECL: {
+            const FunctionDecl& decl = *program.functions[stmt.function];
+            Frame& function = frames[stmt.function];
+            for (size_t i = 0; i < decl.parameters.size(); ++i) {
+                if (decl.parameters[i].default_value) {
+                    analyzeExpression(*decl.parameters[i].default_value, frame);
+                    Type value = typeOf(*decl.parameters[i].default_value, frame);
+                    widen(function.defaults[i], value);
+                    widen(function.incoming[i], value);
+                }
+            }
+            break;
+        }
+        case StmtKind::RETURN:
+            analyzeExpression(*stmt.expr, frame);
+            if (frame != script) {
+                widen(frames[frame].result, typeOf(*stmt.expr, frame));
+                if (stmt.expr->kind == ExprKind::CALL && stmt.expr->function == frame) {
+                    frames[frame].tail_calls = true;
+                }
+            }
+            break;
+        case StmtKind::SHOW:
+        case StmtKind::EXPRESSION:
+            analyzeExpression(*stmt.expr, frame);
+            break;
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND:
+            arraysUnsupported(); // rejected by collect()
+        case StmtKind::PARALLEL:
+            parallelLoopsUnsupported(); // rejected by collect()
+        case StmtKind::SPAWN:
+            tasksUnsupported(); // rejected by collect()
+    }
+}
+
+void CEmitter::analyzeBlock(const std::vector<StmtPtr>& body, size_t frame) {
+    for (const auto& stmt : body) {
+        analyzeStatement(*stmt, frame);
+    }
+}
+
+// Type a `name:type = value` declaration stores.
+CEmitter::Type CEmitter::declaredType(TokenType keyword, Type value) {
+    switch (keyword) {
+        case TokenType::KEYWORD_NUM: return Type::NUM;
+        case TokenType::KEYWORD_FLOAT: return Type::FLOAT;
+        case TokenType::KEYWORD_BOOL: return Type::BOOL;
+        case TokenType::KEYWORD_STRING: return Type::STRING;
+        case TokenType::KEYWORD_CHAR: return Type::CHAR;
+        default: return value;
+    }
+}
+
+// Evaluating the expression can neither raise nor show anything, so it may
+// be reordered with its neighbours.
+bool CEmitter::isQuiet(const Expr& expr, size_t frame) const {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            return true;
+        case ExprKind::VARIABLE:
+            return expr.slot != UNRESOLVED_SLOT;
+        case ExprKind::BINARY: {
+            if (!isQuiet(*expr.lhs, frame) || !isQuiet(*expr.rhs, frame) || expr.op == TokenType::SLASH) {
+                return false;
+            }
+            Type lhs = typeOf(*expr.lhs, frame);
+            Type rhs = typeOf(*expr.rhs, frame);
+            bool numeric = (lhs == Type::NUM || lhs == Type::FLOAT) && (rhs == Type::NUM || rhs == Type::FLOAT);
+            return numeric || (expr.op == TokenType::PLUS && lhs == Type::STRING && rhs == Type::STRING);
+        }
+        case ExprKind::CALL:
+        case ExprKind::ARRAY:
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+        case ExprKind::CHANNEL:
+            return false;
+    }
+    return false;
+}
+
+std::string CEmitter::emit() {
+    collect(program.statements, script);
+
+    // Widen types until nothing changes, then once more with everything still
+    // unknown (never assigned, or only from calls that never return) dynamic
+    for (int pass = 0; pass < 2; ++pass) {
+        settle = pass == 1;
+        do {
+            changed = false;
+            analyzeBlock(program.statements, script);
+            for (size_t f = 0; f < script; ++f) {
+                if (!frames[f].declared) continue;
+                const FunctionDecl& decl = *program.functions[f];
+                for (size_t i = 0; i < decl.parameters.size(); ++i) {
+                    widen(frames[f].slots[i], declaredType(decl.parameters[i].type, frames[f].incoming[i]));
+                }
+                analyzeBlock(decl.body, f);
+                if (!alwaysReturns(decl.body)) {
+                    widen(frames[f].result, Type::DYNAMIC); // falls off the end with no value
+                }
+            }
+        } while (changed);
+    }
+    for (Frame& frame : frames) {
+        for (Type& type : frame.slots) {
+            if (type == Type::UNSET) type = Type::DYNAMIC;
+        }
+        for (Type& type : frame.defaults) {
+            if (type == Type::UNSET) type = Type::DYNAMIC;
+        }
+        for (Type& type : frame.incoming) {
+            if (type == Type::UNSET) type = Type::DYNAMIC;
+        }
+        if (frame.result == Type::UNSET) frame.result = Type::DYNAMIC;
+    }
+
+    out = "// Generated by supernova --emit-c.\n";
+    out += RUNTIME_HEAD;
+    out += "const size_t MAX_CALL_DEPTH = " + std::to_string(max_call_depth) + ";\n";
+    out += RUNTIME_TAIL;
+
+    // Declared functions, their default values and which declaration of
+    // each name ran last
+    bool any_function = false;
+    for (size_t f = 0; f < script; ++f) {
+        if (!frames[f].declared) continue;
+        if (!any_function) out += "\n";
+        any_function = true;
+        const FunctionDecl& decl = *program.functions[f];
+        out += "static " + signature(f) + ";\n";
+        out += "static bool defined_" + std::to_string(f) + " = false;\n";
+        for (size_t i = 0; i < decl.parameters.size(); ++i) {
+            if (decl.parameters[i].default_value) {
+                out += "static " + cType(frames[f].defaults[i]) + " default_" + std::to_string(f) + "_" + std::to_string(i) + ";\n";
+            }
+        }
+    }
+    for (const auto& name : name_ids) {
+        out += "static size_t latest_" + std::to_string(name.second) + " = 0;\n";
+    }
+    for (const auto& call : dynamic_calls) {
+        if (call.first) emitDynamicCall(*call.first, call.second);
+    }
+    for (size_t f = 0; f < script; ++f) {
+        if (frames[f].declared) emitFunction(f);
+    }
+
+    out += "\nstatic void script() {\n";
+    indent = 1;
+    temporaries = 0;
+    for (size_t slot = 0; slot < frames[script].slots.size(); ++slot) {
+        const Frame& frame = frames[script];
+        std::string name = frame.names[slot].empty() ? "l" + std::to_string(slot) : frame.names[slot];
+        line(cType(frame.slots[slot]) + " " + name + "{};");
+    }
+    emitBlock(program.statements, script);
+    out += "}\n";
+    out += RUNTIME_MAIN;
+    return std::move(out);
+}
+
+void CEmitter::line(const std::string& text) {
+    out.append(static_cast<size_t>(indent) * 4, ' ');
+    out += text;
+    out += '\n';
+}
+
+// Types only ever widen along an assignment, so a conversion either keeps
+// the type or boxes a native value.
+std::string CEmitter::convert(const std::string& code, Type from, Type to) const {
+    if (from == to) return code;
+    if (to != Type::DYNAMIC) throw RuntimeError("C emitter: cannot convert between native types.");
+    return "nv::Value(" + code + ")";
+}
+
+// Applies the conversion of a `name:type = value` declaration.
+std::string CEmitter::declare(const std::string& code, Type from, TokenType keyword) const {
+    std::string boxed = convert(code, from, Type::DYNAMIC);
+    switch (keyword) {
+        case TokenType::KEYWORD_NUM:
+            if (from == Type::NUM) return code;
+            if (from == Type::FLOAT) return "static_cast<int>(" + code + ")";
+            return "nv::toNum(" + boxed + ")";
+        case TokenType::KEYWORD_FLOAT:
+            if (from == Type::FLOAT) return code;
+            if (from == Type::NUM) return "static_cast<float>(" + code + ")";
+            return "nv::toFloat(" + boxed + ")";
+        case TokenType::KEYWORD_BOOL:
+            return from == Type::BOOL ? code : "nv::toBool(" + boxed + ")";
+        case TokenType::KEYWORD_STRING:
+            return from == Type::STRING ? code : "nv::toString(" + boxed + ")";
+        case TokenType::KEYWORD_CHAR:
+            return from == Type::CHAR ? code : "nv::toChar(" + boxed + ")";
+        default:
+            return code;
+    }
+}
+
+std::string CEmitter::functionName(size_t function) const {
+    return "f" + std::to_string(function) + "_" + program.functions[function]->name;
+}
+
+std::string CEmitter::signature(size_t function) const {
+    const FunctionDecl& decl = *program.functions[function];
+    const Frame& frame = frames[function];
+    std::string text = cType(frame.result) + " " + functionName(function) + "(";
+    for (size_t i = 0; i < decl.parameters.size(); ++i) {
+        if (i > 0) text += ", ";
+        text += cType(frame.incoming[i]) + " p" + std::to_string(i);
+    }
+    return text + ")";
+}
+
+void CEmitter::emitFunction(size_t function) {
+    const FunctionDecl& decl = *program.functions[function];
+    const Frame& frame = frames[function];
+    out += "\nstatic " + signature(function) + " {\n";
+    indent = 1;
+    temporaries = 0;
+    line("if (!defined_" + std::to_string(function) + ") nv::undefinedFunction<int>(" + quote(decl.name) + ");");
+    line("nv::CallGuard guard;");
+    // Arguments are converted like declarations of the annotated type
+    for (size_t i = 0; i < decl.parameters.size(); ++i) {
+        Type incoming = frame.incoming[i];
+        std::string argument = "p" + std::to_string(i);
+        if (incoming == Type::STRING || incoming == Type::DYNAMIC) {
+            argument = "std::move(" + argument + ")";
+        }
+        std::string code = declare(argument, incoming, decl.parameters[i].type);
+        code = convert(code, declaredType(decl.parameters[i].type, incoming), frame.slots[i]);
+        line(cType(frame.slots[i]) + " " + frame.names[i] + " = " + code + ";");
+    }
+    for (size_t slot = decl.parameters.size(); slot < frame.slots.size(); ++slot) {
+        std::string name = frame.names[slot].empty() ? "l" + std::to_string(slot) : frame.names[slot];
+        line(cType(frame.slots[slot]) + " " + name + "{};");
+    }
+    if (frame.tail_calls) {
+        out += "tail_call:\n";
+    }
+    emitBlock(decl.body, function);
+    if (!alwaysReturns(decl.body)) {
+        line("return nv::Value();");
+    }
+    out += "}\n";
+}
+
+// A call bound by name at runtime: binds the arguments to whichever
+// declaration of the name ran last.
+void CEmitter::emitDynamicCall(const Expr& call, size_t frame) {
+    Type result = callType(call);
+    std::string text = "\nstatic " + cType(result) + " call_" + std::to_string(call.call_site) + "(";
+    for (size_t a = 0; a < call.args.size(); ++a) {
+        if (a > 0) text += ", ";
+        text += cType(typeOf(*call.args[a].value, frame)) + " a" + std::to_string(a);
+    }
+    out += text + ") {\n";
+    indent = 1;
+    auto found = declarations.find(call.name);
+    if (found != declarations.end()) {
+        line("switch (latest_" + std::to_string(name_ids.at(call.name)) + ") {");
+        for (size_t function : found->second) {
+            const FunctionDecl& decl = *program.functions[function];
+            const Frame& callee = frames[function];
+            line("    case " + std::to_string(function + 1) + ":");
+            std::string arguments;
+            std::string missing;
+            for (size_t i = 0; i < decl.parameters.size() && missing.empty(); ++i) {
+                int arg = matchArgument(call, decl.parameters[i].name);
+                std::string value;
+                if (arg >= 0) {
+                    value = convert("a" + std::to_string(arg), typeOf(*call.args[arg].value, frame), callee.incoming[i]);
+                } else if (decl.parameters[i].default_value) {
+                    value = convert("default_" + std::to_string(function) + "_" + std::to_string(i), callee.defaults[i], callee.incoming[i]);
+                } else {
+                    missing = decl.parameters[i].name;
+                }
+                arguments += (i > 0 ? ", " : "") + value;
+            }
+            if (!missing.empty()) {
+                line("        return nv::missingArgument<" + cType(result) + ">(true, " + quote(decl.name) + ", " + quote(missing) + ");");
+            } else {
+                line("        return " + convert(functionName(function) + "(" + arguments + ")", callee.result, result) + ";");
+            }
+        }
+        line("}");
+    }
+    line("return nv::undefinedFunction<" + cType(result) + ">(" + quote(call.name) + ");");
+    out += "}\n";
+}
+
+void CEmitter::emitBlock(const std::vector<StmtPtr>& body, size_t frame) {
+    for (const auto& stmt : body) {
+        emitStatement(*stmt, frame);
+    }
+}
+
+void CEmitter::emitStatement(const Stmt& stmt, size_t frame) {
+    switch (stmt.kind) {
+        case StmtKind::SHOW:
+            line("nv::show(" + emitExpression(*stmt.expr, frame) + ");");
+            break;
+        case StmtKind::VAR_DECL: {
+            Type value = typeOf(*stmt.expr, frame);
+            std::string code = declare(emitExpression(*stmt.expr, frame), value, stmt.type);
+            code = convert(code, declaredType(stmt.type, value), slotType(frame, stmt.slot));
+            line(frames[frame].names[stmt.slot] + " = " + code + ";");
+            break;
+        }
+        case StmtKind::ASSIGN: {
+            const std::string& name = frames[frame].names[stmt.slot];
+            if (stmt.in_place && slotType(frame, stmt.slot) == Type::STRING) {
+                // Appends in place instead of copying the string for every `+`
+                std::vector<const Expr*> operands;
+                for (const Expr* spine = stmt.expr.get(); spine->kind == ExprKind::BINARY; spine = spine->lhs.get()) {
+                    operands.insert(operands.begin(), spine->rhs.get());
+                }
+                for (const std::string& operand : emitOperands(operands, frame)) {
+                    line(name + " += " + operand + ";");
+                }
+                break;
+            }
+            std::string code = emitExpression(*stmt.expr, frame);
+            line(name + " = " + convert(code, typeOf(*stmt.expr, frame), slotType(frame, stmt.slot)) + ";");
+            break;
+        }
+        case StmtKind::IF:
+            line("if (nv::truthy(" + emitExpression(*stmt.expr, frame) + ")) {");
+            indent++;
+            emitBlock(stmt.body, frame);
+            indent--;
+            if (stmt.has_else) {
+                line("} else {");
+                indent++;
+                emitBlock(stmt.else_body, frame);
+                indent--;
+            }
+            line("}");
+            break;
+        case StmtKind::WHILE:
+            if (isQuiet(*stmt.expr, frame)) {
+                line("while (nv::loopCondition(" + emitExpression(*stmt.expr, frame) + ")) {");
+                indent++;
+            } else {
+                line("for (;;) {");
+                indent++;
+                line("if (!nv::loopCondition(" + emitExpression(*stmt.expr, frame) + ")) break;");
+            }
+            emitBlock(stmt.body, frame);
+            indent--;
+            line("}");
+            break;
+        case StmtKind::BLOCK:
+            emitBlock(stmt.body, frame);
+            break;
+        case StmtKind::FUN_DECL: {
+            const FunctionDecl& decl = *program.functions[stmt.function];
+            std::string index = std::to_string(stmt.function);
+            for (size_t i = 0; i < decl.parameters.size(); ++i) {
+                if (decl.parameters[i].default_value) {
+                    line("default_" + index + "_" + std::to_string(i) + " = " + emitExpression(*decl.parameters[i].default_value, frame) + ";");
+                }
+            }
+            line("defined_" + index + " = true;");
+            line("latest_" + std::to_string(name_ids.at(decl.name)) + " = " + std::to_string(stmt.function + 1) + ";");
+            break;
+        }
+        case StmtKind::RETURN:
+            if (frame == script) {
+                // `return` at top level ends the program
+                line("(void)(" + emitExpression(*stmt.expr, frame) + ");");
+                line("return;");
+            } else if (stmt.expr->kind == ExprKind::CALL && stmt.expr->function == frame
+                       && std::find(stmt.expr->bindings.begin(), stmt.expr->bindings.end(), MISSING_ARGUMENT) == stmt.expr->bindings.end()) {
+                emitTailCall(*stmt.expr, frame);
+            } else {
+                std::string code = emitExpression(*stmt.expr, frame);
+                line("return " + convert(code, typeOf(*stmt.expr, frame), frames[frame].result) + ";");
+            }
+            break;
+        case StmtKind::EXPRESSION:
+            line("(void)(" + emitExpression(*stmt.expr, frame) + ");");
+            break;
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND:
+            arraysUnsupported(); // rejected by collect()
+        case StmtKind::PARALLEL:
+            parallelLoopsUnsupported(); // rejected by collect()
+        case StmtKind::SPAWN:
+            tasksUnsupported(); // rejected by collect()
+    }
+}
+
+// `return f ...` inside f: rebinds the parameters and starts over. The
+// arguments may read the parameters, so all are evaluated first.
+void CEmitter::emitTailCall(const Expr& call, size_t frame) {
+    std::vector<std::string> arguments;
+    for (const auto& arg : call.args) {
+        std::string code = emitExpression(*arg.value, frame);
+        arguments.push_back(arg.value->kind == ExprKind::LITERAL ? code : temporary(code, typeOf(*arg.value, frame)));
+    }
+    const Frame& function = frames[frame];
+    const FunctionDecl& decl = *program.functions[frame];
+    for (size_t i = 0; i < call.bindings.size(); ++i) {
+        int binding = call.bindings[i];
+        std::string value = binding == DEFAULT_ARGUMENT ? "default_" + std::to_string(frame) + "_" + std::to_string(i) : arguments[binding];
+        Type type = binding == DEFAULT_ARGUMENT ? function.defaults[i] : typeOf(*call.args[binding].value, frame);
+        value = declare(value, type, decl.parameters[i].type);
+        line(function.names[i] + " = " + convert(value, declaredType(decl.parameters[i].type, type), function.slots[i]) + ";");
+    }
+    line("goto tail_call;");
+}
+
+std::string CEmitter::temporary(const std::string& code, Type type) {
+    std::string name = "_t" + std::to_string(++temporaries);
+    line(cType(type) + " " + name + " = " + code + ";");
+    return name;
+}
+
+// Emits operands that Nova evaluates left to right. C++ leaves the order
+// open, so every operand that is not quiet, except the last such one, is
+// evaluated into a temporary first.
+std::vector<std::string> CEmitter::emitOperands(const std::vector<const Expr*>& operands, size_t frame) {
+    size_t last = 0;
+    for (size_t i = 0; i < operands.size(); ++i) {
+        if (!isQuiet(*operands[i], frame)) last = i;
+    }
+    std::vector<std::string> codes;
+    for (size_t i = 0; i < operands.size(); ++i) {
+        std::string code = emitExpression(*operands[i], frame);
+        if (i < last && !isQuiet(*operands[i], frame)) {
+            code = temporary(code, typeOf(*operands[i], frame));
+        }
+        codes.push_back(code);
+    }
+    return codes;
+}
+
+std::string CEmitter::emitExpression(const Expr& expr, size_t frame) {
+    switch (expr.kind) {
+        case ExprKind::LITERAL: {
+            const Value& value = expr.literal;
+            switch (value.type) {
+                case ValueType::NUMBER:
+                    if (value.i_value == INT_MIN) return "(-2147483647 - 1)";
+                    return value.i_value < 0 ? "(" + std::to_string(value.i_value) + ")" : std::to_string(value.i_value);
+                case ValueType::FLOAT: {
+                    if (!std::isfinite(value.f_value)) {
+                        uint32_t bits;
+                        std::memcpy(&bits, &value.f_value, sizeof(bits));
+                        return "nv::floatFromBits(" + std::to_string(bits) + "u)";
+                    }
+                    char digits[32];
+                    std::snprintf(digits, sizeof(digits), "%.9g", static_cast<double>(value.f_value));
+                    std::string text = digits;
+                    if (text.find_first_of(".e") == std::string::npos) text += ".0";
+                    return value.f_value < 0 ? "(" + text + "f)" : text + "f";
+                }
+                case ValueType::BOOLEAN:
+                    return value.b_value ? "true" : "false";
+                case ValueType::CHAR:
+                    return "static_cast<char>(" + std::to_string(static_cast<int>(value.c_value)) + ")";
+                case ValueType::STRING:
+                    return "std::string(" + quote(value.str()) + ", " + std::to_string(value.str().size()) + ")";
+                case ValueType::NONE:
+                case ValueType::ARRAY:
+                case ValueType::CHANNEL:
+                    return "nv::Value()";
+            }
+            return "nv::Value()";
+        }
+        case ExprKind::VARIABLE:
+            if (expr.slot == UNRESOLVED_SLOT) {
+                return "nv::undefinedVariable(" + quote(expr.name) + ")";
+            }
+            return frames[frame].names[expr.slot];
+        case ExprKind::BINARY: {
+            std::vector<std::string> codes = emitOperands({ expr.lhs.get(), expr.rhs.get() }, frame);
+            Type lhs = typeOf(*expr.lhs, frame);
+            Type rhs = typeOf(*expr.rhs, frame);
+            bool numeric = (lhs == Type::NUM || lhs == Type::FLOAT) && (rhs == Type::NUM || rhs == Type::FLOAT);
+            if (numeric) {
+                bool integer = lhs == Type::NUM && rhs == Type::NUM;
+                std::string a = !integer && lhs == Type::NUM ? "static_cast<float>(" + codes[0] + ")" : codes[0];
+                std::string b = !integer && rhs == Type::NUM ? "static_cast<float>(" + codes[1] + ")" : codes[1];
+                switch (expr.op) {
+                    case TokenType::PLUS: return integer ? "nv::add(" + a + ", " + b + ")" : "(" + a + " + " + b + ")";
+                    case TokenType::MINUS: return integer ? "nv::sub(" + a + ", " + b + ")" : "(" + a + " - " + b + ")";
+                    case TokenType::STAR: return integer ? "nv::mul(" + a + ", " + b + ")" : "(" + a + " * " + b + ")";
+                    case TokenType::SLASH: return "nv::divide(" + a + ", " + b + ")";
+                    default: return "(" + a + " " + comparisonOperator(expr.op) + " " + b + ")";
+                }
+            }
+            if (expr.op == TokenType::PLUS && lhs == Type::STRING && rhs == Type::STRING) {
+                return "(" + codes[0] + " + " + codes[1] + ")";
+            }
+            std::string op = std::string("'") + operatorCode(expr.op) + "'";
+            std::string operands = convert(codes[0], lhs, Type::DYNAMIC) + ", " + convert(codes[1], rhs, Type::DYNAMIC);
+            return (isArithmetic(expr.op) ? "nv::binary(" : "nv::compare(") + op + ", " + operands + ")";
+        }
+        case ExprKind::CALL:
+            return emitCall(expr, frame);
+        case ExprKind::ARRAY:
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            arraysUnsupported(); // rejected by collect()
+        case ExprKind::CHANNEL:
+            tasksUnsupported(); // rejected by collect()
+    }
+    return "nv::Value()";
+}
+
+std::string CEmitter::emitCall(const Expr& call, size_t frame) {
+    std::vector<const Expr*> operands;
+    for (const auto& arg : call.args) {
+        operands.push_back(arg.value.get());
+    }
+    if (call.function == DYNAMIC_FUNCTION) {
+        std::vector<std::string> codes = emitOperands(operands, frame);
+        std::string text = "call_" + std::to_string(call.call_site) + "(";
+        for (size_t a = 0; a < codes.size(); ++a) {
+            text += (a > 0 ? ", " : "") + codes[a];
+        }
+        return text + ")";
+    }
+
+    const Frame& callee = frames[call.function];
+    const FunctionDecl& decl = *program.functions[call.function];
+    std::vector<bool> used(call.args.size(), false);
+    std::string missing;
+    for (size_t i = 0; i < call.bindings.size(); ++i) {
+        if (call.bindings[i] >= 0) used[call.bindings[i]] = true;
+        if (call.bindings[i] == MISSING_ARGUMENT && missing.empty()) missing = decl.parameters[i].name;
+    }
+    // Arguments no parameter takes, and all of them when the call fails,
+    // are still evaluated for their effects, in order
+    bool evaluate_all = !callee.declared || !missing.empty();
+    for (size_t a = 0; a < call.args.size(); ++a) {
+        if (!used[a] && !isQuiet(*operands[a], frame)) evaluate_all = true;
+    }
+    std::vector<std::string> codes;
+    if (evaluate_all) {
+        for (const Expr* operand : operands) {
+            std::string code = emitExpression(*operand, frame);
+            codes.push_back(isQuiet(*operand, frame) ? code : temporary(code, typeOf(*operand, frame)));
+        }
+    } else {
+        codes = emitOperands(operands, frame);
+    }
+    if (!callee.declared) {
+        return "nv::undefinedFunction<nv::Value>(" + quote(call.name) + ")";
+    }
+    if (!missing.empty()) {
+        return "nv::missingArgument<" + cType(callee.result) + ">(defined_" + std::to_string(call.function) + ", "
+               + quote(call.name) + ", " + quote(missing) + ")";
+    }
+
+    std::string text = functionName(call.function) + "(";
+    for (size_t i = 0; i < call.bindings.size(); ++i) {
+        int binding = call.bindings[i];
+        std::string value = binding == DEFAULT_ARGUMENT
+            ? convert("default_" + std::to_string(call.function) + "_" + std::to_string(i), callee.defaults[i], callee.incoming[i])
+            : convert(codes[binding], typeOf(*operands[binding], frame), callee.incoming[i]);
+        text += (i > 0 ? ", " : "") + value;
+    }
+    return text + ")";
+}
+
+#ifdef _WIN32
+
+bool buildExecutable(const std::string&, const std::string&, std::string& error) {
+    error = "--build is not supported on Windows; compile the output of --emit-c instead.";
+    return false;
+}
+
+#else
+
+static std::string shellQuote(const std::string& text) {
+    std::string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+bool buildExecutable(const std::string& source, const std::string& executable, std::string& error) {
+    char path[] = "/tmp/supernova-XXXXXX.cpp";
+    int fd = mkstemps(path, 4);
+    if (fd < 0) {
+        error = "cannot create a temporary file: " + std::string(std::strerror(errno));
+        return false;
+    }
+    bool written = write(fd, source.data(), source.size()) == static_cast<ssize_t>(source.size());
+    close(fd);
+    if (!written) {
+        unlink(path);
+        error = "cannot write " + std::string(path);
+        return false;
+    }
+
+    const char* compiler = std::getenv("CXX");
+    std::string command = shellQuote(compiler && *compiler ? compiler : "g++") + " -std=c++11 -O2 -pthread -o "
+                          + shellQuote(executable) + " " + shellQuote(path);
+    int status = std::system(command.c_str());
+    unlink(path);
+    if (status != 0) {
+        error = "C++ compiler failed: " + command;
+        return false;
+    }
+    return true;
+}
+
+#endif
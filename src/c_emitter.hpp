@@ -0,0 +1,87 @@
+#pragma once
+#include "ast.hpp"
+#include "error.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Translates a resolved Program into a standalone C++ program with the same
+// output and runtime errors as the VM. Every local slot, parameter and return
+// value whose type is the same on every path becomes a native `int`,
+// `float`, `bool`, `std::string` or `char`; the rest use the small dynamic
+// value type of the runtime written in front of the program.
+//
+// Types are inferred over the whole program: a parameter takes the types of
+// the arguments passed to it at every call site, converted by its annotation
+// like a declaration, a function the types of its returns. Calls run natively, with the VM's call depth limit; only a
+// function calling itself in tail position reuses its frame.
+class CEmitter {
+public:
+    CEmitter(const Program& program, size_t max_call_depth);
+    std::string emit();
+
+private:
+    enum class Type : uint8_t { UNSET, NUM, FLOAT, BOOL, STRING, CHAR, DYNAMIC };
+
+    // Locals of a function or of the top-level script.
+    struct Frame {
+        std::vector<Type> slots;
+        std::vector<std::string> names; // C++ name of each slot
+        Type result = Type::UNSET;
+        std::vector<Type> defaults;     // of the parameters with default values
+        std::vector<Type> incoming;     // of the arguments, before the annotations convert them
+        bool declared = false;          // a FUN_DECL statement for it exists
+        bool tail_calls = false;        // returns a call to itself somewhere
+    };
+
+    const Program& program;
+    size_t max_call_depth;
+    std::vector<Frame> frames; // functions by index, then the script
+    size_t script;
+    std::unordered_map<std::string, std::vector<size_t>> declarations; // by function name
+    std::unordered_map<std::string, size_t> name_ids;
+    std::vector<std::pair<const Expr*, size_t>> dynamic_calls; // call and its frame, by call site
+    bool changed = false;
+    bool settle = false; // unset types read as dynamic
+
+    std::string out;
+    int indent = 0;
+    int temporaries = 0;
+
+    static Type join(Type a, Type b);
+    static std::string cType(Type type);
+    static bool alwaysReturns(const std::vector<StmtPtr>& body);
+    static Type declaredType(TokenType keyword, Type value);
+
+    void collect(const std::vector<StmtPtr>& body, size_t frame);
+    void collectExpression(const Expr& expr, size_t frame);
+    void nameSlot(size_t frame, int slot, const std::string& name);
+    void widen(Type& type, Type with);
+    void analyzeBlock(const std::vector<StmtPtr>& body, size_t frame);
+    void analyzeStatement(const Stmt& stmt, size_t frame);
+    void analyzeExpression(const Expr& expr, size_t frame);
+    Type typeOf(const Expr& expr, size_t frame) const;
+    Type slotType(size_t frame, int slot) const;
+    Type callType(const Expr& call) const;
+    int matchArgument(const Expr& call, const std::string& parameter) const;
+    bool isQuiet(const Expr& expr, size_t frame) const;
+
+    void line(const std::string& text);
+    std::string convert(const std::string& code, Type from, Type to) const;
+    std::string declare(const std::string& code, Type from, TokenType keyword) const;
+    std::string functionName(size_t function) const;
+    std::string signature(size_t function) const;
+    void emitFunction(size_t function);
+    void emitDynamicCall(const Expr& call, size_t frame);
+    void emitBlock(const std::vector<StmtPtr>& body, size_t frame);
+    void emitStatement(const Stmt& stmt, size_t frame);
+    void emitTailCall(const Expr& call, size_t frame);
+    std::string emitExpression(const Expr& expr, size_t frame);
+    std::vector<std::string> emitOperands(const std::vector<const Expr*>& operands, size_t frame);
+    std::string emitCall(const Expr& call, size_t frame);
+    std::string temporary(const std::string& code, Type type);
+};
+
+// Compiles C++ `source` into `executable` with the system compiler ($CXX,
+// default g++). Returns false with a message in `error` on failure.
+bool buildExecutable(const std::string& source, const std::string& executable, std::string& error);
@@ -0,0 +1,499 @@
+#include "compiler.hpp"
+#include <cstring>
+#include <limits>
+
+static OpCode binaryOpCode(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS: return OpCode::ADD;
+        case TokenType::MINUS: return OpCode::SUBTRACT;
+        case TokenType::STAR: return OpCode::MULTIPLY;
+        case TokenType::SLASH: return OpCode::DIVIDE;
+        case TokenType::EQUAL_EQUAL: return OpCode::EQUAL;
+        case TokenType::NOT_EQUAL: return OpCode::NOT_EQUAL;
+        case TokenType::GREATER: return OpCode::GREATER;
+        case TokenType::GREATER_EQUAL: return OpCode::GREATER_EQUAL;
+        case TokenType::LESS: return OpCode::LESS;
+        default: return OpCode::LESS_EQUAL;
+    }
+}
+
+// Type both operands of a binary expression are brought to before the
+// operator runs: NUM or FLOAT for numbers, STRING for concatenation,
+// DYNAMIC when the operator has to check at runtime.
+static StaticType operandType(const Expr& binary) {
+    StaticType lhs = binary.lhs->static_type;
+    StaticType rhs = binary.rhs->static_type;
+    bool lhs_numeric = lhs == StaticType::NUM || lhs == StaticType::FLOAT;
+    bool rhs_numeric = rhs == StaticType::NUM || rhs == StaticType::FLOAT;
+    if (lhs_numeric && rhs_numeric) {
+        return lhs == StaticType::NUM && rhs == StaticType::NUM ? StaticType::NUM : StaticType::FLOAT;
+    }
+    if (binary.op == TokenType::PLUS && lhs == StaticType::STRING && rhs == StaticType::STRING) {
+        return StaticType::STRING;
+    }
+    return StaticType::DYNAMIC;
+}
+
+static OpCode typedOpCode(TokenType op, StaticType operands) {
+    int offset = static_cast<int>(binaryOpCode(op)) - static_cast<int>(OpCode::ADD);
+    switch (operands) {
+        case StaticType::NUM: return static_cast<OpCode>(static_cast<int>(OpCode::ADD_NUM) + offset);
+        case StaticType::FLOAT: return static_cast<OpCode>(static_cast<int>(OpCode::ADD_FLOAT) + offset);
+        case StaticType::STRING: return OpCode::CONCAT;
+        default: return binaryOpCode(op);
+    }
+}
+
+Compiler::Compiler(const Program& program, bool profiling) : program(program), profiling(profiling) {
+    if (program.function_names.size() > std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("Too many functions in program.");
+    }
+    output.functions.resize(program.function_names.size());
+    // Declarations in code that is never compiled still get their name
+    for (size_t i = 0; i < program.function_names.size(); ++i) {
+        output.functions[i].name = nameIndex(program.function_names[i]);
+    }
+    output.script.name = nameIndex("<script>");
+    chunk = &output.script.chunk;
+}
+
+CompiledProgram Compiler::compile() {
+    for (const auto& stmt : program.statements) {
+        compileTopLevel(*stmt);
+    }
+    return finish();
+}
+
+void Compiler::compileTopLevel(const Stmt& stmt) {
+    if (paused) {
+        // The statement takes the place of the PAUSE
+        chunk->code.pop_back();
+        paused = false;
+    }
+    compileStatement(stmt);
+}
+
+CompiledProgram Compiler::finish() {
+    end();
+    return std::move(output);
+}
+
+void Compiler::pause() {
+    if (!paused) {
+        emitOp(OpCode::PAUSE);
+        paused = true;
+    }
+    output.script.slot_count = program.slot_count;
+    output.call_sites = program.call_sites;
+}
+
+void Compiler::end() {
+    if (ended) return;
+    if (paused) {
+        chunk->code.pop_back();
+        paused = false;
+    }
+    emitOp(OpCode::RETURN_NONE);
+    ended = true;
+    output.script.slot_count = program.slot_count;
+    output.call_sites = program.call_sites;
+}
+
+uint32_t Compiler::nameIndex(const std::string& name) {
+    auto found = name_indices.find(name);
+    if (found != name_indices.end()) {
+        return found->second;
+    }
+    if (output.names.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("Too many distinct identifiers in program.");
+    }
+    uint32_t index = static_cast<uint32_t>(output.names.size());
+    output.names.push_back(name);
+    name_indices[name] = index;
+    return index;
+}
+
+// Literals are pooled once per chunk, keyed by their type and payload.
+uint32_t Compiler::addConstant(const Value& value) {
+    std::string key(1, static_cast<char>(value.type));
+    if (value.type == ValueType::STRING) {
+        key += value.str();
+    } else {
+        int payload = value.type == ValueType::NUMBER ? value.i_value : 0;
+        if (value.type == ValueType::FLOAT) std::memcpy(&payload, &value.f_value, sizeof(payload));
+        if (value.type == ValueType::BOOLEAN) payload = value.b_value;
+        if (value.type == ValueType::CHAR) payload = value.c_value;
+        key.append(reinterpret_cast<const char*>(&payload), sizeof(payload));
+    }
+
+    auto found = constant_indices.find(key);
+    if (found != constant_indices.end()) {
+        return found->second;
+    }
+    if (chunk->constants.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("Too many constants in one chunk.");
+    }
+    uint32_t index = static_cast<uint32_t>(chunk->constants.size());
+    chunk->constants.push_back(value);
+    constant_indices[key] = index;
+    return index;
+}
+
+void Compiler::emitConstant(const Value& value) {
+    uint32_t index = addConstant(value);
+    if (index <= std::numeric_limits<uint16_t>::max()) {
+        emitOp(OpCode::CONSTANT);
+        emitShort(static_cast<uint16_t>(index));
+    } else {
+        emitOp(OpCode::CONSTANT_LONG);
+        emitLong(index);
+    }
+}
+
+void Compiler::emitByte(uint8_t byte) {
+    chunk->code.push_back(byte);
+}
+
+void Compiler::emitOp(OpCode op) {
+    emitByte(static_cast<uint8_t>(op));
+}
+
+void Compiler::emitShort(uint16_t value) {
+    emitByte(static_cast<uint8_t>(value & 0xff));
+    emitByte(static_cast<uint8_t>(value >> 8));
+}
+
+void Compiler::emitLong(uint32_t value) {
+    emitShort(static_cast<uint16_t>(value & 0xffff));
+    emitShort(static_cast<uint16_t>(value >> 16));
+}
+
+// Emits a forward jump with a placeholder offset and returns the operand position.
+size_t Compiler::emitJump(OpCode op) {
+    emitOp(op);
+    emitLong(0xffffffff);
+    return chunk->code.size() - 4;
+}
+
+// Offsets are 32 bits, so a jump can cross any body a chunk can hold.
+void Compiler::patchJump(size_t operand) {
+    size_t jump = chunk->code.size() - (operand + 4);
+    if (jump > std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("Too much code to jump over.");
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        chunk->code[operand + i] = static_cast<uint8_t>(jump >> (8 * i));
+    }
+}
+
+void Compiler::emitLoop(size_t loop_start) {
+    emitOp(OpCode::LOOP);
+    size_t offset = chunk->code.size() + 4 - loop_start;
+    if (offset > std::numeric_limits<uint32_t>::max()) {
+        throw RuntimeError("Loop body too large.");
+    }
+    emitLong(static_cast<uint32_t>(offset));
+    emitLong(static_cast<uint32_t>(output.loop_count++));
+}
+
+void Compiler::compileFunction(const FunctionDecl& decl, CompiledFunction& function) {
+    function.name = nameIndex(decl.name);
+    function.line = decl.line;
+    function.is_pure = decl.is_pure;
+    function.slot_count = decl.slot_count;
+    for (const auto& param : decl.parameters) {
+        function.parameters.push_back({ nameIndex(param.name), param.default_value != nullptr, param.type });
+    }
+
+    Chunk* enclosing = chunk;
+    std::unordered_map<std::string, uint32_t> enclosing_constants;
+    enclosing_constants.swap(constant_indices);
+    chunk = &function.chunk;
+    for (const auto& stmt : decl.body) {
+        compileStatement(*stmt);
+    }
+    emitOp(OpCode::RETURN_NONE);
+    chunk = enclosing;
+    constant_indices.swap(enclosing_constants);
+}
+
+// Blocks need no runtime bookkeeping: the Resolver already placed their
+// variables in frame slots.
+void Compiler::compileBlock(const std::vector<StmtPtr>& body) {
+    for (const auto& stmt : body) {
+        compileStatement(*stmt);
+    }
+}
+
+void Compiler::emitSlot(OpCode op, int slot) {
+    emitOp(op);
+    emitLong(static_cast<uint32_t>(slot));
+}
+
+void Compiler::compileStatement(const Stmt& stmt) {
+    if (profiling) {
+        emitOp(OpCode::COUNT_LINE);
+        emitLong(static_cast<uint32_t>(stmt.line));
+    }
+    switch (stmt.kind) {
+        case StmtKind::SHOW:
+            compileExpression(*stmt.expr);
+            emitOp(OpCode::SHOW);
+            break;
+        case StmtKind::VAR_DECL:
+            // Values of a known type are converted here instead of at runtime;
+            // arrays always convert at runtime, where their elements are
+            if (stmt.expr->static_type == StaticType::DYNAMIC || stmt.type == TokenType::KEYWORD_NUM_ARRAY
+                || stmt.type == TokenType::KEYWORD_FLOAT_ARRAY) {
+                compileExpression(*stmt.expr);
+                emitSlot(OpCode::DECLARE_LOCAL, stmt.slot);
+                emitByte(static_cast<uint8_t>(stmt.type));
+            } else {
+                if (stmt.type == TokenType::KEYWORD_NUM) compileAs(*stmt.expr, StaticType::NUM);
+                else if (stmt.type == TokenType::KEYWORD_FLOAT) compileAs(*stmt.expr, StaticType::FLOAT);
+                else compileExpression(*stmt.expr);
+                emitSlot(OpCode::SET_LOCAL, stmt.slot);
+            }
+            break;
+        case StmtKind::ASSIGN:
+            if (stmt.in_place) {
+                compileInPlace(*stmt.expr, stmt.slot);
+                break;
+            }
+            compileExpression(*stmt.expr);
+            emitSlot(OpCode::SET_LOCAL, stmt.slot);
+            break;
+        case StmtKind::IF: {
+            compileExpression(*stmt.expr);
+            size_t else_jump = emitJump(stmt.expr->static_type == StaticType::BOOL ? OpCode::JUMP_IF_FALSE_BOOL : OpCode::JUMP_IF_FALSE);
+            compileBlock(stmt.body);
+            if (stmt.has_else) {
+                size_t end_jump = emitJump(OpCode::JUMP);
+                patchJump(else_jump);
+                compileBlock(stmt.else_body);
+                patchJump(end_jump);
+            } else {
+                patchJump(else_jump);
+            }
+            break;
+        }
+        case StmtKind::WHILE: {
+            size_t loop_start = chunk->code.size();
+            compileExpression(*stmt.expr);
+            size_t exit_jump = emitJump(stmt.expr->static_type == StaticType::BOOL ? OpCode::JUMP_IF_FALSE_BOOL : OpCode::LOOP_IF_FALSE);
+            compileBlock(stmt.body);
+            emitLoop(loop_start);
+            patchJump(exit_jump);
+            break;
+        }
+        case StmtKind::BLOCK:
+            compileBlock(stmt.body);
+            break;
+        case StmtKind::FUN_DECL: {
+            // Defaults are evaluated where the declaration runs, in declaration order
+            const FunctionDecl& decl = *program.functions[stmt.function];
+            compileFunction(decl, output.functions[stmt.function]);
+            for (const auto& param : decl.parameters) {
+                if (param.default_value) {
+                    compileExpression(*param.default_value);
+                }
+            }
+            emitOp(OpCode::DEFINE_FUNCTION);
+            emitLong(static_cast<uint32_t>(stmt.function));
+            break;
+        }
+        case StmtKind::RETURN:
+            compileExpression(*stmt.expr);
+            emitOp(OpCode::RETURN);
+            break;
+        case StmtKind::EXPRESSION:
+            compileExpression(*stmt.expr);
+            if (stmt.expr->kind != ExprKind::METHOD || stmt.expr->method != Method::SEND) {
+                emitOp(OpCode::POP); // SEND leaves nothing
+            }
+            break;
+        case StmtKind::SPAWN:
+            compileCall(*stmt.expr, true);
+            break;
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND:
+            if (stmt.kind == StmtKind::STORE_INDEX) {
+                compileExpression(*stmt.index);
+            }
+            compileExpression(*stmt.expr);
+            if (stmt.slot == UNRESOLVED_SLOT) {
+                emitOp(OpCode::UNDEFINED_VARIABLE);
+                emitLong(nameIndex(stmt.name));
+            } else {
+                emitSlot(stmt.kind == StmtKind::STORE_INDEX ? OpCode::STORE_INDEX : OpCode::APPEND, stmt.slot);
+            }
+            break;
+        case StmtKind::PARALLEL: {
+            // The body is compiled in line as a loop over one chunk, from the
+            // index to the slot after it; the VM skips it and runs it on its workers
+            compileExpression(*stmt.expr);
+            compileExpression(*stmt.index);
+            if (stmt.reductions.size() > std::numeric_limits<uint8_t>::max()) {
+                throw RuntimeError("Too many reductions in one parallel loop.");
+            }
+            emitSlot(OpCode::PARALLEL, stmt.slot);
+            emitByte(static_cast<uint8_t>(stmt.reductions.size()));
+            for (const auto& clause : stmt.reductions) {
+                emitLong(static_cast<uint32_t>(clause.slot));
+                emitByte(static_cast<uint8_t>(clause.kind));
+            }
+            emitLong(0xffffffff);
+            size_t body_jump = chunk->code.size() - 4;
+            size_t loop_start = chunk->code.size();
+            emitSlot(OpCode::GET_LOCAL, stmt.slot);
+            emitSlot(OpCode::GET_LOCAL, stmt.slot + 1);
+            emitOp(OpCode::LESS_NUM);
+            size_t exit_jump = emitJump(OpCode::JUMP_IF_FALSE_BOOL);
+            compileBlock(stmt.body);
+            emitConstant(Value(1));
+            emitSlot(OpCode::UPDATE_LOCAL_NUM, stmt.slot);
+            emitByte(static_cast<uint8_t>(TokenType::PLUS));
+            emitLoop(loop_start);
+            patchJump(exit_jump);
+            emitOp(OpCode::PARALLEL_END);
+            patchJump(body_jump);
+            break;
+        }
+    }
+}
+
+// Emits `x = x op a op b ...` as successive updates of x's slot, see Resolver.
+void Compiler::compileInPlace(const Expr& value, int slot) {
+    if (value.kind != ExprKind::BINARY) {
+        return; // reached x itself
+    }
+    compileInPlace(*value.lhs, slot);
+    StaticType operands = operandType(value);
+    OpCode update = OpCode::UPDATE_LOCAL;
+    if (operands == StaticType::NUM) {
+        update = OpCode::UPDATE_LOCAL_NUM;
+    } else if (operands == StaticType::FLOAT && value.lhs->static_type == StaticType::FLOAT) {
+        update = OpCode::UPDATE_LOCAL_FLOAT;
+    }
+    if (update == OpCode::UPDATE_LOCAL_FLOAT) {
+        compileAs(*value.rhs, StaticType::FLOAT);
+    } else {
+        compileExpression(*value.rhs);
+    }
+    emitSlot(update, slot);
+    emitByte(static_cast<uint8_t>(value.op));
+}
+
+// Compiles a num or float expression and converts it to `type`; literals
+// are converted here.
+void Compiler::compileAs(const Expr& expr, StaticType type) {
+    bool converts = (type == StaticType::NUM && expr.static_type == StaticType::FLOAT)
+                    || (type == StaticType::FLOAT && expr.static_type == StaticType::NUM);
+    if (!converts) {
+        compileExpression(expr);
+    } else if (expr.kind == ExprKind::LITERAL) {
+        const Value& value = expr.literal;
+        emitConstant(type == StaticType::FLOAT ? Value(static_cast<float>(value.i_value)) : Value(static_cast<int>(value.f_value)));
+    } else {
+        compileExpression(expr);
+        emitOp(type == StaticType::FLOAT ? OpCode::NUM_TO_FLOAT : OpCode::FLOAT_TO_NUM);
+    }
+}
+
+// A call, or with `spawn` a call that starts a new task: SPAWN goes between
+// the arguments and the call instruction.
+void Compiler::compileCall(const Expr& expr, bool spawn) {
+    if (expr.args.size() >= BIND_MISSING) {
+        throw RuntimeError("Too many arguments in call to '" + expr.name + "'");
+    }
+    for (const auto& arg : expr.args) {
+        compileExpression(*arg.value);
+    }
+    if (spawn) {
+        emitOp(OpCode::SPAWN);
+        spawned = true;
+    }
+    if (expr.function == DYNAMIC_FUNCTION) {
+        emitOp(OpCode::CALL);
+        emitLong(nameIndex(expr.name));
+        emitByte(static_cast<uint8_t>(expr.args.size()));
+        emitLong(static_cast<uint32_t>(expr.call_site));
+        for (const auto& arg : expr.args) {
+            emitLong(nameIndex(arg.name));
+        }
+    } else if (expr.in_order) {
+        emitOp(OpCode::CALL_DIRECT);
+        emitLong(static_cast<uint32_t>(expr.function));
+        emitByte(static_cast<uint8_t>(expr.args.size()));
+    } else {
+        emitOp(OpCode::CALL_BIND);
+        emitLong(static_cast<uint32_t>(expr.function));
+        emitByte(static_cast<uint8_t>(expr.args.size()));
+        for (int binding : expr.bindings) {
+            if (binding == DEFAULT_ARGUMENT) emitByte(BIND_DEFAULT);
+            else if (binding == MISSING_ARGUMENT) emitByte(BIND_MISSING);
+            else emitByte(static_cast<uint8_t>(binding));
+        }
+    }
+}
+
+void Compiler::compileExpression(const Expr& expr) {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            emitConstant(expr.literal);
+            break;
+        case ExprKind::VARIABLE:
+            if (expr.slot == UNRESOLVED_SLOT) {
+                emitOp(OpCode::UNDEFINED_VARIABLE);
+                emitLong(nameIndex(expr.name));
+            } else {
+                emitSlot(OpCode::GET_LOCAL, expr.slot);
+            }
+            break;
+        case ExprKind::BINARY: {
+            StaticType operands = operandType(expr);
+            compileAs(*expr.lhs, operands);
+            compileAs(*expr.rhs, operands);
+            emitOp(typedOpCode(expr.op, operands));
+            break;
+        }
+        case ExprKind::CALL:
+            compileCall(expr, false);
+            break;
+        case ExprKind::ARRAY:
+            for (const auto& element : expr.elements) {
+                compileExpression(*element);
+            }
+            emitOp(OpCode::ARRAY);
+            emitLong(static_cast<uint32_t>(expr.elements.size()));
+            break;
+        case ExprKind::INDEX:
+            compileExpression(*expr.lhs);
+            compileExpression(*expr.rhs);
+            emitOp(OpCode::INDEX);
+            break;
+        case ExprKind::CHANNEL:
+            compileExpression(*expr.rhs);
+            emitOp(OpCode::CHANNEL);
+            break;
+        case ExprKind::METHOD:
+            compileExpression(*expr.lhs);
+            switch (expr.method) {
+                case Method::LENGTH: emitOp(OpCode::ARRAY_LENGTH); break;
+                case Method::SUM: emitOp(OpCode::ARRAY_SUM); break;
+                case Method::MIN: emitOp(OpCode::ARRAY_MIN); break;
+                case Method::MAX: emitOp(OpCode::ARRAY_MAX); break;
+                case Method::RECEIVE: emitOp(OpCode::RECEIVE); break;
+                case Method::SEND:
+                    compileExpression(*expr.rhs);
+                    emitOp(OpCode::SEND);
+                    break;
+                default:
+                    // `.append` only reaches here as a statement, see Parser
+                    compileExpression(*expr.rhs);
+                    emitOp(OpCode::ARRAY_DOT);
+                    break;
+            }
+            break;
+    }
+}
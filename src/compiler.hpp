@@ -0,0 +1,64 @@
+#pragma once
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "error.hpp"
+#include <unordered_map>
+#include <string>
+
+// Lowers a parsed Program into bytecode for the VM. Function bodies are
+// compiled where their declaration appears, so statements can also be fed in
+// one at a time while parsing and released once compiled.
+//
+// Operators and declarations whose operand types the TypeChecker proved get
+// typed instructions; without it every expression is DYNAMIC and the
+// generic instructions check at runtime.
+class Compiler {
+public:
+    // With `profiling` every statement also counts its line, see Profiler.
+    explicit Compiler(const Program& program, bool profiling = false);
+    CompiledProgram compile();
+
+    // Streaming use: compile resolved top-level statements in order, then finish().
+    void compileTopLevel(const Stmt& stmt);
+    CompiledProgram finish();
+    // The script so far can run before the next statement is compiled:
+    // pause() ends it with PAUSE, end() with its final RETURN_NONE. Either
+    // makes compiled() complete up to there.
+    void pause();
+    void end();
+    const CompiledProgram& compiled() const { return output; }
+    // A `spawn` was compiled; tasks cannot be paused, see VM::resume
+    bool spawns() const { return spawned; }
+
+private:
+    const Program& program;
+    CompiledProgram output;
+    std::unordered_map<std::string, uint32_t> name_indices;
+    Chunk* chunk = nullptr;
+    bool profiling;
+    bool paused = false;
+    bool ended = false;
+    bool spawned = false;
+    std::unordered_map<std::string, uint32_t> constant_indices; // of the current chunk
+
+    uint32_t nameIndex(const std::string& name);
+    uint32_t addConstant(const Value& value);
+    void emitConstant(const Value& value);
+
+    void emitByte(uint8_t byte);
+    void emitOp(OpCode op);
+    void emitShort(uint16_t value);
+    void emitLong(uint32_t value);
+    size_t emitJump(OpCode op);
+    void patchJump(size_t operand);
+    void emitLoop(size_t loop_start);
+
+    void compileFunction(const FunctionDecl& decl, CompiledFunction& function);
+    void compileBlock(const std::vector<StmtPtr>& body);
+    void emitSlot(OpCode op, int slot);
+    void compileStatement(const Stmt& stmt);
+    void compileExpression(const Expr& expr);
+    void compileCall(const Expr& expr, bool spawn);
+    void compileInPlace(const Expr& value, int slot);
+    void compileAs(const Expr& expr, StaticType type);
+};
@@ -0,0 +1,352 @@
+#include "driver.hpp"
+#include "allocation_counter.hpp"
+#include "c_emitter.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "memo_cache.hpp"
+#include "operations.hpp"
+#include "optimizer.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "program_cache.hpp"
+#include "resolver.hpp"
+#include "source_file.hpp"
+#include "type_checker.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+RunOptions::RunOptions()
+    : max_depth(DEFAULT_MAX_CALL_DEPTH), threads(std::max(std::thread::hardware_concurrency(), 1u)) {}
+
+static void makeAbsolute(std::string& path, const std::string& directory) {
+    if (!path.empty() && path != "-" && path[0] != '/') {
+        path = directory + "/" + path;
+    }
+}
+
+void RunOptions::resolvePaths(const std::string& directory) {
+    makeAbsolute(stacks_path, directory);
+    makeAbsolute(emit_path, directory);
+    makeAbsolute(build_path, directory);
+    makeAbsolute(path, directory);
+}
+
+void printUsage(FILE* stream) {
+    std::fputs("Usage: supernova [--interp] [--line-buffered] [--max-depth <n>] [--no-memo] [--memo-stats] [--task-stats] [--alloc-stats] [--no-jit] [--no-cache] [--threads <n>] [--profile] [--profile-stacks <file>] [--emit-c <file>] [--build <file>] <source-file>\n"
+               "       supernova --serve <socket>\n"
+               "       supernova --client <socket> [options] <source-file>\n"
+               "  --interp                 run with the tree-walking interpreter instead of the bytecode VM\n"
+               "  --line-buffered          write each line of output immediately (default on a terminal)\n"
+               "  --max-depth <n>          fail with a runtime error beyond n nested calls (default 1000000)\n"
+               "  --no-memo                do not cache results of pure functions\n"
+               "  --memo-stats             print the hit rate of the pure-function cache on exit\n"
+               "  --task-stats             print how many tasks ran, how often they switched and the peak run queue on exit\n"
+               "  --alloc-stats            print the heap allocations made while compiling and while running on exit\n"
+               "  --no-jit                 never compile hot loops and functions to native code\n"
+               "  --no-cache               neither read nor write the compiled program cache (<file>.nvc)\n"
+               "  --threads <n>            run parallel loops and tasks on n threads (default: one per core)\n"
+               "  --profile                print per-function times and per-line statement counts on exit\n"
+               "  --profile-stacks <file>  profile and also write collapsed call stacks for flame graphs\n"
+               "  --emit-c <file>          translate the program to standalone C++ instead of running it (- for stdout)\n"
+               "  --build <file>           compile the program to a native executable with the system C++ compiler\n"
+               "  --serve <socket>         keep compiled programs in memory and run the command lines of clients\n"
+               "  --client <socket>        run the command line in the --serve daemon listening on <socket>\n",
+               stream);
+}
+
+// A positive count, as taken by --max-depth and --threads.
+static bool parseCount(const std::string& text, size_t& count) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value == 0) {
+        return false;
+    }
+    count = static_cast<size_t>(value);
+    return true;
+}
+
+bool parseRunOptions(const std::vector<std::string>& args, RunOptions& options) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        if (arg == "--interp") {
+            options.use_interpreter = true;
+        } else if (arg == "--line-buffered") {
+            options.line_buffered = true;
+        } else if (arg == "--max-depth" && has_value) {
+            if (!parseCount(args[++i], options.max_depth)) {
+                return false;
+            }
+        } else if (arg == "--no-memo") {
+            options.memoize = false;
+        } else if (arg == "--memo-stats") {
+            options.memo_stats = true;
+        } else if (arg == "--task-stats") {
+            options.task_stats = true;
+        } else if (arg == "--alloc-stats") {
+            options.alloc_stats = true;
+        } else if (arg == "--no-jit") {
+            options.use_jit = false;
+        } else if (arg == "--no-cache") {
+            options.use_cache = false;
+        } else if (arg == "--threads" && has_value) {
+            if (!parseCount(args[++i], options.threads)) {
+                return false;
+            }
+        } else if (arg == "--profile") {
+            options.profile = true;
+        } else if (arg == "--profile-stacks" && has_value) {
+            options.profile = true;
+            options.stacks_path = args[++i];
+        } else if (arg == "--emit-c" && has_value) {
+            options.emit_path = args[++i];
+        } else if (arg == "--build" && has_value) {
+            options.build_path = args[++i];
+        } else if (options.path.empty() && !arg.empty()) {
+            options.path = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.path.empty();
+}
+
+bool LoadedPrograms::stamp(const std::string& path, int64_t& modified, int64_t& size) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+#if defined(__APPLE__)
+    modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    modified = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#else
+    modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    size = static_cast<int64_t>(info.st_size);
+    return true;
+}
+
+std::shared_ptr<const CompiledProgram> LoadedPrograms::load(const std::string& path, std::string& error) {
+    // Stamped before reading, so a change made meanwhile is seen next time
+    int64_t modified = -1;
+    int64_t size = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = programs.find(path);
+        if (found != programs.end()) {
+            if (stamp(path, modified, size) && found->second.modified == modified && found->second.size == size) {
+                found->second.used = ++uses;
+                return found->second.program;
+            }
+            programs.erase(found); // changed or gone
+        } else {
+            stamp(path, modified, size);
+        }
+    }
+    SourceFile source;
+    if (!source.open(path, error)) {
+        return nullptr;
+    }
+    std::shared_ptr<const CompiledProgram> program =
+        std::make_shared<const CompiledProgram>(compileSource(source.data(), source.size(), false));
+    store(path, modified, size, program);
+    return program;
+}
+
+bool LoadedPrograms::has(const std::string& path) {
+    int64_t modified;
+    int64_t size;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = programs.find(path);
+    return found != programs.end() && stamp(path, modified, size) && found->second.modified == modified
+           && found->second.size == size;
+}
+
+void LoadedPrograms::store(const std::string& path, int64_t modified, int64_t size,
+                           std::shared_ptr<const CompiledProgram> program) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (programs.size() >= MAX_PROGRAMS && !programs.count(path)) {
+        auto oldest = programs.begin();
+        for (auto it = programs.begin(); it != programs.end(); ++it) {
+            if (it->second.used < oldest->second.used) {
+                oldest = it;
+            }
+        }
+        programs.erase(oldest);
+    }
+    Entry& entry = programs[path];
+    entry.modified = modified;
+    entry.size = size;
+    entry.used = ++uses;
+    entry.program = std::move(program);
+}
+
+bool usesLoadedPrograms(const RunOptions& options) {
+    bool needs_tree = !options.emit_path.empty() || !options.build_path.empty() || options.use_interpreter;
+    return !needs_tree && options.use_cache && !options.profile;
+}
+
+int runCommand(const RunOptions& options, FILE* out, FILE* err, LoadedPrograms* loaded) {
+    // These work on the whole syntax tree rather than on bytecode
+    bool needs_tree = !options.emit_path.empty() || !options.build_path.empty() || options.use_interpreter;
+    bool warm = loaded && usesLoadedPrograms(options);
+    SourceFile source;
+    std::string error;
+    if (!warm && !source.open(options.path, error)) {
+        std::fprintf(err, "Error: %s\n", error.c_str());
+        return 1;
+    }
+
+    Output output(out);
+    bool line_buffered = options.line_buffered;
+#ifndef _WIN32
+    line_buffered = line_buffered || isatty(fileno(out)) != 0;
+#endif
+    output.setLineBuffered(line_buffered);
+    Profiler profiler;
+    Profiler* active_profiler = options.profile ? &profiler : nullptr;
+    MemoCache memo;
+    MemoCache* active_memo = options.memoize ? &memo : nullptr;
+    ThreadPool pool(options.threads);
+    TaskStats tasks;
+    int status = 0;
+    // Allocations before compiling, once the program starts running, and
+    // while it waits for the statements compiled after that
+    AllocationCount compile_start = allocationCount();
+    AllocationCount run_start;
+    AllocationCount compiled_later;
+    bool started = false;
+    // Compiles the script while it runs when no cached bytecode is used
+    std::unique_ptr<SourceCompiler> streaming;
+    bool cached = !warm && options.use_cache && !options.profile;
+    std::string cache_path;
+    uint64_t source_hash = 0;
+
+    try {
+        if (needs_tree) {
+            Lexer lexer(source.data(), source.size());
+            Parser parser(lexer);
+            Program program = parser.parse();
+            Optimizer optimizer(program);
+            optimizer.optimize();
+            Resolver resolver(program);
+            resolver.resolve();
+            TypeChecker checker(program);
+            checker.check();
+            if (options.use_interpreter) {
+                Interpreter interpreter(program, output, active_profiler);
+                interpreter.setMaxCallDepth(options.max_depth);
+                interpreter.setMemoCache(active_memo);
+                interpreter.setThreadPool(&pool);
+                run_start = allocationCount();
+                started = true;
+                interpreter.run();
+            } else {
+                CEmitter emitter(program, options.max_depth);
+                std::string code = emitter.emit();
+                if (options.emit_path == "-") {
+                    output.write(code.data(), code.size());
+                } else if (!options.emit_path.empty()) {
+                    std::ofstream file(options.emit_path.c_str(), std::ios::binary);
+                    if (!(file << code)) {
+                        std::fprintf(err, "Error: cannot write '%s'\n", options.emit_path.c_str());
+                        status = 1;
+                    }
+                }
+                if (!options.build_path.empty() && !buildExecutable(code, options.build_path, error)) {
+                    std::fprintf(err, "Error: %s\n", error.c_str());
+                    status = 1;
+                }
+            }
+        } else {
+            // Unchanged scripts start from the bytecode compiled by an
+            // earlier run. Others run each statement as soon as it is
+            // compiled, except profiled ones, whose functions the Profiler
+            // lists before the run.
+            std::shared_ptr<const CompiledProgram> compiled;
+            if (warm) {
+                compiled = loaded->load(options.path, error);
+                if (!compiled) {
+                    std::fprintf(err, "Error: %s\n", error.c_str());
+                    return 1;
+                }
+            } else {
+                CompiledProgram fresh;
+                if (cached) {
+                    cache_path = programCachePath(options.path);
+                    source_hash = hashSource(source.data(), source.size());
+                }
+                if (cached && loadProgramCache(cache_path, source_hash, fresh)) {
+                    compiled = std::make_shared<const CompiledProgram>(std::move(fresh));
+                } else {
+                    streaming.reset(new SourceCompiler(source.data(), source.size(), options.profile));
+                    while (streaming->compileNext() && options.profile) {}
+                }
+            }
+            VM vm(compiled ? *compiled : streaming->program(), output, active_profiler);
+            vm.setMaxCallDepth(options.max_depth);
+            vm.setMemoCache(active_memo);
+            vm.setJitEnabled(options.use_jit);
+            vm.setThreadPool(&pool);
+            vm.setTaskStats(&tasks);
+            run_start = allocationCount();
+            started = true;
+            vm.run();
+            while (vm.paused()) {
+                AllocationCount compile_next = allocationCount();
+                streaming->compileNext();
+                compiled_later = compiled_later + (allocationCount() - compile_next);
+                vm.resume();
+            }
+        }
+    } catch (const RuntimeError& e) {
+        // Everything shown before the error goes out first
+        output.flush();
+        std::fprintf(err, "Runtime Error: %s\n", e.what());
+        status = 1;
+    }
+
+    output.flush();
+    AllocationCount end = allocationCount();
+    if (!started) {
+        run_start = end;
+    }
+    // Bytecode is cached once the whole script compiled; a run that ended
+    // early compiles the rest first
+    if (streaming && cached && !streaming->failed()) {
+        try {
+            saveProgramCache(cache_path, source_hash, streaming->finish()); // best effort
+        } catch (const RuntimeError&) {
+        }
+    }
+    if (options.memo_stats) {
+        memo.printStats(err);
+    }
+    if (options.task_stats) {
+        tasks.print(err);
+    }
+    if (options.alloc_stats) {
+        printAllocationStats(err, run_start - compile_start + compiled_later, end - run_start - compiled_later);
+    }
+    if (options.profile) {
+        profiler.finish();
+        profiler.report(err);
+        if (!options.stacks_path.empty() && !profiler.writeCollapsedStacks(options.stacks_path)) {
+            std::fprintf(err, "Error: cannot write '%s'\n", options.stacks_path.c_str());
+            status = 1;
+        }
+    }
+    std::fflush(err);
+    return status;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "bytecode.hpp"
+#include "nova.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What a `supernova` command line asks for and how it is carried out,
+// shared by main() and the --serve daemon, which runs the command line of
+// each client the same way.
+
+struct RunOptions {
+    bool use_interpreter = false;
+    bool line_buffered = false; // also when the output is a terminal
+    bool profile = false;
+    std::string stacks_path; // --profile-stacks
+    size_t max_depth;
+    bool memoize = true;
+    bool memo_stats = false;
+    bool task_stats = false;
+    bool alloc_stats = false;
+    bool use_jit = true;
+    bool use_cache = true;
+    size_t threads; // one per core unless given
+    std::string emit_path;
+    std::string build_path;
+    std::string path; // of the script
+
+    RunOptions();
+
+    // Makes the paths relative to `directory` absolute.
+    void resolvePaths(const std::string& directory);
+};
+
+void printUsage(FILE* stream);
+
+// Returns false when the arguments, without the program name, are not a
+// valid command line.
+bool parseRunOptions(const std::vector<std::string>& args, RunOptions& options);
+
+// Compiled programs the --serve daemon keeps in memory, keyed by path. An
+// entry is used while the file keeps the modification time and size it had
+// when it was read, and replaced once it changes. Beyond MAX_PROGRAMS the
+// least recently used entry is dropped. Any thread may use it.
+class LoadedPrograms {
+public:
+    static const size_t MAX_PROGRAMS = 256;
+
+    // The program for `path`, compiled again if the file changed. Returns
+    // null with `error` set when the file cannot be read; errors in the
+    // program raise RuntimeError and are not kept.
+    std::shared_ptr<const CompiledProgram> load(const std::string& path, std::string& error);
+
+    // Whether the program for `path` is kept and the file unchanged since.
+    bool has(const std::string& path);
+    // Keeps `program`, compiled from `path` after stamp() gave `modified`
+    // and `size`; a change made meanwhile is seen next time.
+    void store(const std::string& path, int64_t modified, int64_t size, std::shared_ptr<const CompiledProgram> program);
+    // Modification time and size of a file, which tell whether it changed.
+    static bool stamp(const std::string& path, int64_t& modified, int64_t& size);
+
+private:
+    struct Entry {
+        int64_t modified = -1; // nanoseconds since the epoch
+        int64_t size = -1;
+        uint64_t used = 0; // `uses` when last loaded
+        std::shared_ptr<const CompiledProgram> program;
+    };
+
+    std::mutex mutex; // guards the fields below
+    std::unordered_map<std::string, Entry> programs;
+    uint64_t uses = 0;
+};
+
+// Whether runCommand takes the program from its LoadedPrograms: runs of the
+// VM that neither profile nor bypass the cache.
+bool usesLoadedPrograms(const RunOptions& options);
+
+// Runs a command line, writing the program's output to `out` and errors and
+// reports to `err`, and returns the exit status. With `loaded`, the VM takes
+// unprofiled programs from it instead of the .nvc cache files.
+int runCommand(const RunOptions& options, FILE* out, FILE* err, LoadedPrograms* loaded = nullptr);
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdexcept>
+#include <string>
+
+class RuntimeError : public std::runtime_error {
+public:
+    explicit RuntimeError(const std::string& message) : std::runtime_error(message) {}
+};
@@ -0,0 +1,484 @@
+#include "interpreter.hpp"
+#include "arrays.hpp"
+#include "operations.hpp"
+#include "tasks.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Non-tail calls recurse on the native stack; stop this far short of its limit.
+static const size_t NATIVE_STACK_RESERVE = 256 * 1024;
+
+static size_t nativeStackBudget() {
+    size_t limit = 1024 * 1024; // Windows default for the main thread
+#ifndef _WIN32
+    struct rlimit rl;
+    limit = 8 * 1024 * 1024;
+    if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+        limit = static_cast<size_t>(rl.rlim_cur);
+    }
+#endif
+    return limit > 2 * NATIVE_STACK_RESERVE ? limit - NATIVE_STACK_RESERVE : limit / 2;
+}
+
+Interpreter::Interpreter(const Program& program, Output& output, Profiler* profiler)
+    : program(program), output(output), profiler(profiler), stack(program.slot_count), functions(program.functions.size()),
+      call_sites(program.call_sites), max_call_depth(DEFAULT_MAX_CALL_DEPTH) {
+    if (profiler) {
+        for (const auto& decl : program.functions) {
+            profiler->addFunction(decl->name, decl->line);
+        }
+    }
+}
+
+const Value& Interpreter::getVariable(const Expr& variable) const {
+    if (variable.slot == UNRESOLVED_SLOT) {
+        throw RuntimeError("Undefined variable '" + variable.name + "'");
+    }
+    return stack[base + variable.slot];
+}
+
+Value Interpreter::evaluate(const Expr& expr) {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            return expr.literal;
+        case ExprKind::VARIABLE:
+            return getVariable(expr);
+        case ExprKind::BINARY: {
+            Value lhs = evaluate(*expr.lhs);
+            Value rhs = evaluate(*expr.rhs);
+            return applyBinary(expr.op, lhs, rhs);
+        }
+        case ExprKind::CALL:
+            return callFunction(expr);
+        case ExprKind::ARRAY:
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+        case ExprKind::CHANNEL:
+            return evaluateObject(expr);
+    }
+    return Value();
+}
+
+// Kept out of evaluate() so that its frame, which every nested call adds to
+// the native stack, stays small.
+Value Interpreter::evaluateObject(const Expr& expr) {
+    switch (expr.kind) {
+        case ExprKind::ARRAY: {
+            std::vector<Value> elements;
+            elements.reserve(expr.elements.size());
+            for (const auto& element : expr.elements) {
+                elements.push_back(evaluate(*element));
+            }
+            return makeArray(elements.data(), elements.size());
+        }
+        case ExprKind::INDEX: {
+            Value array = evaluate(*expr.lhs);
+            Value index = evaluate(*expr.rhs);
+            return arrayIndex(array, index);
+        }
+        case ExprKind::CHANNEL:
+            return makeChannel(evaluate(*expr.rhs));
+        case ExprKind::METHOD: {
+            Value array = evaluate(*expr.lhs);
+            switch (expr.method) {
+                case Method::LENGTH: return arrayLength(array);
+                case Method::SUM: return arraySum(array);
+                case Method::MIN: return arrayMin(array);
+                case Method::MAX: return arrayMax(array);
+                case Method::SEND: {
+                    // Without tasks, nothing could ever make room or send
+                    Value item = evaluate(*expr.rhs);
+                    if (!trySend(array, item)) {
+                        throw RuntimeError(DEADLOCK_ERROR);
+                    }
+                    return Value();
+                }
+                case Method::RECEIVE: {
+                    Value item;
+                    if (!tryReceive(array, item)) {
+                        throw RuntimeError(DEADLOCK_ERROR);
+                    }
+                    return item;
+                }
+                default: {
+                    // `.append` only reaches here as a statement, see Parser
+                    Value other = evaluate(*expr.rhs);
+                    return arrayDot(array, other);
+                }
+            }
+        }
+        default:
+            break;
+    }
+    return Value();
+}
+
+// Evaluates the arguments of `call` on top of the stack, in source order, and
+// leaves them in parameter order; returns the callee's index.
+size_t Interpreter::pushArguments(const Expr& call) {
+    size_t index = call.function;
+    if (index == DYNAMIC_FUNCTION) {
+        index = callSite(call).function;
+    }
+    if (index == DYNAMIC_FUNCTION || !functions[index].decl) {
+        throw RuntimeError("Undefined function '" + call.name + "'");
+    }
+
+    size_t args_base = stack.size();
+    for (const auto& arg : call.args) {
+        Value value = evaluate(*arg.value);
+        stack.push_back(std::move(value));
+    }
+    if (call.function == index) {
+        if (!call.in_order) {
+            bindArguments(call, index, call.bindings, args_base);
+        }
+        return index;
+    }
+
+    const CallSite& site = callSite(call);
+    if (site.function == index) {
+        bindArguments(call, index, site.bindings, args_base);
+    } else {
+        // A declaration that ran while the arguments were evaluated rebound the name
+        std::vector<int> bindings;
+        matchArguments(call, *functions[index].decl, bindings);
+        bindArguments(call, index, bindings, args_base);
+    }
+    return index;
+}
+
+// Inline cache of a call bound by name: the declaration the name refers to
+// and how the arguments map onto its parameters. It stays valid until the
+// next function declaration runs, so repeated calls skip the name lookup.
+const Interpreter::CallSite& Interpreter::callSite(const Expr& call) {
+    CallSite& site = call_sites[call.call_site];
+    if (site.generation != declarations) {
+        site.generation = declarations;
+        auto found = functions_by_name.find(call.name);
+        site.function = found == functions_by_name.end() ? DYNAMIC_FUNCTION : found->second;
+        if (site.function != DYNAMIC_FUNCTION) {
+            matchArguments(call, *functions[site.function].decl, site.bindings);
+        }
+    }
+    return site;
+}
+
+// Binds parameters by name; the last argument with a matching name wins.
+void Interpreter::matchArguments(const Expr& call, const FunctionDecl& decl, std::vector<int>& bindings) {
+    bindings.assign(decl.parameters.size(), MISSING_ARGUMENT);
+    for (size_t i = 0; i < decl.parameters.size(); ++i) {
+        const ParameterDecl& param = decl.parameters[i];
+        for (size_t a = call.args.size(); a-- > 0;) {
+            if (call.args[a].name == param.name) {
+                bindings[i] = static_cast<int>(a);
+                break;
+            }
+        }
+        if (bindings[i] == MISSING_ARGUMENT && param.default_value) {
+            bindings[i] = DEFAULT_ARGUMENT;
+        }
+    }
+}
+
+Value Interpreter::callFunction(const Expr& call) {
+    // The arguments become the first slots of the callee's frame
+    size_t args_base = stack.size();
+    size_t index = pushArguments(call);
+
+    const FunctionDecl& callee = *functions[index].decl;
+    bool memoized = memo && callee.is_pure;
+    size_t memo_function = index;
+    size_t memo_start = memo_args.size(); // of this call's arguments in memo_args
+    if (memoized) {
+        const Value* args = stack.data() + args_base;
+        Value cached;
+        if (memo->lookup(index, args, callee.parameters.size(), cached)) {
+            stack.resize(args_base);
+            return cached;
+        }
+        memo_args.insert(memo_args.end(), args, args + callee.parameters.size());
+    }
+
+    if (depth >= max_call_depth) {
+        throwCallDepthExceeded(max_call_depth);
+    }
+    char marker;
+    if (static_cast<size_t>(native_stack_origin - &marker) > native_stack_budget) {
+        throw RuntimeError("Maximum call depth exceeded: the interpreter ran out of native stack at depth "
+                           + std::to_string(depth) + ".");
+    }
+    depth++;
+
+    size_t caller_base = base;
+    base = args_base;
+    if (profiler) {
+        profiler->enterFunction(index);
+    }
+
+    for (;;) {
+        const FunctionDecl& decl = *functions[index].decl;
+        stack.resize(base + decl.slot_count);
+        for (size_t i = 0; i < decl.parameters.size(); ++i) {
+            convertParameter(decl.parameters[i].type, stack[base + i]);
+        }
+        executeBlock(decl.body);
+        if (!tail_call) {
+            break;
+        }
+
+        // `return g ...` left g's arguments above the frame: run g in this frame
+        index = tail_function;
+        size_t parameter_count = functions[index].decl->parameters.size();
+        for (size_t i = 0; i < parameter_count; ++i) {
+            stack[base + i] = std::move(stack[tail_args_base + i]);
+        }
+        stack.resize(base + parameter_count);
+        tail_call = false;
+        is_returning = false;
+        if (profiler) {
+            profiler->exitFunction();
+            profiler->enterFunction(index);
+        }
+    }
+
+    if (profiler) {
+        profiler->exitFunction();
+    }
+    depth--;
+    base = caller_base;
+    stack.resize(args_base);
+
+    Value result;
+    if (is_returning) {
+        result = std::move(return_value);
+        is_returning = false;
+    }
+    if (memoized) {
+        memo->store(memo_function, memo_args.data() + memo_start, memo_args.size() - memo_start, result);
+        memo_args.resize(memo_start);
+    }
+    return result;
+}
+
+// Moves the evaluated arguments at args_base into parameter order, filling in defaults.
+void Interpreter::bindArguments(const Expr& call, size_t index, const std::vector<int>& bindings, size_t args_base) {
+    const BoundFunction& func = functions[index];
+    const FunctionDecl& decl = *func.decl;
+
+    arguments.assign(decl.parameters.size(), Value());
+    for (size_t i = 0; i < decl.parameters.size(); ++i) {
+        int arg = bindings[i];
+        if (arg == MISSING_ARGUMENT) {
+            throw RuntimeError("Missing argument for parameter '" + decl.parameters[i].name + "' in function '" + call.name + "'");
+        }
+        arguments[i] = arg == DEFAULT_ARGUMENT ? func.defaults[i] : stack[args_base + arg];
+    }
+
+    stack.resize(args_base);
+    for (auto& value : arguments) {
+        stack.push_back(std::move(value));
+    }
+}
+
+void Interpreter::executeBlock(const std::vector<StmtPtr>& body) {
+    for (const auto& stmt : body) {
+        if (is_returning) break;
+        execute(*stmt);
+    }
+}
+
+void Interpreter::executeIf(const Stmt& stmt) {
+    if (isTruthy(evaluate(*stmt.expr))) {
+        executeBlock(stmt.body);
+    } else if (stmt.has_else) {
+        executeBlock(stmt.else_body);
+    }
+}
+
+void Interpreter::executeWhile(const Stmt& stmt) {
+    while (loopCondition(evaluate(*stmt.expr))) {
+        executeBlock(stmt.body);
+        if (is_returning) { // Handle return inside loop
+            return;
+        }
+    }
+}
+
+void Interpreter::executeFunctionDeclaration(const Stmt& stmt) {
+    const FunctionDecl& decl = *program.functions[stmt.function];
+    std::vector<Value> defaults(decl.parameters.size());
+    for (size_t i = 0; i < decl.parameters.size(); ++i) {
+        if (decl.parameters[i].default_value) {
+            defaults[i] = evaluate(*decl.parameters[i].default_value);
+        }
+    }
+    BoundFunction& func = functions[stmt.function];
+    func.decl = &decl;
+    func.defaults.swap(defaults);
+    functions_by_name[decl.name] = stmt.function;
+    declarations++; // invalidates every call site cache
+}
+
+// Runs `x = x op a op b ...` as successive updates of x's slot, see Resolver.
+void Interpreter::assignInPlace(const Expr& value, int slot) {
+    if (value.kind != ExprKind::BINARY) {
+        return; // reached x itself
+    }
+    assignInPlace(*value.lhs, slot);
+    Value rhs = evaluate(*value.rhs);
+    applyBinaryInPlace(value.op, stack[base + slot], rhs);
+}
+
+// `name[index] = value` and `name.append(value)`.
+void Interpreter::updateArray(const Stmt& stmt) {
+    Value index = stmt.index ? evaluate(*stmt.index) : Value();
+    Value element = evaluate(*stmt.expr);
+    if (stmt.slot == UNRESOLVED_SLOT) {
+        throw RuntimeError("Undefined variable '" + stmt.name + "'");
+    }
+    // Taken after evaluating: calls may grow the stack
+    Value& array = stack[base + stmt.slot];
+    if (stmt.kind == StmtKind::STORE_INDEX) {
+        arrayStore(array, index, element);
+    } else {
+        arrayAppend(array, element);
+    }
+}
+
+void Interpreter::executeParallel(const Stmt& stmt) {
+    Value from = evaluate(*stmt.expr);
+    Value limit = evaluate(*stmt.index);
+    std::vector<Reduction> kinds;
+    std::vector<Value> values;
+    for (const auto& clause : stmt.reductions) {
+        kinds.push_back(clause.kind);
+        values.push_back(stack[base + clause.slot]);
+    }
+
+    // Profiles count into one Profiler, so they keep to this thread
+    ThreadPool* threads = profiler ? nullptr : pool;
+    size_t workers = parallelWorkers(threads);
+    while (parallel_workers.size() < workers) {
+        parallel_workers.emplace_back(new Interpreter(program, output));
+    }
+    for (size_t w = 0; w < workers; ++w) {
+        Interpreter& worker = *parallel_workers[w];
+        worker.profiler = profiler;
+        worker.functions = functions;
+        worker.functions_by_name = functions_by_name;
+        worker.declarations = declarations;
+        worker.depth = depth;
+        worker.max_call_depth = max_call_depth;
+        worker.memo = workers > 1 ? nullptr : memo;
+        // Worker 0 runs on this thread, further down its native stack
+        worker.native_stack_origin = native_stack_origin;
+        worker.native_stack_budget = native_stack_budget;
+    }
+    const Value* slots = stack.data() + base;
+    size_t slot_count = stack.size() - base;
+    runParallelLoop(threads, from, limit, kinds, values.data(), [&](size_t worker, int first, int last, Value* partials) {
+        char origin;
+        Interpreter& interpreter = *parallel_workers[worker];
+        if (worker != 0) {
+            interpreter.native_stack_origin = &origin;
+            interpreter.native_stack_budget = nativeStackBudget();
+        }
+        interpreter.runChunk(stmt, slots, slot_count, first, last, partials);
+    });
+    for (size_t r = 0; r < stmt.reductions.size(); ++r) {
+        stack[base + stmt.reductions[r].slot] = std::move(values[r]);
+    }
+}
+
+// Runs in a worker: the iterations [first, last) on a copy of the loop's
+// frame whose reduction variables start as `partials`.
+void Interpreter::runChunk(const Stmt& loop, const Value* slots, size_t slot_count, int first, int last, Value* partials) {
+    stack.assign(slots, slots + slot_count);
+    base = 0;
+    for (size_t r = 0; r < loop.reductions.size(); ++r) {
+        stack[loop.reductions[r].slot] = partials[r];
+    }
+    for (int i = first; i < last; ++i) {
+        stack[loop.slot] = Value(i);
+        executeBlock(loop.body);
+    }
+    for (size_t r = 0; r < loop.reductions.size(); ++r) {
+        partials[r] = std::move(stack[loop.reductions[r].slot]);
+    }
+}
+
+void Interpreter::execute(const Stmt& stmt) {
+    if (profiler) {
+        profiler->countStatement(stmt.line);
+    }
+    switch (stmt.kind) {
+        case StmtKind::SHOW:
+            output.show(evaluate(*stmt.expr));
+            break;
+        case StmtKind::VAR_DECL:
+        case StmtKind::ASSIGN: {
+            if (stmt.in_place) {
+                assignInPlace(*stmt.expr, stmt.slot);
+                break;
+            }
+            // Evaluate first: calls in the expression may grow the stack
+            Value value = evaluate(*stmt.expr);
+            if (stmt.kind == StmtKind::VAR_DECL) {
+                value = convertForDeclaration(stmt.type, value);
+            }
+            stack[base + stmt.slot] = std::move(value);
+            break;
+        }
+        case StmtKind::IF:
+            executeIf(stmt);
+            break;
+        case StmtKind::WHILE:
+            executeWhile(stmt);
+            break;
+        case StmtKind::BLOCK:
+            executeBlock(stmt.body);
+            break;
+        case StmtKind::FUN_DECL:
+            executeFunctionDeclaration(stmt);
+            break;
+        case StmtKind::RETURN:
+            if (stmt.expr->kind == ExprKind::CALL && depth > 0) {
+                // Tail call, finished by callFunction without growing the native stack
+                tail_args_base = stack.size();
+                tail_function = pushArguments(*stmt.expr);
+                tail_call = true;
+            } else {
+                return_value = evaluate(*stmt.expr);
+            }
+            is_returning = true;
+            break;
+        case StmtKind::EXPRESSION:
+            evaluate(*stmt.expr);
+            break;
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND:
+            updateArray(stmt);
+            break;
+        case StmtKind::PARALLEL:
+            executeParallel(stmt);
+            break;
+        case StmtKind::SPAWN:
+            throw RuntimeError("--interp does not support spawn yet.");
+    }
+}
+
+void Interpreter::run() {
+    char origin;
+    native_stack_origin = &origin;
+    native_stack_budget = nativeStackBudget();
+    if (profiler) {
+        profiler->start();
+    }
+    for (const auto& stmt : program.statements) {
+        if (is_returning) return;
+        execute(*stmt);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "ast.hpp"
+#include "error.hpp"
+#include "memo_cache.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "value.hpp"
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+// Tree-walking evaluator for a parsed and resolved Program. Nova calls
+// recurse through evaluate() on the native stack, except tail calls, which
+// callFunction runs in the caller's frame; the depth limit is therefore also
+// bounded by the native stack size.
+//
+// The body of a `parallel` loop runs on worker Interpreters like the VM's,
+// see vm.hpp. There are no tasks: `spawn` raises, and a channel operation
+// that would have to wait is a deadlock.
+class Interpreter {
+public:
+    Interpreter(const Program& program, Output& output, Profiler* profiler = nullptr);
+    void setMaxCallDepth(size_t depth) { max_call_depth = depth; }
+    // Calls to pure functions are answered from `memo` when it is set.
+    void setMemoCache(MemoCache* cache) { memo = cache; }
+    // Parallel loops run on `workers` when it is set, on this thread otherwise.
+    void setThreadPool(ThreadPool* workers) { pool = workers; }
+    void run();
+
+private:
+    struct BoundFunction {
+        const FunctionDecl* decl = nullptr; // null until the declaration runs
+        std::vector<Value> defaults;        // evaluated when the declaration runs
+    };
+
+    struct CallSite {
+        uint64_t generation = 0; // value of `declarations` when filled in
+        size_t function = DYNAMIC_FUNCTION;
+        std::vector<int> bindings; // like Expr::bindings, for `function`
+    };
+
+    const Program& program;
+    Output& output;
+    Profiler* profiler;
+    std::vector<Value> stack; // frames of every active call, innermost last
+    size_t base = 0;          // first slot of the running function's frame
+    std::vector<BoundFunction> functions; // indexed like Program::functions
+    std::unordered_map<std::string, size_t> functions_by_name; // latest declaration of each name
+    std::vector<CallSite> call_sites; // indexed by Expr::call_site
+    uint64_t declarations = 1;        // function declarations run so far, plus one
+    std::vector<Value> arguments; // scratch space for reordering call arguments
+    bool is_returning = false;
+    Value return_value;
+    bool tail_call = false;     // returning into a call of tail_function
+    size_t tail_function = 0;
+    size_t tail_args_base = 0;  // where the tail call's bound arguments start
+    size_t depth = 0;           // active calls
+    size_t max_call_depth;
+    MemoCache* memo = nullptr;
+    std::vector<Value> memo_args; // arguments of the memoized calls running, innermost last
+    const char* native_stack_origin = nullptr; // deepest calls are furthest below it
+    size_t native_stack_budget = 0;
+    ThreadPool* pool = nullptr;
+    std::vector<std::unique_ptr<Interpreter>> parallel_workers; // indexed by pool worker
+
+    const Value& getVariable(const Expr& variable) const;
+
+    void execute(const Stmt& stmt);
+    void executeBlock(const std::vector<StmtPtr>& body);
+    void executeIf(const Stmt& stmt);
+    void executeWhile(const Stmt& stmt);
+    void executeFunctionDeclaration(const Stmt& stmt);
+    void assignInPlace(const Expr& value, int slot);
+    void updateArray(const Stmt& stmt);
+    void executeParallel(const Stmt& stmt);
+    void runChunk(const Stmt& loop, const Value* slots, size_t slot_count, int first, int last, Value* partials);
+    Value evaluate(const Expr& expr);
+    Value evaluateObject(const Expr& expr);
+    size_t pushArguments(const Expr& call);
+    const CallSite& callSite(const Expr& call);
+    void matchArguments(const Expr& call, const FunctionDecl& decl, std::vector<int>& bindings);
+    Value callFunction(const Expr& call);
+    void bindArguments(const Expr& call, size_t index, const std::vector<int>& bindings, size_t args_base);
+};
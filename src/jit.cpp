@@ -0,0 +1,768 @@
+#include "jit.hpp"
+#include "lexer.hpp"
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define NOVA_JIT 1
+#include <sys/mman.h>
+#endif
+
+NativeCode::NativeCode(void* memory, size_t size, std::vector<std::pair<uint32_t, ValueType>> guards,
+                       std::vector<uint32_t> overwritten)
+    : memory(memory), size(size), entry(reinterpret_cast<Entry>(memory)), guards(std::move(guards)),
+      overwritten(std::move(overwritten)) {}
+
+NativeCode::~NativeCode() {
+#ifdef NOVA_JIT
+    munmap(memory, size);
+#endif
+}
+
+#ifndef NOVA_JIT
+
+bool jitSupported() {
+    return false;
+}
+
+std::unique_ptr<NativeCode> compileRegion(const Chunk&, size_t, size_t, const Value*, size_t) {
+    return nullptr;
+}
+
+#else
+
+bool jitSupported() {
+    return true;
+}
+
+namespace {
+
+// Type of a local or operand during analysis: a ValueType, or UNKNOWN where
+// the paths reaching an instruction disagree. Only UNKNOWN locals may be
+// overwritten; reading one makes the region uncompilable.
+typedef uint8_t Type;
+const Type NUMBER = static_cast<Type>(ValueType::NUMBER);
+const Type FLOAT = static_cast<Type>(ValueType::FLOAT);
+const Type BOOLEAN = static_cast<Type>(ValueType::BOOLEAN);
+const Type UNKNOWN = 0xff;
+
+bool isNumeric(Type type) {
+    return type == NUMBER || type == FLOAT;
+}
+
+bool isScalar(Type type) {
+    return type == NUMBER || type == FLOAT || type == BOOLEAN;
+}
+
+uint16_t readShort(const uint8_t* ip) {
+    return static_cast<uint16_t>(ip[0] | (ip[1] << 8));
+}
+
+uint32_t readLong(const uint8_t* ip) {
+    return readShort(ip) | (static_cast<uint32_t>(readShort(ip + 2)) << 16);
+}
+
+// The untyped form of a typed instruction. The analysis below infers the
+// operand types the TypeChecker proved, so both compile to the same code.
+OpCode genericOp(OpCode op) {
+    int code = static_cast<int>(op);
+    if (op >= OpCode::ADD_NUM && op <= OpCode::LESS_EQUAL_NUM) {
+        return static_cast<OpCode>(static_cast<int>(OpCode::ADD) + code - static_cast<int>(OpCode::ADD_NUM));
+    }
+    if (op >= OpCode::ADD_FLOAT && op <= OpCode::LESS_EQUAL_FLOAT) {
+        return static_cast<OpCode>(static_cast<int>(OpCode::ADD) + code - static_cast<int>(OpCode::ADD_FLOAT));
+    }
+    switch (op) {
+        case OpCode::UPDATE_LOCAL_NUM:
+        case OpCode::UPDATE_LOCAL_FLOAT: return OpCode::UPDATE_LOCAL;
+        case OpCode::JUMP_IF_FALSE_BOOL: return OpCode::JUMP_IF_FALSE;
+        default: return op;
+    }
+}
+
+// Length of a supported instruction, 0 for everything the JIT leaves to the VM.
+size_t instructionLength(OpCode op) {
+    switch (genericOp(op)) {
+        case OpCode::CONSTANT: return 3;
+        case OpCode::CONSTANT_LONG: return 5;
+        case OpCode::GET_LOCAL: return 5;
+        case OpCode::SET_LOCAL: return 5;
+        case OpCode::DECLARE_LOCAL: return 6;
+        case OpCode::UPDATE_LOCAL: return 6;
+        case OpCode::ADD:
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+        case OpCode::NUM_TO_FLOAT:
+        case OpCode::FLOAT_TO_NUM:
+        case OpCode::POP:
+        case OpCode::RETURN:
+        case OpCode::RETURN_NONE:
+            return 1;
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::LOOP_IF_FALSE:
+            return 5;
+        case OpCode::LOOP: return 9;
+        default: return 0;
+    }
+}
+
+bool isArithmetic(OpCode op) {
+    return op == OpCode::ADD || op == OpCode::SUBTRACT || op == OpCode::MULTIPLY || op == OpCode::DIVIDE;
+}
+
+OpCode arithmeticFor(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS: return OpCode::ADD;
+        case TokenType::MINUS: return OpCode::SUBTRACT;
+        case TokenType::STAR: return OpCode::MULTIPLY;
+        default: return OpCode::DIVIDE;
+    }
+}
+
+// Result type of `lhs op rhs` following applyBinary, or UNKNOWN when it raises.
+Type binaryType(OpCode op, Type lhs, Type rhs) {
+    if (!isNumeric(lhs) || !isNumeric(rhs)) {
+        return UNKNOWN;
+    }
+    if (!isArithmetic(op)) {
+        return BOOLEAN;
+    }
+    return lhs == NUMBER && rhs == NUMBER ? NUMBER : FLOAT;
+}
+
+// Type after convertForDeclaration, or UNKNOWN when it raises.
+Type declaredType(TokenType keyword, Type value) {
+    switch (keyword) {
+        case TokenType::KEYWORD_NUM: return isNumeric(value) ? NUMBER : UNKNOWN;
+        case TokenType::KEYWORD_FLOAT: return isNumeric(value) ? FLOAT : UNKNOWN;
+        case TokenType::KEYWORD_BOOL: return value == BOOLEAN ? BOOLEAN : UNKNOWN;
+        case TokenType::KEYWORD_STRING:
+        case TokenType::KEYWORD_CHAR: return UNKNOWN;
+        default: return value;
+    }
+}
+
+int32_t typeOffset() {
+    Value probe;
+    return static_cast<int32_t>(reinterpret_cast<const char*>(&probe.type) - reinterpret_cast<const char*>(&probe));
+}
+
+int32_t payloadOffset() {
+    Value probe;
+    return static_cast<int32_t>(reinterpret_cast<const char*>(&probe.i_value) - reinterpret_cast<const char*>(&probe));
+}
+
+// x86-64 condition codes
+enum Condition : uint8_t {
+    CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+    CC_P = 0xa, CC_NP = 0xb, CC_L = 0xc, CC_GE = 0xd, CC_LE = 0xe, CC_G = 0xf
+};
+
+// Registers used by the templates. Locals are addressed from rbx, the
+// result Value from r12; operands live on the native stack.
+enum Reg : uint8_t { EAX = 0, ECX = 1 };
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+    void emit32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, 4);
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void pushRax() { emit({ 0x50 }); }
+    void popRax() { emit({ 0x58 }); }
+    void popRcx() { emit({ 0x59 }); }
+    void movEaxImm(int32_t value) { emit({ 0xb8 }); emit32(value); }
+
+    // mov r32, [rbx + disp] / movzx r32, byte [rbx + disp]
+    void load(Reg reg, int32_t disp, bool byte) {
+        if (byte) emit({ 0x0f, 0xb6 });
+        else emit({ 0x8b });
+        emit({ static_cast<uint8_t>(0x83 | (reg << 3)) });
+        emit32(disp);
+    }
+    // mov [rbx + disp], eax / al
+    void storeEax(int32_t disp, bool byte) {
+        emit({ static_cast<uint8_t>(byte ? 0x88 : 0x89), 0x83 });
+        emit32(disp);
+    }
+    // mov byte [rbx + disp], imm8
+    void storeByte(int32_t disp, uint8_t value) {
+        emit({ 0xc6, 0x83 });
+        emit32(disp);
+        emit({ value });
+    }
+    // mov [r12 + disp8], eax / al and mov byte [r12 + disp8], imm8
+    void storeResultEax(int8_t disp, bool byte) {
+        emit({ 0x41, static_cast<uint8_t>(byte ? 0x88 : 0x89), 0x44, 0x24, static_cast<uint8_t>(disp) });
+    }
+    void storeResultByte(int8_t disp, uint8_t value) {
+        emit({ 0x41, 0xc6, 0x44, 0x24, static_cast<uint8_t>(disp), value });
+    }
+
+    // movd xmm, r32 or cvtsi2ss xmm, r32
+    void toXmm(uint8_t xmm, Reg reg, bool convert) {
+        if (convert) emit({ 0xf3, 0x0f, 0x2a });
+        else emit({ 0x66, 0x0f, 0x6e });
+        emit({ static_cast<uint8_t>(0xc0 | (xmm << 3) | reg) });
+    }
+    void movdEaxXmm0() { emit({ 0x66, 0x0f, 0x7e, 0xc0 }); }
+    void setccAl(Condition cc) { emit({ 0x0f, static_cast<uint8_t>(0x90 | cc), 0xc0 }); }
+    void setccCl(Condition cc) { emit({ 0x0f, static_cast<uint8_t>(0x90 | cc), 0xc1 }); }
+    void movzxEaxAl() { emit({ 0x0f, 0xb6, 0xc0 }); }
+
+    // Jumps with a rel32 patched later; returns the position of the rel32.
+    size_t jump() { emit({ 0xe9 }); emit32(0); return code.size() - 4; }
+    size_t jumpIf(Condition cc) { emit({ 0x0f, static_cast<uint8_t>(0x80 | cc) }); emit32(0); return code.size() - 4; }
+    void patch(size_t rel32, size_t target) {
+        int32_t distance = static_cast<int32_t>(target) - static_cast<int32_t>(rel32 + 4);
+        std::memcpy(&code[rel32], &distance, 4);
+    }
+};
+
+struct State {
+    bool reached = false;
+    std::vector<Type> slots;
+    std::vector<Type> stack;
+};
+
+class RegionCompiler {
+public:
+    RegionCompiler(const Chunk& chunk, size_t start, size_t end, const Value* slots, size_t slot_count)
+        : chunk(chunk), code(chunk.code.data()), start(start), end(end), entry_slots(slots),
+          slot_count(slot_count), states(end - start), is_instruction(end - start, false),
+          touched(slot_count, false), type_offset(typeOffset()), payload_offset(payloadOffset()) {}
+
+    std::unique_ptr<NativeCode> compile();
+
+private:
+    const Chunk& chunk;
+    const uint8_t* code;
+    size_t start;
+    size_t end;
+    const Value* entry_slots;
+    size_t slot_count;
+    std::vector<State> states;        // indexed by offset - start
+    std::vector<bool> is_instruction; // by offset - start
+    std::vector<bool> touched;        // locals the region reads or writes
+    std::vector<size_t> worklist;
+    int32_t type_offset;
+    int32_t payload_offset;
+
+    Assembler as;
+    std::vector<size_t> labels;                          // native position of each offset
+    std::vector<std::pair<size_t, size_t>> fixups;       // rel32 -> bytecode offset
+    std::vector<std::pair<size_t, uint32_t>> exits;      // rel32 -> resume offset
+
+    bool decode();
+    bool analyze();
+    bool step(size_t offset);
+    bool flowTo(size_t target, const State& state);
+    bool constantType(size_t index, Type& type) const;
+    size_t jumpTarget(size_t offset) const;
+
+    void generate();
+    void emitInstruction(size_t offset, size_t restart);
+    void emitBranch(size_t rel32, size_t target);
+    void emitExit(size_t rel32, uint32_t resume) { exits.push_back(std::make_pair(rel32, resume)); }
+    void emitArithmetic(OpCode op, Type lhs, Type rhs, size_t restart);
+    void emitComparison(OpCode op, Type lhs, Type rhs);
+    void emitStore(uint32_t slot, Type type);
+    void emitConversion(Type to);
+    int32_t slotPayload(uint32_t slot) const { return static_cast<int32_t>(slot * sizeof(Value)) + payload_offset; }
+    int32_t slotType(uint32_t slot) const { return static_cast<int32_t>(slot * sizeof(Value)) + type_offset; }
+};
+
+size_t RegionCompiler::jumpTarget(size_t offset) const {
+    OpCode op = static_cast<OpCode>(code[offset]);
+    uint32_t distance = readLong(code + offset + 1);
+    return op == OpCode::LOOP ? offset + 5 - distance : offset + 5 + distance;
+}
+
+bool RegionCompiler::constantType(size_t index, Type& type) const {
+    const Value& value = chunk.constants[index];
+    type = static_cast<Type>(value.type);
+    return isScalar(type);
+}
+
+// Marks instruction boundaries and touched locals; rejects unsupported code.
+bool RegionCompiler::decode() {
+    size_t offset = start;
+    while (offset < end) {
+        OpCode op = genericOp(static_cast<OpCode>(code[offset]));
+        size_t length = instructionLength(op);
+        if (length == 0 || offset + length > end) {
+            return false;
+        }
+        is_instruction[offset - start] = true;
+        if (op == OpCode::GET_LOCAL || op == OpCode::SET_LOCAL || op == OpCode::DECLARE_LOCAL || op == OpCode::UPDATE_LOCAL) {
+            uint32_t slot = readLong(code + offset + 1);
+            ValueType entry = slot < slot_count ? entry_slots[slot].type : ValueType::NONE;
+            if (slot >= slot_count || entry == ValueType::STRING || entry == ValueType::ARRAY || entry == ValueType::CHANNEL) {
+                return false; // a counted value would be overwritten without being released
+            }
+            touched[slot] = true;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+bool RegionCompiler::flowTo(size_t target, const State& state) {
+    if (target == end) {
+        return state.stack.empty();
+    }
+    if (target < start || target > end || !is_instruction[target - start]) {
+        return false;
+    }
+    State& existing = states[target - start];
+    if (!existing.reached) {
+        existing = state;
+        existing.reached = true;
+        worklist.push_back(target);
+        return true;
+    }
+    if (existing.stack != state.stack) {
+        return false;
+    }
+    bool changed = false;
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (existing.slots[i] != state.slots[i] && existing.slots[i] != UNKNOWN) {
+            existing.slots[i] = UNKNOWN;
+            changed = true;
+        }
+    }
+    if (changed) {
+        worklist.push_back(target);
+    }
+    return true;
+}
+
+// Applies one instruction to its entry state and propagates the result.
+bool RegionCompiler::step(size_t offset) {
+    State state = states[offset - start];
+    OpCode op = genericOp(static_cast<OpCode>(code[offset]));
+    size_t next = offset + instructionLength(op);
+    const uint8_t* operands = code + offset + 1;
+
+    auto pop = [&state](Type& type) {
+        if (state.stack.empty()) return false;
+        type = state.stack.back();
+        state.stack.pop_back();
+        return true;
+    };
+
+    Type value, lhs, rhs;
+    switch (op) {
+        case OpCode::CONSTANT:
+        case OpCode::CONSTANT_LONG: {
+            size_t index = op == OpCode::CONSTANT ? readShort(operands) : readLong(operands);
+            if (!constantType(index, value)) return false;
+            state.stack.push_back(value);
+            return flowTo(next, state);
+        }
+        case OpCode::GET_LOCAL:
+            value = state.slots[readLong(operands)];
+            if (!isScalar(value)) return false;
+            state.stack.push_back(value);
+            return flowTo(next, state);
+        case OpCode::SET_LOCAL:
+            if (!pop(value)) return false;
+            state.slots[readLong(operands)] = value;
+            return flowTo(next, state);
+        case OpCode::DECLARE_LOCAL:
+            if (!pop(value)) return false;
+            value = declaredType(static_cast<TokenType>(operands[4]), value);
+            if (value == UNKNOWN) return false;
+            state.slots[readLong(operands)] = value;
+            return flowTo(next, state);
+        case OpCode::UPDATE_LOCAL: {
+            uint32_t slot = readLong(operands);
+            if (!pop(rhs)) return false;
+            value = binaryType(arithmeticFor(static_cast<TokenType>(operands[4])), state.slots[slot], rhs);
+            if (value == UNKNOWN) return false;
+            state.slots[slot] = value;
+            return flowTo(next, state);
+        }
+        case OpCode::ADD:
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+            if (!pop(rhs) || !pop(lhs)) return false;
+            value = binaryType(op, lhs, rhs);
+            if (value == UNKNOWN) return false;
+            state.stack.push_back(value);
+            return flowTo(next, state);
+        case OpCode::NUM_TO_FLOAT:
+            if (!pop(value) || value != NUMBER) return false;
+            state.stack.push_back(FLOAT);
+            return flowTo(next, state);
+        case OpCode::FLOAT_TO_NUM:
+            if (!pop(value) || value != FLOAT) return false;
+            state.stack.push_back(NUMBER);
+            return flowTo(next, state);
+        case OpCode::POP:
+            return pop(value) && flowTo(next, state);
+        case OpCode::JUMP:
+        case OpCode::LOOP:
+            return flowTo(jumpTarget(offset), state);
+        case OpCode::JUMP_IF_FALSE:
+            if (!pop(value) || !isScalar(value)) return false;
+            if (value == FLOAT) {
+                return flowTo(jumpTarget(offset), state); // floats are never truthy
+            }
+            return flowTo(next, state) && flowTo(jumpTarget(offset), state);
+        case OpCode::LOOP_IF_FALSE:
+            if (!pop(value) || (value != NUMBER && value != BOOLEAN)) return false;
+            return flowTo(next, state) && flowTo(jumpTarget(offset), state);
+        case OpCode::RETURN:
+            return pop(value) && isScalar(value) && state.stack.empty();
+        case OpCode::RETURN_NONE:
+            return state.stack.empty();
+        default:
+            return false;
+    }
+}
+
+bool RegionCompiler::analyze() {
+    State entry;
+    entry.reached = true;
+    entry.slots.resize(slot_count, UNKNOWN);
+    for (size_t i = 0; i < slot_count; ++i) {
+        Type type = static_cast<Type>(entry_slots[i].type);
+        if (touched[i] && isScalar(type)) {
+            entry.slots[i] = type;
+        }
+    }
+    states[0] = entry;
+    worklist.push_back(start);
+    while (!worklist.empty()) {
+        size_t offset = worklist.back();
+        worklist.pop_back();
+        if (!step(offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RegionCompiler::emitBranch(size_t rel32, size_t target) {
+    if (target == end) {
+        emitExit(rel32, static_cast<uint32_t>(end));
+    } else {
+        fixups.push_back(std::make_pair(rel32, target));
+    }
+}
+
+// eax = lhs, ecx = rhs; leaves the result in eax.
+void RegionCompiler::emitArithmetic(OpCode op, Type lhs, Type rhs, size_t restart) {
+    if (lhs == NUMBER && rhs == NUMBER) {
+        switch (op) {
+            case OpCode::ADD: as.emit({ 0x01, 0xc8 }); break;             // add eax, ecx
+            case OpCode::SUBTRACT: as.emit({ 0x29, 0xc8 }); break;        // sub eax, ecx
+            case OpCode::MULTIPLY: as.emit({ 0x0f, 0xaf, 0xc1 }); break;  // imul eax, ecx
+            default:
+                as.emit({ 0x85, 0xc9 });                                   // test ecx, ecx
+                emitExit(as.jumpIf(CC_E), static_cast<uint32_t>(restart)); // Division by zero.
+                // INT_MIN / -1 traps in idiv; the VM wraps it
+                as.emit({ 0x83, 0xf9, 0xff });                             // cmp ecx, -1
+                as.emit({ 0x75, 0x0b });                                   // jne over the exit
+                as.emit({ 0x3d, 0x00, 0x00, 0x00, 0x80 });                 // cmp eax, INT_MIN
+                emitExit(as.jumpIf(CC_E), static_cast<uint32_t>(restart));
+                as.emit({ 0x99, 0xf7, 0xf9 });                             // cdq; idiv ecx
+                break;
+        }
+        return;
+    }
+    as.toXmm(0, EAX, lhs == NUMBER);
+    as.toXmm(1, ECX, rhs == NUMBER);
+    uint8_t instruction;
+    switch (op) {
+        case OpCode::ADD: instruction = 0x58; break;
+        case OpCode::SUBTRACT: instruction = 0x5c; break;
+        case OpCode::MULTIPLY: instruction = 0x59; break;
+        default:
+            as.emit({ 0x0f, 0x57, 0xd2 });         // xorps xmm2, xmm2
+            as.emit({ 0x0f, 0x2e, 0xca });         // ucomiss xmm1, xmm2
+            as.emit({ 0x7a, 0x06 });               // jp over the exit: NaN is not zero
+            emitExit(as.jumpIf(CC_E), static_cast<uint32_t>(restart));
+            instruction = 0x5e;
+            break;
+    }
+    as.emit({ 0xf3, 0x0f, instruction, 0xc1 });    // op xmm0, xmm1
+    as.movdEaxXmm0();
+}
+
+// eax = lhs, ecx = rhs; leaves 0 or 1 in eax.
+void RegionCompiler::emitComparison(OpCode op, Type lhs, Type rhs) {
+    if (lhs == NUMBER && rhs == NUMBER) {
+        static const Condition conditions[] = { CC_E, CC_NE, CC_G, CC_GE, CC_L, CC_LE };
+        as.emit({ 0x39, 0xc8 }); // cmp eax, ecx
+        as.setccAl(conditions[static_cast<int>(op) - static_cast<int>(OpCode::EQUAL)]);
+        as.movzxEaxAl();
+        return;
+    }
+    as.toXmm(0, EAX, lhs == NUMBER);
+    as.toXmm(1, ECX, rhs == NUMBER);
+    // Unordered (NaN) operands compare false except for !=
+    switch (op) {
+        case OpCode::EQUAL:
+            as.emit({ 0x0f, 0x2e, 0xc1 }); // ucomiss xmm0, xmm1
+            as.setccAl(CC_E);
+            as.setccCl(CC_NP);
+            as.emit({ 0x20, 0xc8 });       // and al, cl
+            break;
+        case OpCode::NOT_EQUAL:
+            as.emit({ 0x0f, 0x2e, 0xc1 });
+            as.setccAl(CC_NE);
+            as.setccCl(CC_P);
+            as.emit({ 0x08, 0xc8 });       // or al, cl
+            break;
+        case OpCode::GREATER:
+            as.emit({ 0x0f, 0x2e, 0xc1 });
+            as.setccAl(CC_A);
+            break;
+        case OpCode::GREATER_EQUAL:
+            as.emit({ 0x0f, 0x2e, 0xc1 });
+            as.setccAl(CC_AE);
+            break;
+        case OpCode::LESS:
+            as.emit({ 0x0f, 0x2e, 0xc8 }); // ucomiss xmm1, xmm0
+            as.setccAl(CC_A);
+            break;
+        default:
+            as.emit({ 0x0f, 0x2e, 0xc8 });
+            as.setccAl(CC_AE);
+            break;
+    }
+    as.movzxEaxAl();
+}
+
+// Converts the number or float in eax to the other one.
+void RegionCompiler::emitConversion(Type to) {
+    if (to == NUMBER) {
+        as.toXmm(0, EAX, false);
+        as.emit({ 0xf3, 0x0f, 0x2c, 0xc0 }); // cvttss2si eax, xmm0
+    } else {
+        as.toXmm(0, EAX, true);
+        as.movdEaxXmm0();
+    }
+}
+
+// Stores eax into a local, tag included, since the local's type may change.
+void RegionCompiler::emitStore(uint32_t slot, Type type) {
+    as.storeEax(slotPayload(slot), type == BOOLEAN);
+    as.storeByte(slotType(slot), type);
+}
+
+void RegionCompiler::emitInstruction(size_t offset, size_t restart) {
+    const State& state = states[offset - start];
+    OpCode op = genericOp(static_cast<OpCode>(code[offset]));
+    const uint8_t* operands = code + offset + 1;
+    Type top = state.stack.empty() ? UNKNOWN : state.stack.back();
+    Type below = state.stack.size() < 2 ? UNKNOWN : state.stack[state.stack.size() - 2];
+
+    switch (op) {
+        case OpCode::CONSTANT:
+        case OpCode::CONSTANT_LONG: {
+            const Value& value = chunk.constants[op == OpCode::CONSTANT ? readShort(operands) : readLong(operands)];
+            int32_t bits = 0;
+            if (value.type == ValueType::BOOLEAN) bits = value.b_value ? 1 : 0;
+            else std::memcpy(&bits, &value.i_value, 4);
+            as.movEaxImm(bits);
+            as.pushRax();
+            break;
+        }
+        case OpCode::GET_LOCAL: {
+            uint32_t slot = readLong(operands);
+            as.load(EAX, slotPayload(slot), state.slots[slot] == BOOLEAN);
+            as.pushRax();
+            break;
+        }
+        case OpCode::SET_LOCAL:
+            as.popRax();
+            emitStore(readLong(operands), top);
+            break;
+        case OpCode::DECLARE_LOCAL: {
+            Type declared = declaredType(static_cast<TokenType>(operands[4]), top);
+            as.popRax();
+            if (top != declared) {
+                emitConversion(declared);
+            }
+            emitStore(readLong(operands), declared);
+            break;
+        }
+        case OpCode::NUM_TO_FLOAT:
+        case OpCode::FLOAT_TO_NUM:
+            as.popRax();
+            emitConversion(op == OpCode::NUM_TO_FLOAT ? FLOAT : NUMBER);
+            as.pushRax();
+            break;
+        case OpCode::UPDATE_LOCAL: {
+            uint32_t slot = readLong(operands);
+            OpCode arithmetic = arithmeticFor(static_cast<TokenType>(operands[4]));
+            Type target = state.slots[slot];
+            as.popRcx();
+            as.load(EAX, slotPayload(slot), false);
+            emitArithmetic(arithmetic, target, top, restart);
+            emitStore(slot, binaryType(arithmetic, target, top));
+            break;
+        }
+        case OpCode::ADD:
+        case OpCode::SUBTRACT:
+        case OpCode::MULTIPLY:
+        case OpCode::DIVIDE:
+            as.popRcx();
+            as.popRax();
+            emitArithmetic(op, below, top, restart);
+            as.pushRax();
+            break;
+        case OpCode::EQUAL:
+        case OpCode::NOT_EQUAL:
+        case OpCode::GREATER:
+        case OpCode::GREATER_EQUAL:
+        case OpCode::LESS:
+        case OpCode::LESS_EQUAL:
+            as.popRcx();
+            as.popRax();
+            emitComparison(op, below, top);
+            as.pushRax();
+            break;
+        case OpCode::POP:
+            as.popRax();
+            break;
+        case OpCode::JUMP:
+        case OpCode::LOOP:
+            emitBranch(as.jump(), jumpTarget(offset));
+            break;
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::LOOP_IF_FALSE:
+            as.popRax();
+            if (top == FLOAT) {
+                emitBranch(as.jump(), jumpTarget(offset));
+            } else {
+                as.emit({ 0x85, 0xc0 }); // test eax, eax
+                emitBranch(as.jumpIf(CC_E), jumpTarget(offset));
+            }
+            break;
+        case OpCode::RETURN:
+            as.popRax();
+            as.storeResultEax(static_cast<int8_t>(payload_offset), top == BOOLEAN);
+            as.storeResultByte(static_cast<int8_t>(type_offset), top);
+            emitExit(as.jump(), static_cast<uint32_t>(offset));
+            break;
+        case OpCode::RETURN_NONE:
+            emitExit(as.jump(), static_cast<uint32_t>(offset));
+            break;
+        default:
+            break;
+    }
+}
+
+void RegionCompiler::generate() {
+    as.emit({ 0x55 });             // push rbp
+    as.emit({ 0x48, 0x89, 0xe5 }); // mov rbp, rsp
+    as.emit({ 0x53 });             // push rbx
+    as.emit({ 0x41, 0x54 });       // push r12
+    as.emit({ 0x48, 0x89, 0xfb }); // mov rbx, rdi (locals)
+    as.emit({ 0x49, 0x89, 0xf4 }); // mov r12, rsi (result)
+
+    labels.assign(end - start, 0);
+    size_t restart = start; // last instruction entered with an empty operand stack
+    for (size_t offset = start; offset < end; offset += instructionLength(static_cast<OpCode>(code[offset]))) {
+        labels[offset - start] = as.code.size();
+        const State& state = states[offset - start];
+        if (!state.reached) {
+            continue;
+        }
+        if (state.stack.empty()) {
+            restart = offset;
+        }
+        emitInstruction(offset, restart);
+    }
+    emitExit(as.jump(), static_cast<uint32_t>(end));
+
+    for (const auto& fixup : fixups) {
+        as.patch(fixup.first, labels[fixup.second - start]);
+    }
+
+    // Exit stubs load the resume offset and share the epilogue
+    std::vector<size_t> epilogue_jumps;
+    for (const auto& exit : exits) {
+        as.patch(exit.first, as.code.size());
+        as.movEaxImm(static_cast<int32_t>(exit.second));
+        epilogue_jumps.push_back(as.jump());
+    }
+    for (size_t rel32 : epilogue_jumps) {
+        as.patch(rel32, as.code.size());
+    }
+    as.emit({ 0x48, 0x8d, 0x65, 0xf0 }); // lea rsp, [rbp - 16]
+    as.emit({ 0x41, 0x5c });             // pop r12
+    as.emit({ 0x5b });                   // pop rbx
+    as.emit({ 0x5d });                   // pop rbp
+    as.emit({ 0xc3 });                   // ret
+}
+
+std::unique_ptr<NativeCode> RegionCompiler::compile() {
+    // Locals are addressed by a 32-bit displacement from rbx
+    if (slot_count > std::numeric_limits<int32_t>::max() / sizeof(Value)) {
+        return nullptr;
+    }
+    if (start >= end || !decode() || !analyze()) {
+        return nullptr;
+    }
+    generate();
+
+    size_t size = as.code.size();
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, as.code.data(), size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+
+    // Locals that entered as UNKNOWN are never read before being written, so
+    // only their old value must not need releasing
+    std::vector<std::pair<uint32_t, ValueType>> guards;
+    std::vector<uint32_t> overwritten;
+    for (size_t i = 0; i < slot_count; ++i) {
+        if (!touched[i]) continue;
+        if (states[0].slots[i] == UNKNOWN) {
+            overwritten.push_back(static_cast<uint32_t>(i));
+        } else {
+            guards.push_back(std::make_pair(static_cast<uint32_t>(i), entry_slots[i].type));
+        }
+    }
+    return std::unique_ptr<NativeCode>(new NativeCode(memory, size, std::move(guards), std::move(overwritten)));
+}
+
+} // namespace
+
+std::unique_ptr<NativeCode> compileRegion(const Chunk& chunk, size_t start, size_t end,
+                                          const Value* slots, size_t slot_count) {
+    RegionCompiler compiler(chunk, start, end, slots, slot_count);
+    return compiler.compile();
+}
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+#include "bytecode.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Template JIT for the VM. A region of a chunk (a hot `while` loop or a
+// whole hot function) is translated instruction by instruction into x86-64
+// code in its own executable mapping. Regions may only use locals, `num`,
+// `float` and `bool` constants, arithmetic, comparisons and jumps; anything
+// else (strings, `show`, calls, declarations) leaves the region to the VM.
+//
+// The types of the locals are inferred over the region from their types
+// when it is compiled and checked again on every entry. Native code exits
+// back to the VM with the bytecode offset to resume at:
+//   - the end of the region, or a RETURN/RETURN_NONE inside it (a RETURN
+//     leaves its value in `result`);
+//   - before an operation that would raise, such as division by zero. The
+//     VM resumes at the start of the statement, which has not stored
+//     anything yet, and raises the usual RuntimeError itself.
+class NativeCode {
+public:
+    typedef uint32_t (*Entry)(Value* slots, Value* result);
+
+    NativeCode(void* memory, size_t size, std::vector<std::pair<uint32_t, ValueType>> guards,
+               std::vector<uint32_t> overwritten);
+    ~NativeCode();
+    NativeCode(const NativeCode&) = delete;
+    NativeCode& operator=(const NativeCode&) = delete;
+
+    // Whether the frame's locals have the types the code was compiled for.
+    bool matches(const Value* slots) const {
+        for (const auto& guard : guards) {
+            if (slots[guard.first].type != guard.second) return false;
+        }
+        for (uint32_t slot : overwritten) {
+            ValueType type = slots[slot].type;
+            if (type == ValueType::STRING || type == ValueType::ARRAY || type == ValueType::CHANNEL) return false;
+        }
+        return true;
+    }
+
+    uint32_t run(Value* slots, Value* result) const { return entry(slots, result); }
+
+private:
+    void* memory;
+    size_t size;
+    Entry entry;
+    std::vector<std::pair<uint32_t, ValueType>> guards; // locals the region may read on entry
+    std::vector<uint32_t> overwritten; // locals it only writes before reading; never strings or arrays
+};
+
+// Loops and functions become hot after this many iterations or calls.
+const uint32_t JIT_THRESHOLD = 1000;
+
+// False on platforms without the x86-64 emitter; the VM then never compiles.
+bool jitSupported();
+
+// Compiles chunk.code[start, end) for a frame whose locals are `slots`.
+// Returns null when the region uses anything the JIT does not handle.
+std::unique_ptr<NativeCode> compileRegion(const Chunk& chunk, size_t start, size_t end,
+                                          const Value* slots, size_t slot_count);
@@ -1,25 +1,38 @@
 #include "lexer.hpp"
+#include "error.hpp"
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
-Lexer::Lexer(const std::string& src) : source(src) {}
+Lexer::Lexer(const char* source, size_t length) : source(source), length(length) {}
+
+Lexer::Lexer(const std::string& src) : source(src.data()), length(src.size()) {}
 
 char Lexer::peek() const {
-    if (pos >= source.size()) return '\0';
+    if (pos >= length) return '\0';
     return source[pos];
 }
 
 char Lexer::advance() {
-    if (pos < source.size()) return source[pos++];
+    if (pos < length) {
+        char c = source[pos++];
+        if (c == '\n') {
+            line++;
+            line_start = pos;
+        }
+        return c;
+    }
     return '\0';
 }
 
 char Lexer::peekNext() const {
-    if (pos + 1 >= source.size()) return '\0';
+    if (pos + 1 >= length) return '\0';
     return source[pos + 1];
 }
 
 void Lexer::skipWhitespace() {
-    while (std::isspace(peek())) advance();
+    while (std::isspace(static_cast<unsigned char>(peek()))) advance();
 }
 
 void Lexer::skipComment() {
@@ -31,175 +44,254 @@ void Lexer::skipComment() {
     }
 }
 
+// Builds a token spanning [start, end), positioned at `start` on the current line.
+Token Lexer::makeToken(TokenType type, size_t start, size_t end) const {
+    Token token;
+    token.type = type;
+    token.start = source + start;
+    token.length = static_cast<uint32_t>(end - start);
+    token.line = line;
+    token.column = static_cast<uint32_t>(start - line_start + 1);
+    token.is_float = false;
+    token.int_value = 0;
+    return token;
+}
+
 Token Lexer::readString() {
+    uint32_t start_line = line;
+    size_t start_column = pos - line_start + 1;
     advance(); // skip opening quote
-    std::string value;
+    size_t start = pos;
     while (peek() != '"' && peek() != '\0') {
-        value += advance();
+        advance();
     }
+    Token token = makeToken(TokenType::STRING, start, pos);
+    token.line = start_line; // strings may span lines
+    token.column = static_cast<uint32_t>(start_column);
     advance(); // skip closing quote
-    return { TokenType::STRING, value };
+    return token;
+}
+
+// Keywords are classified by length and first character before comparing
+// the remaining bytes, so most identifiers are rejected after one switch.
+static TokenType classifyWord(const char* word, size_t length) {
+#define NOVA_KEYWORD(text, type) \
+    if (std::memcmp(word, text, length) == 0) return type
+    switch (length) {
+        case 2:
+            if (word[0] == 'i') { NOVA_KEYWORD("if", TokenType::KEYWORD_IF); }
+            break;
+        case 3:
+            switch (word[0]) {
+                case 'n': NOVA_KEYWORD("num", TokenType::KEYWORD_NUM); break;
+                case 'f': NOVA_KEYWORD("fun", TokenType::KEYWORD_FUN); break;
+                case 'e': NOVA_KEYWORD("end", TokenType::KEYWORD_END); break;
+            }
+            break;
+        case 4:
+            switch (word[0]) {
+                case 's': NOVA_KEYWORD("show", TokenType::SHOW); break;
+                case 'b': NOVA_KEYWORD("bool", TokenType::KEYWORD_BOOL); break;
+                case 'c': NOVA_KEYWORD("char", TokenType::KEYWORD_CHAR); break;
+                case 't': NOVA_KEYWORD("true", TokenType::KEYWORD_TRUE); break;
+                case 'e': NOVA_KEYWORD("else", TokenType::KEYWORD_ELSE); break;
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'f':
+                    NOVA_KEYWORD("float", TokenType::KEYWORD_FLOAT);
+                    NOVA_KEYWORD("false", TokenType::KEYWORD_FALSE);
+                    break;
+                case 'w': NOVA_KEYWORD("while", TokenType::KEYWORD_WHILE); break;
+                case 's':
+                    NOVA_KEYWORD("start", TokenType::KEYWORD_START);
+                    NOVA_KEYWORD("spawn", TokenType::KEYWORD_SPAWN);
+                    break;
+            }
+            break;
+        case 6:
+            switch (word[0]) {
+                case 's': NOVA_KEYWORD("string", TokenType::KEYWORD_STRING); break;
+                case 'r': NOVA_KEYWORD("return", TokenType::KEYWORD_RETURN); break;
+            }
+            break;
+        case 7:
+            if (word[0] == 'c') { NOVA_KEYWORD("channel", TokenType::KEYWORD_CHANNEL); }
+            break;
+        case 8:
+            if (word[0] == 'p') { NOVA_KEYWORD("parallel", TokenType::KEYWORD_PARALLEL); }
+            break;
+    }
+#undef NOVA_KEYWORD
+    return TokenType::IDENTIFIER;
 }
 
 Token Lexer::readIdentifierOrKeyword() {
-    std::string value;
-    while (std::isalnum(peek()) || peek() == '_') {
-        value += advance();
+    size_t start = pos;
+    while (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_') {
+        advance();
     }
-    if (value == "show")
-        return { TokenType::SHOW, value };
-    if (value == "num")
-        return { TokenType::KEYWORD_NUM, value };
-    if (value == "string")
-        return { TokenType::KEYWORD_STRING, value };
-    if (value == "bool")
-        return { TokenType::KEYWORD_BOOL, value };
-    if (value == "float")
-        return { TokenType::KEYWORD_FLOAT, value };
-    if (value == "char")
-        return { TokenType::KEYWORD_CHAR, value };
-    if (value == "true")
-        return { TokenType::KEYWORD_TRUE, value };
-    if (value == "false")
-        return { TokenType::KEYWORD_FALSE, value };
-    if (value == "if")
-        return { TokenType::KEYWORD_IF, value };
-    if (value == "else")
-        return { TokenType::KEYWORD_ELSE, value };
-    if (value == "while")
-        return { TokenType::KEYWORD_WHILE, value };
-    if (value == "fun")
-        return { TokenType::KEYWORD_FUN, value };
-    if (value == "return")
-        return { TokenType::KEYWORD_RETURN, value };
-    if (value == "start")
-        return { TokenType::KEYWORD_START, value };
-    if (value == "end")
-        return { TokenType::KEYWORD_END, value };
-    return { TokenType::IDENTIFIER, value };
+    return makeToken(classifyWord(source + start, pos - start), start, pos);
 }
 
 Token Lexer::readNumber() {
-    std::string value;
-    while (std::isdigit(peek())) {
-        value += advance();
+    size_t start = pos;
+    long long integer = 0;
+    bool overflow = false;
+    while (std::isdigit(static_cast<unsigned char>(peek()))) {
+        integer = integer * 10 + (advance() - '0');
+        if (integer > std::numeric_limits<int>::max()) {
+            overflow = true;
+            integer = 0;
+        }
     }
+
+    bool is_float = false;
     if (peek() == '.') {
-        value += advance(); // consume '.'
-        while (std::isdigit(peek())) {
-            value += advance();
+        is_float = true;
+        advance(); // consume '.'
+        while (std::isdigit(static_cast<unsigned char>(peek()))) {
+            advance();
         }
     }
-    return { TokenType::NUMBER, value };
+
+    Token token = makeToken(TokenType::NUMBER, start, pos);
+    token.is_float = is_float;
+    if (is_float) {
+        // The source buffer need not be NUL-terminated, so convert a local copy
+        std::string digits(source + start, pos - start);
+        token.float_value = std::strtof(digits.c_str(), nullptr);
+    } else if (overflow) {
+        throw RuntimeError("Number literal out of range: " + token.text());
+    } else {
+        token.int_value = static_cast<int>(integer);
+    }
+    return token;
 }
 
 Token Lexer::readChar() {
+    size_t start = pos;
     advance(); // skip opening single quote
     char c = advance(); // read the character
     if (peek() != '\'') {
         // Error: expected closing single quote
-        return { TokenType::UNKNOWN, "" };
+        return makeToken(TokenType::UNKNOWN, start, start);
     }
     advance(); // skip closing single quote
-    return { TokenType::CHAR, std::string(1, c) };
+    Token token = makeToken(TokenType::CHAR, start + 1, start + 2);
+    token.char_value = c;
+    return token;
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
+Token Lexer::readOperator() {
+    size_t start = pos;
+    char c = advance();
+    TokenType type = TokenType::UNKNOWN;
+    switch (c) {
+        case '=':
+            type = TokenType::EQUAL;
+            if (peek() == '=') { advance(); type = TokenType::EQUAL_EQUAL; }
+            break;
+        case '<':
+            type = TokenType::LESS;
+            if (peek() == '=') { advance(); type = TokenType::LESS_EQUAL; }
+            break;
+        case '>':
+            type = TokenType::GREATER;
+            if (peek() == '=') { advance(); type = TokenType::GREATER_EQUAL; }
+            break;
+        case '!':
+            if (peek() == '=') { advance(); type = TokenType::NOT_EQUAL; }
+            break;
+        case '+': type = TokenType::PLUS; break;
+        case '-': type = TokenType::MINUS; break;
+        case '*': type = TokenType::STAR; break;
+        case '/': type = TokenType::SLASH; break;
+        case '(': type = TokenType::LEFT_PAREN; break;
+        case ')': type = TokenType::RIGHT_PAREN; break;
+        case '[': type = TokenType::LEFT_BRACKET; break;
+        case ']': type = TokenType::RIGHT_BRACKET; break;
+        case '.': type = TokenType::DOT; break;
+        case ',': type = TokenType::COMMA; break;
+        case ':': type = TokenType::COLON; break;
+    }
+    return makeToken(type, start, pos);
+}
 
-    while (peek() != '\0') {
+Token Lexer::next() {
+    for (;;) {
         skipWhitespace();
         char c = peek();
 
+        if (c == '\0')
+            return makeToken(TokenType::END_OF_FILE, pos, pos);
         if (c == '"')
-            tokens.push_back(readString());
-        else if (std::isalpha(c))
-            tokens.push_back(readIdentifierOrKeyword());
-        else if (std::isdigit(c))
-            tokens.push_back(readNumber());
-        else if (c == '\'')
-            tokens.push_back(readChar());
-        else if (c == '=') {
-            if (peekNext() == '=') {
-                advance(); advance();
-                tokens.push_back({ TokenType::EQUAL_EQUAL, "==" });
-            } else {
-                advance();
-                tokens.push_back({ TokenType::EQUAL, "=" });
-            }
-        }
-        else if (c == '+') {
-            advance();
-            tokens.push_back({ TokenType::PLUS, "+" });
-        }
-        else if (c == '-') {
-            advance();
-            tokens.push_back({ TokenType::MINUS, "-" });
+            return readString();
+        if (std::isalpha(static_cast<unsigned char>(c)))
+            return readIdentifierOrKeyword();
+        if (std::isdigit(static_cast<unsigned char>(c)))
+            return readNumber();
+        if (c == '\'')
+            return readChar();
+        if (c == '/' && peekNext() == '/') {
+            skipComment(); // Continue to the next token after skipping comment
+            continue;
         }
-        else if (c == '*') {
-            advance();
-            tokens.push_back({ TokenType::STAR, "*" });
-        }
-        else if (c == '/') {
-            if (peekNext() == '/') {
-                skipComment();
-                continue; // Continue to the next token after skipping comment
-            } else {
-                advance();
-                tokens.push_back({ TokenType::SLASH, "/" });
+        return readOperator();
+    }
+}
+
+bool Lexer::skipPast(const char* word, size_t word_length) {
+    const char* end = source + length;
+    const char* p = source + pos;
+    auto isWordChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    auto newLine = [&](const char* after) {
+        line++;
+        line_start = static_cast<size_t>(after - source);
+    };
+    while (p < end && *p != '\0') {
+        char c = *p;
+        if (std::isalpha(static_cast<unsigned char>(c))) {
+            const char* start = p;
+            while (p < end && isWordChar(*p)) p++;
+            if (static_cast<size_t>(p - start) == word_length && std::memcmp(start, word, word_length) == 0) {
+                pos = static_cast<size_t>(p - source);
+                return true;
             }
-        }
-        else if (c == '<') {
-            if (peekNext() == '=') {
-                advance(); advance();
-                tokens.push_back({ TokenType::LESS_EQUAL, "<=" });
-            } else {
-                advance();
-                tokens.push_back({ TokenType::LESS, "<" });
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            while (p < end && std::isdigit(static_cast<unsigned char>(*p))) p++;
+            if (p < end && *p == '.') {
+                p++;
+                while (p < end && std::isdigit(static_cast<unsigned char>(*p))) p++;
             }
-        }
-        else if (c == '>') {
-            if (peekNext() == '=') {
-                advance(); advance();
-                tokens.push_back({ TokenType::GREATER_EQUAL, ">=" });
-            } else {
-                advance();
-                tokens.push_back({ TokenType::GREATER, ">" });
+        } else if (c == '"') {
+            // A string runs to its closing quote and may span lines
+            for (p++; p < end && *p != '"' && *p != '\0'; p++) {
+                if (*p == '\n') newLine(p + 1);
             }
-        }
-        else if (c == '!') {
-            if (peekNext() == '=') {
-                advance(); advance();
-                tokens.push_back({ TokenType::NOT_EQUAL, "!=" });
-            } else {
-                advance();
-                tokens.push_back({ TokenType::UNKNOWN, "!" });
+            if (p < end && *p == '"') p++;
+        } else if (c == '\'') {
+            // A char literal is one character, then the closing quote if any
+            for (int i = 0; i < 2 && p < end; ++i) {
+                if (*p++ == '\n') newLine(p);
             }
-        }
-        else if (c == '(') {
-            advance();
-            tokens.push_back({ TokenType::LEFT_PAREN, "(" });
-        }
-        else if (c == ')') {
-            advance();
-            tokens.push_back({ TokenType::RIGHT_PAREN, ")" });
-        }
-        else if (c == ',') {
-            advance();
-            tokens.push_back({ TokenType::COMMA, "," });
-        }
-        else if (c == ':') {
-            advance();
-            tokens.push_back({ TokenType::COLON, ":" });
-        }
-        else if (c == '\0')
-            break;
-        else {
-            advance();
-            tokens.push_back({ TokenType::UNKNOWN, std::string(1, c) });
+            if (p < end && *p == '\'') p++;
+        } else if (c == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n' && *p != '\0') p++;
+        } else {
+            if (c == '\n') newLine(p + 1);
+            p++; // whitespace and operators
         }
     }
+    pos = static_cast<size_t>(p - source);
+    return false;
+}
 
-    tokens.push_back({ TokenType::END_OF_FILE, "" });
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().type != TokenType::END_OF_FILE);
     return tokens;
 }
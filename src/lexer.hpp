@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -38,30 +39,69 @@ enum class TokenType {
     SLASH,
     END_OF_FILE,
     UNKNOWN,
-    CHAR
+    CHAR,
+    LEFT_BRACKET,
+    RIGHT_BRACKET,
+    DOT,
+    KEYWORD_PARALLEL,
+    KEYWORD_SPAWN,
+    KEYWORD_CHANNEL,
+    // Never produced by the Lexer: the Parser folds the annotations `num[]`
+    // and `float[]` into these, used wherever a type keyword can be
+    KEYWORD_NUM_ARRAY,
+    KEYWORD_FLOAT_ARRAY
 };
 
+// A token is a span of the source buffer; nothing is copied out of it.
+// Number, char and keyword tokens carry their decoded value.
 struct Token {
     TokenType type;
-    std::string value;
+    const char* start;  // first character; string tokens exclude the quotes
+    uint32_t length;
+    uint32_t line;      // 1-based
+    uint32_t column;    // 1-based
+    bool is_float;      // NUMBER: literal contains a '.'
+    union {
+        int int_value;      // NUMBER
+        float float_value;  // NUMBER with is_float
+        char char_value;    // CHAR
+    };
+
+    std::string text() const { return std::string(start, length); }
 };
 
+// Tokenizes a source buffer owned by the caller, which must outlive the tokens.
+// Tokens can be pulled one at a time with next() or all at once with tokenize().
 class Lexer {
 public:
+    Lexer(const char* source, size_t length);
     explicit Lexer(const std::string& src);
+    Token next();
     std::vector<Token> tokenize();
+    // Moves past the next identifier or keyword spelled `word`, stepping over
+    // everything before it as next() would but without building tokens.
+    // Returns false at the end of the source.
+    bool skipPast(const char* word, size_t word_length);
+
+    const char* sourceData() const { return source; }
+    size_t sourceLength() const { return length; }
 
 private:
-    std::string source;
+    const char* source;
+    size_t length;
     size_t pos = 0;
+    uint32_t line = 1;
+    size_t line_start = 0;
 
     char peek() const;
     char peekNext() const;
     char advance();
     void skipWhitespace();
+    Token makeToken(TokenType type, size_t start, size_t end) const;
     Token readString();
     Token readIdentifierOrKeyword();
     Token readNumber();
     Token readChar();
+    Token readOperator();
     void skipComment();
 };
@@ -1,29 +1,29 @@
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include "lexer.hpp"
-#include "parser.hpp"
+#include <string>
+#include <vector>
+#include "driver.hpp"
+#include "server.hpp"
 
 int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cout << "Usage: supernova <source-file>\n";
-        return 1;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--serve") {
+        if (args.size() != 2) {
+            printUsage(stdout);
+            return 1;
+        }
+        return serve(args[1]);
+    }
+    if (!args.empty() && args[0] == "--client") {
+        if (args.size() < 3) {
+            printUsage(stdout);
+            return 1;
+        }
+        return runClient(args[1], std::vector<std::string>(args.begin() + 2, args.end()));
     }
 
-    std::ifstream file(argv[1]);
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-
-    Lexer lexer(buffer.str());
-    auto tokens = lexer.tokenize();
-
-    try {
-        Parser parser(tokens);
-        parser.run();
-    } catch (const RuntimeError& e) {
-        std::cerr << "Runtime Error: " << e.what() << std::endl;
+    RunOptions options;
+    if (!parseRunOptions(args, options)) {
+        printUsage(stdout);
         return 1;
     }
-
-    return 0;
+    return runCommand(options, stdout, stderr);
 }
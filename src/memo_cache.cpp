@@ -0,0 +1,154 @@
+#include "memo_cache.hpp"
+#include <cstring>
+#include <functional>
+#include <iterator>
+
+// Bookkeeping of one entry besides its values: list and hash table nodes.
+static const size_t ENTRY_OVERHEAD = 64;
+
+// Elements of an array as raw bytes; nums and floats are both 4 bytes wide.
+static const void* arrayBytes(const ArrayObject& array) {
+    return array.element_type == ValueType::NUMBER ? static_cast<const void*>(array.nums.data())
+                                                   : static_cast<const void*>(array.floats.data());
+}
+
+static size_t hashValue(const Value& value) {
+    size_t payload = 0;
+    switch (value.type) {
+        case ValueType::NUMBER: payload = std::hash<int>()(value.i_value); break;
+        case ValueType::BOOLEAN: payload = value.b_value; break;
+        case ValueType::CHAR: payload = static_cast<unsigned char>(value.c_value); break;
+        case ValueType::STRING: payload = std::hash<std::string>()(value.str()); break;
+        case ValueType::FLOAT: {
+            uint32_t bits;
+            std::memcpy(&bits, &value.f_value, sizeof(bits));
+            payload = bits;
+            break;
+        }
+        case ValueType::ARRAY: {
+            const ArrayObject& array = *value.array_object;
+            const uint8_t* bytes = static_cast<const uint8_t*>(arrayBytes(array));
+            for (size_t i = 0; i < array.size(); ++i) {
+                uint32_t bits;
+                std::memcpy(&bits, bytes + 4 * i, sizeof(bits));
+                payload = payload * 31 + bits;
+            }
+            payload = payload * 31 + static_cast<size_t>(array.element_type);
+            break;
+        }
+        case ValueType::CHANNEL: payload = std::hash<const void*>()(value.channel_object); break;
+        case ValueType::NONE: break;
+    }
+    return payload * 31 + static_cast<size_t>(value.type);
+}
+
+// Floats compare by bit pattern, so every key equals itself.
+static bool sameValue(const Value& a, const Value& b) {
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+        case ValueType::NUMBER: return a.i_value == b.i_value;
+        case ValueType::BOOLEAN: return a.b_value == b.b_value;
+        case ValueType::CHAR: return a.c_value == b.c_value;
+        case ValueType::STRING: return a.string_object == b.string_object || a.str() == b.str();
+        case ValueType::FLOAT: return std::memcmp(&a.f_value, &b.f_value, sizeof(float)) == 0;
+        case ValueType::ARRAY: {
+            const ArrayObject& x = *a.array_object;
+            const ArrayObject& y = *b.array_object;
+            return &x == &y || (x.element_type == y.element_type && x.size() == y.size()
+                                && std::memcmp(arrayBytes(x), arrayBytes(y), 4 * x.size()) == 0);
+        }
+        case ValueType::CHANNEL: return a.channel_object == b.channel_object; // the same channel
+        case ValueType::NONE: return true;
+    }
+    return false;
+}
+
+static size_t valueBytes(const Value& value) {
+    if (value.type == ValueType::ARRAY) {
+        const ArrayObject& array = *value.array_object;
+        return sizeof(Value) + sizeof(ArrayObject) + 4 * (array.nums.capacity() + array.floats.capacity());
+    }
+    return sizeof(Value) + (value.type == ValueType::STRING ? sizeof(StringObject) + value.str().capacity() : 0);
+}
+
+static size_t hashKey(size_t function, const Value* args, size_t count) {
+    size_t hash = function;
+    for (size_t i = 0; i < count; ++i) {
+        hash = hash * 1000003 ^ hashValue(args[i]);
+    }
+    return hash;
+}
+
+MemoCache::MemoCache(size_t max_bytes)
+    : entries(PoolAllocator<Entry>(&pool)),
+      index(0, std::hash<size_t>(), std::equal_to<size_t>(), PoolAllocator<std::pair<const size_t, EntryRef>>(&pool)),
+      max_bytes(max_bytes) {}
+
+bool MemoCache::lookup(size_t function, const Value* args, size_t count, Value& result) {
+    lookups++;
+    size_t hash = hashKey(function, args, count);
+    auto range = index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry& entry = *it->second;
+        if (entry.function != function || entry.args.size() != count) {
+            continue;
+        }
+        size_t i = 0;
+        while (i < count && sameValue(entry.args[i], args[i])) {
+            ++i;
+        }
+        if (i == count) {
+            hits++;
+            entries.splice(entries.begin(), entries, it->second);
+            result = entry.result;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MemoCache::store(size_t function, const Value* args, size_t count, const Value& result) {
+    size_t entry_bytes = ENTRY_OVERHEAD + valueBytes(result);
+    for (size_t i = 0; i < count; ++i) {
+        entry_bytes += valueBytes(args[i]);
+    }
+    if (entry_bytes > max_bytes) {
+        return;
+    }
+    while (bytes + entry_bytes > max_bytes) {
+        evictOldest();
+    }
+
+    entries.emplace_front(&pool);
+    Entry& entry = entries.front();
+    entry.function = function;
+    entry.hash = hashKey(function, args, count);
+    entry.args.assign(args, args + count);
+    entry.result = result;
+    entry.bytes = entry_bytes;
+    index.emplace(entry.hash, entries.begin());
+    bytes += entry_bytes;
+}
+
+void MemoCache::evictOldest() {
+    EntryRef oldest = std::prev(entries.end());
+    auto range = index.equal_range(oldest->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == oldest) {
+            index.erase(it);
+            break;
+        }
+    }
+    bytes -= oldest->bytes;
+    entries.erase(oldest);
+    evictions++;
+}
+
+void MemoCache::printStats(FILE* stream) const {
+    double rate = lookups ? 100.0 * hits / lookups : 0.0;
+    std::fprintf(stream, "Memo: %llu lookups, %llu hits (%.1f%%), %llu evictions, %zu entries, %zu KiB\n",
+                 static_cast<unsigned long long>(lookups), static_cast<unsigned long long>(hits), rate,
+                 static_cast<unsigned long long>(evictions), entries.size(), bytes / 1024);
+}
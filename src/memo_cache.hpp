@@ -0,0 +1,55 @@
+#pragma once
+#include "allocators.hpp"
+#include "value.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Results of calls to pure functions, keyed by the function and its
+// arguments in parameter order (after named arguments and defaults are
+// bound). The Resolver decides which functions are pure.
+//
+// Entries are evicted least recently used first once their estimated size
+// exceeds the memory cap. Their nodes and arguments come from a pool, so a
+// full cache reuses the memory of the entries it evicts.
+class MemoCache {
+public:
+    static const size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024;
+
+    explicit MemoCache(size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // Finds the cached result of `function` for args[0..count).
+    bool lookup(size_t function, const Value* args, size_t count, Value& result);
+    void store(size_t function, const Value* args, size_t count, const Value& result);
+
+    // One line: lookups, hit rate, evictions and current size.
+    void printStats(FILE* stream) const;
+
+private:
+    struct Entry {
+        size_t function;
+        std::vector<Value, PoolAllocator<Value>> args;
+        Value result;
+        size_t hash;
+        size_t bytes;
+
+        explicit Entry(SmallObjectPool* pool) : args(PoolAllocator<Value>(pool)) {}
+    };
+    typedef std::list<Entry, PoolAllocator<Entry>> EntryList;
+    typedef EntryList::iterator EntryRef;
+    typedef std::unordered_multimap<size_t, EntryRef, std::hash<size_t>, std::equal_to<size_t>,
+                                    PoolAllocator<std::pair<const size_t, EntryRef>>> EntryIndex;
+
+    SmallObjectPool pool; // outlives the containers below
+    EntryList entries; // most recently used first
+    EntryIndex index;  // by hash of function and arguments
+    size_t max_bytes;
+    size_t bytes = 0;
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t evictions = 0;
+
+    void evictOldest();
+};
@@ -0,0 +1,154 @@
+#include "nova.hpp"
+#include "compiler.hpp"
+#include "lexer.hpp"
+#include "memo_cache.hpp"
+#include "operations.hpp"
+#include "optimizer.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "type_checker.hpp"
+#include "vm.hpp"
+
+// The stages of the pipeline, which the Parser has to be ahead of: its first
+// statement scans the source for the function names the others work with.
+struct SourceCompiler::State {
+    Lexer lexer;
+    Parser parser;
+    StmtPtr next; // parsed, not compiled yet
+    Optimizer optimizer;
+    Resolver resolver;
+    TypeChecker checker;
+    Compiler compiler;
+    size_t released = 0;
+    bool done = false;
+
+    State(const char* data, size_t size, bool profiling, const std::vector<InputDecl>& inputs)
+        : lexer(data, size), parser(lexer), next(firstStatement(parser, inputs)), optimizer(parser.program()),
+          resolver(parser.program()), checker(parser.program()), compiler(parser.program(), profiling) {}
+
+    static StmtPtr firstStatement(Parser& parser, const std::vector<InputDecl>& inputs) {
+        StmtPtr stmt = parser.parseNext();
+        parser.program().inputs = inputs;
+        return stmt;
+    }
+
+    // Each top-level statement is compiled as soon as it is parsed and its
+    // syntax tree released, so only the bytecode is kept in memory
+    void compile(StmtPtr stmt) {
+        Program& program = parser.program();
+        optimizer.optimizeTopLevel(*stmt);
+        resolver.resolveTopLevel(*stmt);
+        checker.checkTopLevel(*stmt);
+        compiler.compileTopLevel(*stmt);
+        // With no node left, the next statement reuses the arena's memory
+        stmt.reset();
+        for (; released < program.functions.size(); ++released) {
+            program.functions[released].reset();
+        }
+    }
+};
+
+SourceCompiler::SourceCompiler(const char* data, size_t size, bool profiling, const std::vector<InputDecl>& inputs)
+    : state(new State(data, size, profiling, inputs)) {}
+
+SourceCompiler::~SourceCompiler() {}
+
+bool SourceCompiler::compileNext() {
+    State& s = *state;
+    if (s.done) return false;
+    try {
+        StmtPtr stmt = s.next ? std::move(s.next) : s.parser.parseNext();
+        while (stmt) {
+            s.compile(std::move(stmt));
+            s.resolver.finish();
+            if (!s.compiler.spawns()) {
+                s.compiler.pause();
+                return true;
+            }
+            stmt = s.parser.parseNext();
+        }
+        s.resolver.finish();
+        s.compiler.end();
+        s.done = true;
+        return false;
+    } catch (...) {
+        error = true;
+        throw;
+    }
+}
+
+const CompiledProgram& SourceCompiler::program() const {
+    return state->compiler.compiled();
+}
+
+CompiledProgram SourceCompiler::finish() {
+    while (compileNext()) {}
+    return state->compiler.finish();
+}
+
+CompiledProgram compileSource(const char* data, size_t size, bool profiling, const std::vector<InputDecl>& inputs) {
+    return SourceCompiler(data, size, profiling, inputs).finish();
+}
+
+NovaProgram::NovaProgram(const std::string& source, const std::vector<InputDecl>& inputs)
+    : program(compileSource(source.data(), source.size(), false, inputs)), input_list(inputs) {}
+
+// Gives every string constant an object of its own. Pushing a constant
+// counts a reference to it, which threads running copies of the same
+// program would otherwise all write to.
+static void copyStrings(Chunk& chunk) {
+    for (Value& constant : chunk.constants) {
+        if (constant.type == ValueType::STRING) {
+            constant = Value(constant.str());
+        }
+    }
+}
+
+NovaContext::NovaContext(const NovaProgram& program, size_t threads)
+    : program(program), code(program.compiled()), memo(new MemoCache()), pool(new ThreadPool(threads)),
+      output(new Output(static_cast<OutputSink*>(nullptr))) {
+    copyStrings(code.script.chunk);
+    for (CompiledFunction& function : code.functions) {
+        copyStrings(function.chunk);
+    }
+    vm.reset(new VM(code, *output));
+    vm->setMemoCache(memo.get());
+    vm->setThreadPool(pool.get());
+}
+
+NovaContext::~NovaContext() {}
+
+void NovaContext::setMaxCallDepth(size_t depth) {
+    vm->setMaxCallDepth(depth);
+}
+
+void NovaContext::setMemoEnabled(bool enabled) {
+    vm->setMemoCache(enabled ? memo.get() : nullptr);
+}
+
+void NovaContext::setJitEnabled(bool enabled) {
+    vm->setJitEnabled(enabled);
+}
+
+void NovaContext::run(const std::vector<Value>& inputs, OutputSink& sink) {
+    const std::vector<InputDecl>& declared = program.inputs();
+    if (inputs.size() != declared.size()) {
+        throw RuntimeError("Error: expected " + std::to_string(declared.size()) + " inputs, got "
+                           + std::to_string(inputs.size()));
+    }
+    values.assign(inputs.begin(), inputs.end());
+    for (size_t i = 0; i < values.size(); ++i) {
+        convertParameter(declared[i].type, values[i]);
+    }
+
+    output->setSink(&sink);
+    try {
+        vm->run(values);
+    } catch (...) {
+        output->setSink(nullptr);
+        throw;
+    }
+    output->setSink(nullptr);
+    values.clear();
+}
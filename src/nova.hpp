@@ -0,0 +1,109 @@
+#pragma once
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "error.hpp"
+#include "output.hpp"
+#include "value.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// libnova: runs Nova scripts inside a C++ program.
+//
+// A NovaProgram is compiled once and never changes, so any number of
+// threads may run it at the same time. Each thread runs it through a
+// NovaContext of its own, which holds everything a run changes: the VM, the
+// memo cache, the parallel loop threads and the output buffer. A context
+// keeps them from one run to the next, along with native code compiled for
+// hot loops and functions, so only its first run pays for them. Nothing is
+// shared between contexts but the program, which they only read, and the
+// library has no global state.
+//
+//     NovaProgram rule(source, { { "price", TokenType::KEYWORD_FLOAT } });
+//     NovaContext context(rule); // one per thread
+//     context.run({ Value(19.5f) }, sink);
+//
+// Errors in the source and at runtime raise RuntimeError.
+
+// Lexes, parses, checks and compiles a whole source file, one top-level
+// statement at a time, with `inputs` declared before it. Raises
+// RuntimeError for errors in the program.
+CompiledProgram compileSource(const char* data, size_t size, bool profiling,
+                              const std::vector<InputDecl>& inputs = std::vector<InputDecl>());
+
+// Compiles a source file like compileSource, but a statement per call, so
+// the script can run as far as it is compiled: while statements are left,
+// program() ends in PAUSE where the next one goes (see VM::resume).
+class SourceCompiler {
+public:
+    SourceCompiler(const char* data, size_t size, bool profiling,
+                   const std::vector<InputDecl>& inputs = std::vector<InputDecl>());
+    ~SourceCompiler();
+    SourceCompiler(const SourceCompiler&) = delete;
+    SourceCompiler& operator=(const SourceCompiler&) = delete;
+
+    // Compiles the next statement, or every statement left once one has
+    // spawned a task, since tasks cannot wait for the rest. Returns false
+    // when nothing is left and program() ends in RETURN_NONE.
+    bool compileNext();
+    const CompiledProgram& program() const;
+    // An error was raised; the program is incomplete.
+    bool failed() const { return error; }
+    // Compiles what is left and hands over the program.
+    CompiledProgram finish();
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+    bool error = false;
+};
+
+class MemoCache;
+class ThreadPool;
+class VM;
+
+class NovaProgram {
+public:
+    // Compiles `source`. The script can read and assign each of `inputs` as
+    // a variable from its first statement on; an input annotated with a
+    // type keyword has that type.
+    explicit NovaProgram(const std::string& source, const std::vector<InputDecl>& inputs = std::vector<InputDecl>());
+
+    const std::vector<InputDecl>& inputs() const { return input_list; }
+    const CompiledProgram& compiled() const { return program; }
+
+private:
+    CompiledProgram program;
+    std::vector<InputDecl> input_list;
+};
+
+// Runs a NovaProgram, which must outlive it, on one thread at a time.
+class NovaContext {
+public:
+    // `threads` run the parallel loops and tasks of the script; 1 runs them
+    // on the calling thread.
+    explicit NovaContext(const NovaProgram& program, size_t threads = 1);
+    ~NovaContext();
+    NovaContext(const NovaContext&) = delete;
+    NovaContext& operator=(const NovaContext&) = delete;
+
+    void setMaxCallDepth(size_t depth);
+    // Results of pure functions are kept across runs unless disabled.
+    void setMemoEnabled(bool enabled);
+    void setJitEnabled(bool enabled);
+
+    // Runs the script once with inputs[i] as the value of the i-th input,
+    // converted like a declaration, and writes what it shows to `sink`.
+    // Output shown before a runtime error is written before it is raised.
+    void run(const std::vector<Value>& inputs, OutputSink& sink);
+
+private:
+    const NovaProgram& program;
+    // A copy whose string constants no other context counts references to
+    CompiledProgram code;
+    std::unique_ptr<MemoCache> memo;
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<Output> output;
+    std::unique_ptr<VM> vm;
+    std::vector<Value> values; // inputs once converted
+};
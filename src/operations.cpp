@@ -0,0 +1,186 @@
+#include "operations.hpp"
+#include "arrays.hpp"
+#include "error.hpp"
+
+static bool isNumeric(const Value& value) {
+    return value.type == ValueType::NUMBER || value.type == ValueType::FLOAT;
+}
+
+// Element-wise arithmetic: an array with an array or a number.
+static bool isArrayArithmetic(const Value& lhs, const Value& rhs) {
+    bool lhs_ok = isNumeric(lhs) || lhs.type == ValueType::ARRAY;
+    bool rhs_ok = isNumeric(rhs) || rhs.type == ValueType::ARRAY;
+    return lhs_ok && rhs_ok && (lhs.type == ValueType::ARRAY || rhs.type == ValueType::ARRAY);
+}
+
+static float asFloat(const Value& value) {
+    return value.type == ValueType::NUMBER ? static_cast<float>(value.i_value) : value.f_value;
+}
+
+static Value multiplicative(TokenType op, const Value& lhs, const Value& rhs) {
+    if (!isNumeric(lhs) || !isNumeric(rhs)) {
+        if (isArrayArithmetic(lhs, rhs)) {
+            return arrayArithmetic(op, lhs, rhs);
+        }
+        throw RuntimeError("Arithmetic operations can only be performed on numbers or floats.");
+    }
+
+    // Promote to float if either operand is float
+    if (lhs.type == ValueType::FLOAT || rhs.type == ValueType::FLOAT) {
+        float f_lhs = asFloat(lhs);
+        float f_rhs = asFloat(rhs);
+        if (op == TokenType::STAR) {
+            return Value(f_lhs * f_rhs);
+        }
+        if (f_rhs == 0.0f) {
+            throw RuntimeError("Division by zero.");
+        }
+        return Value(f_lhs / f_rhs);
+    }
+
+    if (op == TokenType::STAR) {
+        return Value(wrappingMultiply(lhs.i_value, rhs.i_value));
+    }
+    if (rhs.i_value == 0) {
+        throw RuntimeError("Division by zero.");
+    }
+    return Value(wrappingDivide(lhs.i_value, rhs.i_value));
+}
+
+static Value additive(TokenType op, const Value& lhs, const Value& rhs) {
+    if (lhs.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER) {
+        return Value(op == TokenType::PLUS ? wrappingAdd(lhs.i_value, rhs.i_value) : wrappingSubtract(lhs.i_value, rhs.i_value));
+    }
+    if (isNumeric(lhs) && isNumeric(rhs)) {
+        float f_lhs = asFloat(lhs);
+        float f_rhs = asFloat(rhs);
+        return Value(op == TokenType::PLUS ? f_lhs + f_rhs : f_lhs - f_rhs);
+    }
+    if (isArrayArithmetic(lhs, rhs)) {
+        return arrayArithmetic(op, lhs, rhs);
+    }
+    if (op == TokenType::PLUS) {
+        if (lhs.type == ValueType::STRING && rhs.type == ValueType::STRING) {
+            return Value(lhs.str() + rhs.str());
+        }
+        throw RuntimeError("Invalid operands for + operator.");
+    }
+    throw RuntimeError("Invalid operands for - operator.");
+}
+
+static Value comparison(TokenType op, const Value& lhs, const Value& rhs) {
+    if (!isNumeric(lhs) || !isNumeric(rhs)) {
+        throw RuntimeError("Comparison can only be performed on numbers or floats.");
+    }
+
+    if (lhs.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER) {
+        int a = lhs.i_value;
+        int b = rhs.i_value;
+        switch (op) {
+            case TokenType::EQUAL_EQUAL: return Value(a == b);
+            case TokenType::NOT_EQUAL: return Value(a != b);
+            case TokenType::GREATER: return Value(a > b);
+            case TokenType::GREATER_EQUAL: return Value(a >= b);
+            case TokenType::LESS: return Value(a < b);
+            default: return Value(a <= b);
+        }
+    }
+
+    float a = asFloat(lhs);
+    float b = asFloat(rhs);
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: return Value(a == b);
+        case TokenType::NOT_EQUAL: return Value(a != b);
+        case TokenType::GREATER: return Value(a > b);
+        case TokenType::GREATER_EQUAL: return Value(a >= b);
+        case TokenType::LESS: return Value(a < b);
+        default: return Value(a <= b);
+    }
+}
+
+Value applyBinary(TokenType op, const Value& lhs, const Value& rhs) {
+    switch (op) {
+        case TokenType::STAR:
+        case TokenType::SLASH:
+            return multiplicative(op, lhs, rhs);
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+            return additive(op, lhs, rhs);
+        default:
+            return comparison(op, lhs, rhs);
+    }
+}
+
+void applyBinaryInPlace(TokenType op, Value& lhs, const Value& rhs) {
+    if (op == TokenType::PLUS && lhs.type == ValueType::STRING && rhs.type == ValueType::STRING) {
+        concatenate(lhs, rhs);
+        return;
+    }
+    bool arithmetic = op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR || op == TokenType::SLASH;
+    if (arithmetic && lhs.type == ValueType::ARRAY && isArrayArithmetic(lhs, rhs)) {
+        arrayArithmeticInPlace(op, lhs, rhs);
+        return;
+    }
+    lhs = applyBinary(op, lhs, rhs);
+}
+
+void concatenate(Value& lhs, const Value& rhs) {
+    if (lhs.string_object->refs.load(std::memory_order_acquire) == 1) {
+        lhs.string_object->chars += rhs.str();
+    } else {
+        lhs = Value(lhs.str() + rhs.str());
+    }
+}
+
+bool isTruthy(const Value& value) {
+    if (value.type == ValueType::BOOLEAN) {
+        return value.b_value;
+    } else if (value.type == ValueType::NUMBER) {
+        return value.i_value != 0;
+    } else if (value.type == ValueType::STRING) {
+        return !value.str().empty();
+    }
+    return false;
+}
+
+bool loopCondition(const Value& value) {
+    if (value.type != ValueType::BOOLEAN && value.type != ValueType::NUMBER && value.type != ValueType::STRING) {
+        throw RuntimeError("Condition must be a boolean, number, or string.");
+    }
+    return isTruthy(value);
+}
+
+void throwCallDepthExceeded(size_t max_depth) {
+    throw RuntimeError("Maximum call depth of " + std::to_string(max_depth) + " exceeded.");
+}
+
+Value convertForDeclaration(TokenType type, const Value& value) {
+    if (type == TokenType::KEYWORD_NUM) {
+        if (value.type == ValueType::NUMBER) return value;
+        if (value.type == ValueType::FLOAT) return Value(static_cast<int>(value.f_value));
+        throw RuntimeError("Error: cannot convert to num");
+    } else if (type == TokenType::KEYWORD_STRING) {
+        if (value.type == ValueType::STRING) return value;
+        throw RuntimeError("Error: cannot convert to string");
+    } else if (type == TokenType::KEYWORD_BOOL) {
+        if (value.type == ValueType::BOOLEAN) return value;
+        throw RuntimeError("Error: cannot convert to bool");
+    } else if (type == TokenType::KEYWORD_FLOAT) {
+        if (value.type == ValueType::FLOAT) return value;
+        if (value.type == ValueType::NUMBER) return Value(static_cast<float>(value.i_value));
+        throw RuntimeError("Error: cannot convert to float");
+    } else if (type == TokenType::KEYWORD_CHAR) {
+        if (value.type == ValueType::CHAR) return value;
+        throw RuntimeError("Error: cannot convert to char");
+    } else if (type == TokenType::KEYWORD_CHANNEL) {
+        if (value.type == ValueType::CHANNEL) return value;
+        throw RuntimeError("Error: cannot convert to channel");
+    } else if (type == TokenType::KEYWORD_NUM_ARRAY || type == TokenType::KEYWORD_FLOAT_ARRAY) {
+        bool nums = type == TokenType::KEYWORD_NUM_ARRAY;
+        Value converted;
+        if (convertArray(nums ? ValueType::NUMBER : ValueType::FLOAT, value, converted)) return converted;
+        throw RuntimeError(nums ? "Error: cannot convert to num[]" : "Error: cannot convert to float[]");
+    }
+    // For IDENTIFIER type (e.g., custom types), direct assignment for now
+    return value;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "lexer.hpp"
+#include "value.hpp"
+#include <cstdint>
+
+// Runtime semantics of Nova's operators, shared by every execution engine.
+
+// Integer arithmetic wraps around in 32 bits in every engine, as native code
+// does, and INT_MIN / -1 wraps to INT_MIN instead of trapping.
+inline int wrappingAdd(int a, int b) {
+    return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+inline int wrappingSubtract(int a, int b) {
+    return static_cast<int>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+}
+
+inline int wrappingMultiply(int a, int b) {
+    return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+}
+
+// `b` must not be zero.
+inline int wrappingDivide(int a, int b) {
+    return b == -1 ? wrappingSubtract(0, a) : a / b;
+}
+
+// Applies `+ - * /` or a comparison operator to two evaluated operands.
+Value applyBinary(TokenType op, const Value& lhs, const Value& rhs);
+
+// Same as `lhs = applyBinary(op, lhs, rhs)`, but appends to a string that
+// `lhs` owns exclusively instead of copying it, so building a string with
+// repeated `+` is amortized linear. Arrays owned exclusively are likewise
+// updated element-wise where they are.
+void applyBinaryInPlace(TokenType op, Value& lhs, const Value& rhs);
+
+// Truthiness used by `if`: anything that is not a bool, number or string is false.
+bool isTruthy(const Value& value);
+
+// Truthiness used by `while`, which rejects floats, chars and missing values.
+bool loopCondition(const Value& value);
+
+// Calls that may be active at once before a run fails with a RuntimeError
+// instead of exhausting memory; tail calls do not count.
+const size_t DEFAULT_MAX_CALL_DEPTH = 1000000;
+
+// Raised when a call would exceed the depth limit.
+void throwCallDepthExceeded(size_t max_depth);
+
+// Converts a value to the declared type of a `name:type = ...` declaration.
+Value convertForDeclaration(TokenType type, const Value& value);
+
+// Appends `rhs` to the string `lhs`, in place when `lhs` owns it exclusively.
+void concatenate(Value& lhs, const Value& rhs);
+
+// Arguments of parameters annotated with a type keyword are converted like
+// declarations when a call starts; other type names leave them as they are.
+inline void convertParameter(TokenType type, Value& value) {
+    ValueType declared;
+    switch (type) {
+        case TokenType::KEYWORD_NUM: declared = ValueType::NUMBER; break;
+        case TokenType::KEYWORD_FLOAT: declared = ValueType::FLOAT; break;
+        case TokenType::KEYWORD_BOOL: declared = ValueType::BOOLEAN; break;
+        case TokenType::KEYWORD_STRING: declared = ValueType::STRING; break;
+        case TokenType::KEYWORD_CHAR: declared = ValueType::CHAR; break;
+        case TokenType::KEYWORD_CHANNEL: declared = ValueType::CHANNEL; break;
+        case TokenType::KEYWORD_NUM_ARRAY:
+        case TokenType::KEYWORD_FLOAT_ARRAY: {
+            ValueType elements = type == TokenType::KEYWORD_NUM_ARRAY ? ValueType::NUMBER : ValueType::FLOAT;
+            if (value.type != ValueType::ARRAY || value.array_object->element_type != elements) {
+                value = convertForDeclaration(type, value);
+            }
+            return;
+        }
+        default: return;
+    }
+    if (value.type != declared) {
+        value = convertForDeclaration(type, value);
+    }
+}
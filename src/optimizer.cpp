@@ -0,0 +1,143 @@
+#include "optimizer.hpp"
+#include "error.hpp"
+#include "operations.hpp"
+#include <algorithm>
+
+Optimizer::Optimizer(Program& program) : program(program) {}
+
+void Optimizer::optimize() {
+    for (auto& stmt : program.statements) {
+        optimizeTopLevel(*stmt);
+    }
+}
+
+void Optimizer::optimizeTopLevel(Stmt& stmt) {
+    optimizeStatement(stmt);
+}
+
+static bool isEmptyBlock(const StmtPtr& stmt) {
+    return stmt->kind == StmtKind::BLOCK && stmt->body.empty();
+}
+
+void Optimizer::optimizeBlock(std::vector<StmtPtr>& body) {
+    for (auto& stmt : body) {
+        optimizeStatement(*stmt);
+    }
+    body.erase(std::remove_if(body.begin(), body.end(), isEmptyBlock), body.end());
+}
+
+void Optimizer::optimizeStatement(Stmt& stmt) {
+    switch (stmt.kind) {
+        case StmtKind::IF:
+            foldExpression(stmt.expr);
+            if (stmt.expr->kind == ExprKind::LITERAL) {
+                if (!isTruthy(stmt.expr->literal)) {
+                    stmt.body.swap(stmt.else_body);
+                }
+                stmt.kind = StmtKind::BLOCK;
+                stmt.expr.reset();
+                stmt.else_body.clear();
+                stmt.has_else = false;
+            }
+            optimizeBlock(stmt.body);
+            if (stmt.has_else) {
+                optimizeBlock(stmt.else_body);
+            }
+            break;
+        case StmtKind::WHILE: {
+            foldExpression(stmt.expr);
+            const Expr& condition = *stmt.expr;
+            // Conditions `while` rejects must still raise when the loop is reached
+            if (condition.kind == ExprKind::LITERAL && condition.literal.type != ValueType::FLOAT
+                && condition.literal.type != ValueType::CHAR && condition.literal.type != ValueType::NONE
+                && !isTruthy(condition.literal)) {
+                stmt.kind = StmtKind::BLOCK;
+                stmt.expr.reset();
+                stmt.body.clear();
+                break;
+            }
+            optimizeBlock(stmt.body);
+            break;
+        }
+        case StmtKind::BLOCK:
+            optimizeBlock(stmt.body);
+            break;
+        case StmtKind::FUN_DECL: {
+            FunctionDecl& function = *program.functions[stmt.function];
+            for (auto& param : function.parameters) {
+                if (param.default_value) {
+                    foldExpression(param.default_value);
+                }
+            }
+            optimizeBlock(function.body);
+            break;
+        }
+        case StmtKind::SHOW:
+        case StmtKind::VAR_DECL:
+        case StmtKind::ASSIGN:
+        case StmtKind::RETURN:
+        case StmtKind::EXPRESSION:
+        case StmtKind::APPEND:
+        case StmtKind::SPAWN:
+            foldExpression(stmt.expr);
+            break;
+        case StmtKind::STORE_INDEX:
+            foldExpression(stmt.index);
+            foldExpression(stmt.expr);
+            break;
+        case StmtKind::PARALLEL:
+            foldExpression(stmt.expr);
+            foldExpression(stmt.index);
+            optimizeBlock(stmt.body);
+            break;
+    }
+}
+
+void Optimizer::foldExpression(ExprPtr& expr) {
+    switch (expr->kind) {
+        case ExprKind::LITERAL:
+        case ExprKind::VARIABLE:
+            break;
+        case ExprKind::BINARY: {
+            foldExpression(expr->lhs);
+            foldExpression(expr->rhs);
+            if (expr->lhs->kind != ExprKind::LITERAL || expr->rhs->kind != ExprKind::LITERAL) {
+                break;
+            }
+            Value result;
+            try {
+                result = applyBinary(expr->op, expr->lhs->literal, expr->rhs->literal);
+            } catch (const RuntimeError&) {
+                break; // raised when the expression actually runs
+            }
+            // The node becomes the literal
+            expr->kind = ExprKind::LITERAL;
+            expr->literal = std::move(result);
+            expr->op = TokenType::UNKNOWN;
+            expr->lhs.reset();
+            expr->rhs.reset();
+            break;
+        }
+        case ExprKind::CALL:
+            for (auto& arg : expr->args) {
+                foldExpression(arg.value);
+            }
+            break;
+        case ExprKind::ARRAY:
+            for (auto& element : expr->elements) {
+                foldExpression(element);
+            }
+            break;
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            // Never folded: the array is only known when it runs
+            foldExpression(expr->lhs);
+            if (expr->rhs) {
+                foldExpression(expr->rhs);
+            }
+            break;
+        case ExprKind::CHANNEL:
+            foldExpression(expr->rhs);
+            break;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "ast.hpp"
+#include <vector>
+
+// Simplifies the syntax tree between parsing and resolution. Binary
+// operators whose operands are both literals are replaced by their result,
+// computed with the same applyBinary() the engines use at runtime, so int to
+// float promotion and string concatenation behave exactly as when the
+// expression runs. Integer arithmetic wraps around rather than overflowing,
+// so folding cannot trap. Operations that would raise, such as division by
+// a constant zero, are left alone and still raise when reached.
+//
+// An `if` or `while` whose condition folds to a literal is replaced by a
+// BLOCK holding the branch that runs, or dropped when nothing runs. The
+// block keeps the branch's scope, so the Resolver sees the same bindings.
+class Optimizer {
+public:
+    explicit Optimizer(Program& program);
+    void optimize();
+
+    // Streaming use: optimize each top-level statement before resolving it.
+    void optimizeTopLevel(Stmt& stmt);
+
+private:
+    Program& program;
+
+    void optimizeBlock(std::vector<StmtPtr>& body);
+    void optimizeStatement(Stmt& stmt);
+    void foldExpression(ExprPtr& expr);
+};
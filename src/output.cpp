@@ -0,0 +1,118 @@
+#include "output.hpp"
+
+// Writes the decimal digits of `value` ending at `end` and returns the first character.
+static char* formatInt(char* end, int value) {
+    unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+    do {
+        *--end = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--end = '-';
+    }
+    return end;
+}
+
+Output::Output(FILE* stream, size_t capacity) : stream(stream), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+
+Output::Output(OutputSink* sink, size_t capacity) : stream(nullptr), sink(sink), capacity(capacity) {
+    buffer.reserve(capacity);
+}
+
+Output::~Output() {
+    flush();
+}
+
+void Output::write(const char* data, size_t length) {
+    if (buffer.size() + length > capacity) {
+        flush();
+        if (length > capacity) {
+            send(data, length);
+            return;
+        }
+    }
+    buffer.append(data, length);
+}
+
+void Output::flush() {
+    if (!buffer.empty()) {
+        send(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    if (stream) {
+        std::fflush(stream);
+    }
+}
+
+void Output::setSink(OutputSink* target) {
+    flush();
+    sink = target;
+}
+
+void Output::send(const char* data, size_t length) {
+    if (sink) {
+        sink->write(data, length);
+    } else if (stream) {
+        std::fwrite(data, 1, length, stream);
+    }
+}
+
+void Output::show(const Value& value) {
+    char digits[32];
+    switch (value.type) {
+        case ValueType::NUMBER: {
+            char* end = digits + sizeof(digits);
+            *--end = '\n';
+            char* first = formatInt(end, value.i_value);
+            write(first, static_cast<size_t>(digits + sizeof(digits) - first));
+            break;
+        }
+        case ValueType::STRING:
+            write(value.str().data(), value.str().size());
+            write("\n", 1);
+            break;
+        case ValueType::BOOLEAN:
+            if (value.b_value) write("true\n", 5);
+            else write("false\n", 6);
+            break;
+        case ValueType::FLOAT: {
+            // Same shortest form as streaming a float with default precision
+            int length = std::snprintf(digits, sizeof(digits), "%g\n", static_cast<double>(value.f_value));
+            write(digits, static_cast<size_t>(length));
+            break;
+        }
+        case ValueType::CHAR:
+            digits[0] = value.c_value;
+            digits[1] = '\n';
+            write(digits, 2);
+            break;
+        case ValueType::ARRAY: {
+            const ArrayObject& array = *value.array_object;
+            std::string text = "[";
+            for (size_t i = 0; i < array.size(); ++i) {
+                if (i > 0) text += ", ";
+                if (array.element_type == ValueType::NUMBER) {
+                    char* end = digits + sizeof(digits);
+                    char* first = formatInt(end, array.nums[i]);
+                    text.append(first, end);
+                } else {
+                    int length = std::snprintf(digits, sizeof(digits), "%g", static_cast<double>(array.floats[i]));
+                    text.append(digits, static_cast<size_t>(length));
+                }
+            }
+            text += "]\n";
+            write(text.data(), text.size());
+            break;
+        }
+        case ValueType::CHANNEL:
+            write("<channel>\n", 10);
+            break;
+        case ValueType::NONE:
+            return;
+    }
+    if (line_buffered) {
+        flush();
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "value.hpp"
+#include <cstdio>
+#include <string>
+
+// Where an Output writes when it is not writing to a FILE, as set by an
+// embedding host. Calls to write() never overlap, though the threads of a
+// program running tasks may take turns making them.
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+    virtual void write(const char* data, size_t length) = 0;
+};
+
+// Destination of `show`. Output is collected in a user-space buffer and
+// written when the buffer fills, on flush() and on destruction, so printing
+// many lines costs one write per buffer instead of one per line. In
+// line-buffered mode every completed `show` is written immediately.
+class Output {
+public:
+    explicit Output(FILE* stream = stdout, size_t capacity = 1 << 16);
+    explicit Output(OutputSink* sink, size_t capacity = 1 << 16);
+    ~Output();
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    void setLineBuffered(bool enabled) { line_buffered = enabled; }
+    // Flushes, then writes to `target` instead.
+    void setSink(OutputSink* target);
+
+    // Writes a value the way `show` prints it, followed by a newline.
+    void show(const Value& value);
+    void write(const char* data, size_t length);
+    void flush();
+
+private:
+    FILE* stream;
+    OutputSink* sink = nullptr; // used instead of `stream` when set
+    std::string buffer;
+    size_t capacity;
+    bool line_buffered = false;
+
+    void send(const char* data, size_t length);
+};
@@ -0,0 +1,200 @@
+#include "parallel.hpp"
+#include "error.hpp"
+#include "operations.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+// Chunks a loop is split into at most: enough for stealing to even out
+// uneven iterations, few enough that starting a chunk stays cheap.
+static const size_t MAX_CHUNKS = 256;
+
+ThreadPool::ThreadPool(size_t workers) {
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; ++i) {
+        queues.emplace_back(new Queue());
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t worker, size_t task)>& task) {
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> job_lock(running);
+    size_t workers = size();
+    if (threads.empty()) {
+        for (size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(&ThreadPool::threadMain, this, i);
+        }
+    }
+    for (size_t w = 0; w < workers; ++w) {
+        std::lock_guard<std::mutex> lock(queues[w]->mutex);
+        for (size_t i = count * w / workers; i < count * (w + 1) / workers; ++i) {
+            queues[w]->tasks.push_back(i);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        busy = threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+    work(0);
+    // The queues are empty now, but other workers may still be running tasks
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::threadMain(size_t worker) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        work(worker);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+            done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::work(size_t worker) {
+    size_t task;
+    while (take(worker, task)) {
+        (*job)(worker, task);
+    }
+}
+
+// No tasks are added while a job runs, so once every queue is empty the
+// worker is done with the job.
+bool ThreadPool::take(size_t worker, size_t& task) {
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isNumeric(const Value& value) {
+    return value.type == ValueType::NUMBER || value.type == ValueType::FLOAT;
+}
+
+void runParallelLoop(ThreadPool* pool, const Value& from, const Value& limit,
+                     const std::vector<Reduction>& reductions, Value* values,
+                     const ChunkRunner& run_chunk) {
+    if (from.type != ValueType::NUMBER || limit.type != ValueType::NUMBER) {
+        throw RuntimeError("The range of a parallel loop must be nums.");
+    }
+    size_t count = reductions.size();
+    for (size_t r = 0; r < count; ++r) {
+        if (!isNumeric(values[r])) {
+            throw RuntimeError("Reduction variables of a parallel loop must hold numbers or floats.");
+        }
+    }
+    if (limit.i_value <= from.i_value) {
+        return;
+    }
+    int64_t first = from.i_value;
+    int64_t iterations = static_cast<int64_t>(limit.i_value) - first;
+    int64_t chunk_size = (iterations + MAX_CHUNKS - 1) / MAX_CHUNKS;
+    size_t chunks = static_cast<size_t>((iterations + chunk_size - 1) / chunk_size);
+
+    // A sum starts from zero in every chunk, a min or max from the value
+    // before the loop
+    std::vector<Value> partials(chunks * count);
+    for (size_t c = 0; c < chunks; ++c) {
+        for (size_t r = 0; r < count; ++r) {
+            Value& partial = partials[c * count + r];
+            if (reductions[r] != Reduction::SUM) {
+                partial = values[r];
+            } else if (values[r].type == ValueType::FLOAT) {
+                partial = Value(0.0f);
+            } else {
+                partial = Value(0);
+            }
+        }
+    }
+
+    // Chunks after one that failed are skipped; only the first error counts
+    std::atomic<size_t> failed(chunks);
+    std::vector<std::exception_ptr> errors(chunks);
+    auto task = [&](size_t worker, size_t c) {
+        if (c > failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        int64_t start = first + static_cast<int64_t>(c) * chunk_size;
+        int64_t stop = std::min<int64_t>(start + chunk_size, limit.i_value);
+        try {
+            run_chunk(worker, static_cast<int>(start), static_cast<int>(stop), partials.data() + c * count);
+        } catch (...) {
+            errors[c] = std::current_exception();
+            size_t lowest = failed.load();
+            while (c < lowest && !failed.compare_exchange_weak(lowest, c)) {
+            }
+        }
+    };
+    if (pool && pool->size() > 1 && chunks > 1) {
+        pool->run(chunks, task);
+    } else {
+        for (size_t c = 0; c < chunks; ++c) {
+            task(0, c);
+        }
+    }
+    if (failed.load() < chunks) {
+        std::rethrow_exception(errors[failed.load()]);
+    }
+
+    for (size_t c = 0; c < chunks; ++c) {
+        for (size_t r = 0; r < count; ++r) {
+            const Value& partial = partials[c * count + r];
+            switch (reductions[r]) {
+                case Reduction::SUM:
+                    values[r] = applyBinary(TokenType::PLUS, values[r], partial);
+                    break;
+                case Reduction::MIN:
+                    if (applyBinary(TokenType::LESS, partial, values[r]).b_value) {
+                        values[r] = partial;
+                    }
+                    break;
+                case Reduction::MAX:
+                    if (applyBinary(TokenType::GREATER, partial, values[r]).b_value) {
+                        values[r] = partial;
+                    }
+                    break;
+            }
+        }
+    }
+}
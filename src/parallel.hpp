@@ -0,0 +1,75 @@
+#pragma once
+#include "ast.hpp"
+#include "value.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runtime of `parallel` loops, shared by the VM and the Interpreter.
+//
+// The iterations are split into chunks whose size depends only on the
+// range, each chunk starts its reductions from scratch, and the partial
+// results are combined in chunk order, so a loop computes the same result
+// with any number of threads.
+
+// Fixed set of threads that run the tasks of one job at a time. The thread
+// calling run() is worker 0 and works too. Each worker starts with a
+// contiguous block of the tasks in its own queue and takes them from the
+// back; a worker whose queue is empty steals from the front of the others'.
+class ThreadPool {
+public:
+    // `workers` counts the caller, so 1 starts no threads. The threads are
+    // started by the first job, so programs without one never pay for them.
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+
+    size_t size() const { return queues.size(); }
+
+    // Calls task(worker, i) for every i in [0, count) and returns once all
+    // calls have finished. Tasks must not throw. Jobs from several threads
+    // run one after another.
+    void run(size_t count, const std::function<void(size_t worker, size_t task)>& task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker
+    std::vector<std::thread> threads;           // workers 1 and up
+    std::mutex running;                         // held for a whole job
+    std::mutex mutex;                           // guards the fields below
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    uint64_t generation = 0; // bumped when a job starts
+    size_t busy = 0;         // threads still working on the job
+    bool stopping = false;
+
+    void threadMain(size_t worker);
+    void work(size_t worker);
+    bool take(size_t worker, size_t& task);
+};
+
+// Runs the iterations [first, last) of one chunk with `partials` as the
+// chunk's values of the reduction variables, updating them in place.
+typedef std::function<void(size_t worker, int first, int last, Value* partials)> ChunkRunner;
+
+// Workers a loop may use, so an engine knows how many states to prepare.
+inline size_t parallelWorkers(ThreadPool* pool) {
+    return pool ? pool->size() : 1;
+}
+
+// Runs `parallel i = from to limit` in chunks on `pool`, or on the calling
+// thread when `pool` is null. `values` holds the variables named by
+// `reductions` and receives the combined results. If iterations fail, the
+// error of the first failing chunk is rethrown once all chunks stopped.
+void runParallelLoop(ThreadPool* pool, const Value& from, const Value& limit,
+                     const std::vector<Reduction>& reductions, Value* values,
+                     const ChunkRunner& run_chunk);
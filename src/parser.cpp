@@ -1,421 +1,470 @@
 #include "parser.hpp"
-#include <iostream>
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens) {
-    enterScope(); // Global scope
+static Token endOfFileToken() {
+    Token token;
+    token.type = TokenType::END_OF_FILE;
+    token.start = "";
+    token.length = 0;
+    token.line = 0;
+    token.column = 0;
+    token.is_float = false;
+    token.int_value = 0;
+    return token;
 }
 
-Token Parser::peek() const {
-    if (pos >= tokens.size()) return { TokenType::END_OF_FILE, "" };
-    return tokens[pos];
-}
+static const Token END_OF_FILE_TOKEN = endOfFileToken();
 
-Token Parser::peekNextToken() const {
-    if (pos + 1 >= tokens.size()) return { TokenType::END_OF_FILE, "" };
-    return tokens[pos + 1];
+static bool isTypeKeyword(TokenType type) {
+    return type == TokenType::KEYWORD_NUM || type == TokenType::KEYWORD_STRING || type == TokenType::KEYWORD_BOOL || type == TokenType::KEYWORD_FLOAT || type == TokenType::KEYWORD_CHAR || type == TokenType::KEYWORD_CHANNEL;
 }
 
-Token Parser::advance() {
-    if (pos < tokens.size()) return tokens[pos++];
-    return { TokenType::END_OF_FILE, "" };
+static bool isComparison(TokenType type) {
+    return type == TokenType::EQUAL_EQUAL || type == TokenType::NOT_EQUAL || type == TokenType::GREATER || type == TokenType::GREATER_EQUAL || type == TokenType::LESS || type == TokenType::LESS_EQUAL;
 }
 
-void Parser::enterScope() {
-    scopes.emplace_back();
-}
-
-void Parser::exitScope() {
-    if (!scopes.empty()) {
-        scopes.pop_back();
+// Name token of a function declaration starting at `tokens`, if there is one.
+static const Token* declaredName(const Token* tokens, size_t count) {
+    if (count < 4 || tokens[0].type != TokenType::KEYWORD_FUN || tokens[1].type != TokenType::COLON) {
+        return nullptr;
     }
+    size_t name = tokens[3].type == TokenType::LEFT_BRACKET ? 5 : 3; // `fun:num[] name`
+    return name < count && tokens[name].type == TokenType::IDENTIFIER ? &tokens[name] : nullptr;
 }
 
-void Parser::setVariable(const std::string& name, const Value& value) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        if (it->count(name)) {
-            (*it)[name] = value;
-            return;
-        }
-    }
-    // If not found in any parent scope, set in current scope
-    if (!scopes.empty()) {
-        scopes.back()[name] = value;
-    }
+ExprPtr Parser::makeExpr(ExprKind kind, const Token& token) {
+    Arena* arena = output.arena.get();
+    ExprPtr expr(arena->make<Expr>(kind), ArenaDeleter<Expr>(arena));
+    expr->line = token.line;
+    return expr;
 }
 
-Value Parser::getVariable(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        if (it->count(name)) {
-            return (*it)[name];
-        }
-    }
-    throw RuntimeError("Undefined variable '" + name + "'");
+StmtPtr Parser::makeStmt(StmtKind kind, const Token& token) {
+    Arena* arena = output.arena.get();
+    StmtPtr stmt(arena->make<Stmt>(kind), ArenaDeleter<Stmt>(arena));
+    stmt->line = token.line;
+    return stmt;
 }
 
-bool Parser::parseCondition() {
-    Value result = parseExpression();
-    if (result.type == ValueType::BOOLEAN) {
-        return result.b_value;
-    } else if (result.type == ValueType::NUMBER) {
-        return result.i_value != 0;
-    } else if (result.type == ValueType::STRING) {
-        return !result.s_value.empty();
-    }
-    throw RuntimeError("Condition must be a boolean, number, or string.");
+ExprPtr Parser::makeBinary(TokenType op, ExprPtr lhs, ExprPtr rhs) {
+    Arena* arena = output.arena.get();
+    ExprPtr expr(arena->make<Expr>(ExprKind::BINARY), ArenaDeleter<Expr>(arena));
+    expr->line = lhs->line;
+    expr->op = op;
+    expr->lhs = std::move(lhs);
+    expr->rhs = std::move(rhs);
+    return expr;
 }
 
-Value Parser::parseFactor() {
+Parser::Parser(const std::vector<Token>& tokens) : tokens(&tokens) {}
 
-    Token token = advance();
-
-    if (token.type == TokenType::NUMBER) {
+Parser::Parser(Lexer& lexer) : lexer(&lexer) {}
 
-        if (token.value.find('.') != std::string::npos) {
+// Pulls the next token from the lexer or the token vector into the lookahead.
+void Parser::fill() {
+    Token& slot = lookahead[lookahead_count++];
+    if (lexer) {
+        slot = lexer->next();
+    } else if (next_index < tokens->size()) {
+        slot = (*tokens)[next_index++];
+    } else {
+        slot = END_OF_FILE_TOKEN;
+    }
+}
 
-            return Value(std::stof(token.value));
+const Token& Parser::peek() {
+    if (lookahead_count < 1) fill();
+    return lookahead[0];
+}
 
-        } else {
+const Token& Parser::peekNextToken() {
+    while (lookahead_count < 2) fill();
+    return lookahead[1];
+}
 
-            return Value(std::stoi(token.value));
+Token Parser::advance() {
+    Token token = peek();
+    if (token.type != TokenType::END_OF_FILE) {
+        lookahead[0] = lookahead[1];
+        lookahead_count--;
+    }
+    return token;
+}
 
+// Function names are collected up front so that a call can be told apart from
+// a variable read even when the callee is declared further down the file
+// (mutual recursion, helpers declared after their first caller). When parsing
+// straight from a lexer this is a separate scan of the source that only
+// builds the tokens following each `fun`.
+void Parser::collectFunctionNames() {
+    const size_t WINDOW = 6; // fun : type [ ] name
+    if (!lexer) {
+        const std::vector<Token>& all = *tokens;
+        for (size_t i = 0; i + 3 < all.size(); ++i) {
+            const Token* name = declaredName(&all[i], std::min(WINDOW, all.size() - i));
+            if (name) {
+                output.function_names.push_back(name->text());
+            }
         }
+        return;
+    }
+
+    Lexer scanner(lexer->sourceData(), lexer->sourceLength());
+    Token window[WINDOW];
+    window[0].type = TokenType::KEYWORD_FUN;
+    while (scanner.skipPast("fun", 3)) {
+        // A copy reads the rest of the window, so the scan goes on right
+        // after this `fun` even if it starts no declaration
+        Lexer rest = scanner;
+        for (size_t i = 1; i < WINDOW; ++i) window[i] = rest.next();
+        const Token* name = declaredName(window, WINDOW);
+        if (name) {
+            output.function_names.push_back(name->text());
+        }
+    }
+}
 
-    } else if (token.type == TokenType::STRING) {
-
-        return Value(token.value);
-
-    } else if (token.type == TokenType::KEYWORD_TRUE) {
-
-        return Value(true);
+// Declarations are numbered in source order, so the scan above also tells
+// every later pass the index each function will get.
+void Parser::start() {
+    collectFunctionNames();
+    function_names.insert(output.function_names.begin(), output.function_names.end());
+    started = true;
+}
 
-    } else if (token.type == TokenType::KEYWORD_FALSE) {
+Program Parser::parse() {
+    while (StmtPtr stmt = parseNext()) {
+        output.statements.push_back(std::move(stmt));
+    }
+    return std::move(output);
+}
 
-        return Value(false);
+StmtPtr Parser::parseNext() {
+    if (!started) start();
+    if (peek().type == TokenType::END_OF_FILE) {
+        return nullptr;
+    }
+    return parseStatement();
+}
 
-        } else if (token.type == TokenType::CHAR) {
+// A type annotation: a type keyword or name, or `num[]` and `float[]`.
+TokenType Parser::parseAnnotation(const char* error) {
+    Token type = advance();
+    if (type.type != TokenType::IDENTIFIER && !isTypeKeyword(type.type)) {
+        throw RuntimeError(std::string("Syntax error: ") + error);
+    }
+    if (peek().type != TokenType::LEFT_BRACKET) {
+        return type.type;
+    }
+    advance(); // consume '['
+    if (advance().type != TokenType::RIGHT_BRACKET) {
+        throw RuntimeError("Syntax error: expected ']' in array type");
+    }
+    if (type.type == TokenType::KEYWORD_NUM) return TokenType::KEYWORD_NUM_ARRAY;
+    if (type.type == TokenType::KEYWORD_FLOAT) return TokenType::KEYWORD_FLOAT_ARRAY;
+    throw RuntimeError("Syntax error: arrays can only hold num or float, not '" + type.text() + "'");
+}
 
-            return Value(token.value[0]);
+ExprPtr Parser::parseArray(const Token& bracket) {
+    ExprPtr array = makeExpr(ExprKind::ARRAY, bracket);
+    if (peek().type != TokenType::RIGHT_BRACKET) {
+        array->elements.push_back(parseExpression());
+        while (peek().type == TokenType::COMMA) {
+            advance(); // consume ','
+            array->elements.push_back(parseExpression());
+        }
+    }
+    if (advance().type != TokenType::RIGHT_BRACKET) {
+        throw RuntimeError("Syntax error: expected ']' after array elements");
+    }
+    return array;
+}
 
-        } else if (token.type == TokenType::IDENTIFIER) {
-            // Check if the identifier is a known function
-            if (functions.count(token.value)) {
-                return handleFunctionCall(token.value);
+// Indexing and methods following a factor: `xs[i]`, `xs.sum`, `xs.dot(ys)`, `c.receive`.
+ExprPtr Parser::parsePostfix(ExprPtr expr) {
+    for (;;) {
+        if (peek().type == TokenType::LEFT_BRACKET) {
+            Token bracket = advance();
+            ExprPtr index = makeExpr(ExprKind::INDEX, bracket);
+            index->line = expr->line;
+            index->lhs = std::move(expr);
+            index->rhs = parseExpression();
+            if (advance().type != TokenType::RIGHT_BRACKET) {
+                throw RuntimeError("Syntax error: expected ']' after index");
             }
-            // Otherwise, it's a variable
-            return getVariable(token.value);
+            expr = std::move(index);
+        } else if (peek().type == TokenType::DOT) {
+            advance(); // consume '.'
+            Token name = advance();
+            std::string text = name.type == TokenType::IDENTIFIER ? name.text() : std::string();
+            ExprPtr method = makeExpr(ExprKind::METHOD, name);
+            method->line = expr->line;
+            method->lhs = std::move(expr);
+            if (text == "length") method->method = Method::LENGTH;
+            else if (text == "sum") method->method = Method::SUM;
+            else if (text == "min") method->method = Method::MIN;
+            else if (text == "max") method->method = Method::MAX;
+            else if (text == "dot") method->method = Method::DOT;
+            else if (text == "append") method->method = Method::APPEND;
+            else if (text == "send") method->method = Method::SEND;
+            else if (text == "receive") method->method = Method::RECEIVE;
+            else throw RuntimeError("Syntax error: unknown method '" + name.text() + "'");
+            if (method->method == Method::DOT || method->method == Method::APPEND || method->method == Method::SEND) {
+                if (advance().type != TokenType::LEFT_PAREN) {
+                    throw RuntimeError("Syntax error: expected '(' after '." + text + "'");
+                }
+                method->rhs = parseExpression();
+                if (advance().type != TokenType::RIGHT_PAREN) {
+                    throw RuntimeError("Syntax error: expected ')' after argument of '." + text + "'");
+                }
+            }
+            if (method->method == Method::APPEND) {
+                pending_appends++; // until parseStatement turns it into a statement
+            } else if (method->method == Method::SEND) {
+                pending_sends++;
+            }
+            expr = std::move(method);
         } else {
+            return expr;
+        }
+    }
+}
 
-            throw RuntimeError("Syntax error: expected number, string, boolean, char, or identifier. Received token type: " + std::to_string(static_cast<int>(token.type)));
+ExprPtr Parser::parseFactor() {
+    return parsePostfix(parsePrimary());
+}
+
+ExprPtr Parser::parsePrimary() {
+    Token token = advance();
 
+    if (token.type == TokenType::NUMBER) {
+        ExprPtr expr = makeExpr(ExprKind::LITERAL, token);
+        if (token.is_float) {
+            expr->literal = Value(token.float_value);
+        } else {
+            expr->literal = Value(token.int_value);
+        }
+        return expr;
+    } else if (token.type == TokenType::STRING) {
+        ExprPtr expr = makeExpr(ExprKind::LITERAL, token);
+        expr->literal = Value(token.text());
+        return expr;
+    } else if (token.type == TokenType::KEYWORD_TRUE || token.type == TokenType::KEYWORD_FALSE) {
+        ExprPtr expr = makeExpr(ExprKind::LITERAL, token);
+        expr->literal = Value(token.type == TokenType::KEYWORD_TRUE);
+        return expr;
+    } else if (token.type == TokenType::CHAR) {
+        ExprPtr expr = makeExpr(ExprKind::LITERAL, token);
+        expr->literal = Value(token.char_value);
+        return expr;
+    } else if (token.type == TokenType::LEFT_BRACKET) {
+        return parseArray(token);
+    } else if (token.type == TokenType::KEYWORD_CHANNEL) {
+        ExprPtr channel = makeExpr(ExprKind::CHANNEL, token);
+        if (advance().type != TokenType::LEFT_PAREN) {
+            throw RuntimeError("Syntax error: expected '(' after 'channel'");
         }
+        channel->rhs = parseExpression();
+        if (advance().type != TokenType::RIGHT_PAREN) {
+            throw RuntimeError("Syntax error: expected ')' after the capacity of a channel");
+        }
+        return channel;
+    } else if (token.type == TokenType::LEFT_PAREN) {
+        ExprPtr expr = parseExpression();
+        if (advance().type != TokenType::RIGHT_PAREN) {
+            throw RuntimeError("Syntax error: expected ')' after expression");
+        }
+        return expr;
+    } else if (token.type == TokenType::IDENTIFIER) {
+        // Check if the identifier is a known function
+        std::string name = token.text();
+        if (function_names.count(name)) {
+            return parseFunctionCall(name, token);
+        }
+        // Otherwise, it's a variable
+        ExprPtr expr = makeExpr(ExprKind::VARIABLE, token);
+        expr->name = std::move(name);
+        return expr;
+    }
+    throw RuntimeError("Syntax error: expected number, string, boolean, char, or identifier. Received token type: " + std::to_string(static_cast<int>(token.type)));
 }
 
-Value Parser::parseTerm() {
-    Value result = parseFactor();
-
+ExprPtr Parser::parseTerm() {
+    ExprPtr result = parseFactor();
     while (peek().type == TokenType::STAR || peek().type == TokenType::SLASH) {
-        Token op = advance();
-        Value rhs = parseFactor();
-
-        if ((result.type != ValueType::NUMBER && result.type != ValueType::FLOAT) || (rhs.type != ValueType::NUMBER && rhs.type != ValueType::FLOAT)) {
-                    throw RuntimeError("Arithmetic operations can only be performed on numbers or floats.");        }
-
-        // Promote to float if either operand is float
-        bool promote_to_float = (result.type == ValueType::FLOAT || rhs.type == ValueType::FLOAT);
-        float f_result = (promote_to_float && result.type == ValueType::NUMBER) ? static_cast<float>(result.i_value) : result.f_value;
-        float f_rhs = (promote_to_float && rhs.type == ValueType::NUMBER) ? static_cast<float>(rhs.i_value) : rhs.f_value;
-
-        if (op.type == TokenType::STAR) {
-            if (promote_to_float) {
-                result = Value(f_result * f_rhs);
-            } else {
-                result.i_value *= rhs.i_value;
-            }
-        } else if (op.type == TokenType::SLASH) {
-            if (promote_to_float) {
-                if (f_rhs == 0.0f) {
-                    throw RuntimeError("Division by zero.");
-                }
-                result = Value(f_result / f_rhs);
-            } else {
-                if (rhs.i_value == 0) {
-                    throw RuntimeError("Division by zero.");
-                }
-                result.i_value /= rhs.i_value;
-            }
-        }
+        TokenType op = advance().type;
+        result = makeBinary(op, std::move(result), parseFactor());
     }
     return result;
 }
 
-Value Parser::parseExpression() {
-    if (peek().type == TokenType::KEYWORD_TRUE || peek().type == TokenType::KEYWORD_FALSE) {
-        return parseFactor();
-    }
-    
-    Value result = parseTerm();
-
-    while (peek().type == TokenType::PLUS || peek().type == TokenType::MINUS || peek().type == TokenType::EQUAL_EQUAL || peek().type == TokenType::NOT_EQUAL || peek().type == TokenType::GREATER || peek().type == TokenType::GREATER_EQUAL || peek().type == TokenType::LESS || peek().type == TokenType::LESS_EQUAL) {
-        Token op = advance();
-        Value rhs = parseTerm();
-
-        if (op.type == TokenType::PLUS) {
-            if (result.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER) {
-                result.i_value += rhs.i_value;
-            } else if (result.type == ValueType::FLOAT && rhs.type == ValueType::FLOAT) {
-                result.f_value += rhs.f_value;
-            } else if (result.type == ValueType::NUMBER && rhs.type == ValueType::FLOAT) {
-                result.f_value = static_cast<float>(result.i_value) + rhs.f_value;
-                result.type = ValueType::FLOAT;
-            } else if (result.type == ValueType::FLOAT && rhs.type == ValueType::NUMBER) {
-                result.f_value += static_cast<float>(rhs.i_value);
-            } else if (result.type == ValueType::STRING && rhs.type == ValueType::STRING) {
-                result.s_value += rhs.s_value;
-            } else {
-                throw RuntimeError("Invalid operands for + operator.");
-            }
-        } else if (op.type == TokenType::MINUS) {
-            if (result.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER) {
-                result.i_value -= rhs.i_value;
-            } else if (result.type == ValueType::FLOAT && rhs.type == ValueType::FLOAT) {
-                result.f_value -= rhs.f_value;
-            } else if (result.type == ValueType::NUMBER && rhs.type == ValueType::FLOAT) {
-                result.f_value = static_cast<float>(result.i_value) - rhs.f_value;
-                result.type = ValueType::FLOAT;
-            } else if (result.type == ValueType::FLOAT && rhs.type == ValueType::NUMBER) {
-                result.f_value -= static_cast<float>(rhs.i_value);
-            } else {
-                throw RuntimeError("Invalid operands for - operator.");
-            }
-        } else { 
-            // Comparison operators
-            if ((result.type != ValueType::NUMBER && result.type != ValueType::FLOAT) || (rhs.type != ValueType::NUMBER && rhs.type != ValueType::FLOAT)) {
-                throw RuntimeError("Comparison can only be performed on numbers or floats.");
-            }
+ExprPtr Parser::parseAdditive() {
+    ExprPtr result = parseTerm();
+    while (peek().type == TokenType::PLUS || peek().type == TokenType::MINUS) {
+        TokenType op = advance().type;
+        result = makeBinary(op, std::move(result), parseTerm());
+    }
+    return result;
+}
 
-            bool promote_to_float = (result.type == ValueType::FLOAT || rhs.type == ValueType::FLOAT);
-            float f_result = (promote_to_float && result.type == ValueType::NUMBER) ? static_cast<float>(result.i_value) : result.f_value;
-            float f_rhs = (promote_to_float && rhs.type == ValueType::NUMBER) ? static_cast<float>(rhs.i_value) : rhs.f_value;
-
-            if (op.type == TokenType::EQUAL_EQUAL) {
-                return Value(f_result == f_rhs);
-            } else if (op.type == TokenType::NOT_EQUAL) {
-                return Value(f_result != f_rhs);
-            } else if (op.type == TokenType::GREATER) {
-                return Value(f_result > f_rhs);
-            } else if (op.type == TokenType::GREATER_EQUAL) {
-                return Value(f_result >= f_rhs);
-            } else if (op.type == TokenType::LESS) {
-                return Value(f_result < f_rhs);
-            } else if (op.type == TokenType::LESS_EQUAL) {
-                return Value(f_result <= f_rhs);
-            }
-        }
+// Comparisons bind loosest and do not chain: `a < b + 1` compares against the sum.
+ExprPtr Parser::parseExpression() {
+    ExprPtr result = parseAdditive();
+    if (isComparison(peek().type)) {
+        TokenType op = advance().type;
+        result = makeBinary(op, std::move(result), parseAdditive());
     }
     return result;
 }
 
-void Parser::handleShow() {
-    advance(); // skip 'print'
-    Value value = parseExpression();
-    if (value.type == ValueType::NUMBER) {
-        std::cout << value.i_value << std::endl;
-    } else if (value.type == ValueType::STRING) {
-        std::cout << value.s_value << std::endl;
-    } else if (value.type == ValueType::BOOLEAN) {
-        std::cout << (value.b_value ? "true" : "false") << std::endl;
-    } else if (value.type == ValueType::FLOAT) {
-        std::cout << value.f_value << std::endl;
-    } else if (value.type == ValueType::CHAR) {
-        std::cout << value.c_value << std::endl;
+ExprPtr Parser::parseFunctionCall(const std::string& name, const Token& token) {
+    ExprPtr call = makeExpr(ExprKind::CALL, token);
+    call->name = name;
+
+    // Parse named arguments: identifier : expression
+    while (peek().type == TokenType::IDENTIFIER && peekNextToken().type == TokenType::COLON) {
+        Argument arg;
+        arg.name = advance().text(); // Consume parameter name (e.g., 'a')
+        advance(); // Consume COLON ':'
+        arg.value = parseExpression(); // Parse the argument value (e.g., '3')
+        call->args.push_back(std::move(arg));
     }
+    return call;
+}
+
+StmtPtr Parser::parseShow() {
+    Token keyword = advance(); // skip 'show'
+    StmtPtr stmt = makeStmt(StmtKind::SHOW, keyword);
+    stmt->expr = parseExpression();
+    return stmt;
 }
 
-void Parser::handleVariableDeclaration() {
-    Token name = advance(); // consume the identifier
+StmtPtr Parser::parseVariableDeclaration() {
+    StmtPtr stmt = makeStmt(StmtKind::VAR_DECL, peek());
+    stmt->name = advance().text(); // consume the identifier
     advance(); // consume the ':'
-    Token type = advance();
-    if (type.type != TokenType::IDENTIFIER && type.type != TokenType::KEYWORD_NUM && type.type != TokenType::KEYWORD_STRING && type.type != TokenType::KEYWORD_BOOL && type.type != TokenType::KEYWORD_FLOAT && type.type != TokenType::KEYWORD_CHAR) {
-        throw RuntimeError("Syntax error: expected type annotation");
-    }
+    stmt->type = parseAnnotation("expected type annotation");
     if (advance().type != TokenType::EQUAL) {
         throw RuntimeError("Syntax error: expected '=' after type annotation");
     }
-    Value value = parseExpression();
-    
-    // Type checking and conversion
-    if (type.type == TokenType::KEYWORD_NUM) {
-        if (value.type == ValueType::NUMBER) {
-            setVariable(name.value, value);
-        } else if (value.type == ValueType::FLOAT) {
-            setVariable(name.value, Value(static_cast<int>(value.f_value)));
-        } else {
-            throw RuntimeError("Error: cannot convert to num");
-        }
-    } else if (type.type == TokenType::KEYWORD_STRING) {
-        if (value.type == ValueType::STRING) {
-            setVariable(name.value, value);
-        } else {
-            throw RuntimeError("Error: cannot convert to string");
-        }
-    } else if (type.type == TokenType::KEYWORD_BOOL) {
-        if (value.type == ValueType::BOOLEAN) {
-            setVariable(name.value, value);
-        } else {
-            throw RuntimeError("Error: cannot convert to bool");
-        }
-    } else if (type.type == TokenType::KEYWORD_FLOAT) {
-        if (value.type == ValueType::FLOAT) {
-            setVariable(name.value, value);
-        } else if (value.type == ValueType::NUMBER) {
-            setVariable(name.value, Value(static_cast<float>(value.i_value)));
-        } else {
-            throw RuntimeError("Error: cannot convert to float");
-        }
-    } else if (type.type == TokenType::KEYWORD_CHAR) {
-        if (value.type == ValueType::CHAR) {
-            setVariable(name.value, value);
-        } else {
-            throw RuntimeError("Error: cannot convert to char");
-        }
-    } else {
-        // For IDENTIFIER type (e.g., custom types), direct assignment for now
-        setVariable(name.value, value);
-    }
+    stmt->expr = parseExpression();
+    return stmt;
 }
 
-void Parser::handleAssignmentStatement() {
-    Token name = advance(); // consume the identifier (variable name)
+StmtPtr Parser::parseAssignment() {
+    StmtPtr stmt = makeStmt(StmtKind::ASSIGN, peek());
+    stmt->name = advance().text(); // consume the identifier (variable name)
     advance(); // consume the '='
-    Value value = parseExpression();
-    setVariable(name.value, value);
+    stmt->expr = parseExpression();
+    return stmt;
 }
 
-void Parser::parseBlock() {
-    enterScope();
+std::vector<StmtPtr> Parser::parseBlock() {
+    std::vector<StmtPtr> body;
     while (peek().type != TokenType::KEYWORD_END && peek().type != TokenType::END_OF_FILE) {
-        if (is_returning) break;
-        run_single_statement();
+        body.push_back(parseStatement());
     }
     if (peek().type == TokenType::KEYWORD_END) {
         advance(); // consume 'end'
     }
-    exitScope();
+    return body;
 }
 
-void Parser::handleIfStatement() {
-    advance(); // skip 'if'
-    Value condition = parseExpression();
+StmtPtr Parser::parseIfStatement() {
+    Token keyword = advance(); // skip 'if'
+    StmtPtr stmt = makeStmt(StmtKind::IF, keyword);
+    stmt->expr = parseExpression();
     if (advance().type != TokenType::KEYWORD_START) {
         throw RuntimeError("Syntax error: expected 'start' after condition");
     }
-
-    bool is_true = false;
-    if (condition.type == ValueType::BOOLEAN) {
-        is_true = condition.b_value;
-    } else if (condition.type == ValueType::NUMBER) {
-        is_true = (condition.i_value != 0);
-    } else if (condition.type == ValueType::STRING) {
-        is_true = !condition.s_value.empty();
+    stmt->body = parseBlock();
+    if (peek().type == TokenType::KEYWORD_ELSE) {
+        advance(); // skip 'else'
+        // The else block does not have its own 'start' keyword
+        // It directly follows 'else' and is terminated by the 'end' of the if statement
+        stmt->else_body = parseBlock();
+        stmt->has_else = true;
     }
+    return stmt;
+}
 
-    if (is_true) {
-        parseBlock();
-        if (peek().type == TokenType::KEYWORD_ELSE) {
-            advance(); // skip 'else'
-            // The else block does not have its own 'start' keyword
-            // It directly follows 'else' and is terminated by the 'end' of the if statement
-            parseBlock();
-        }
-    } else {
-        // skip the if block
-        int start_level = 1;
-        while (start_level > 0 && peek().type != TokenType::END_OF_FILE) {
-            Token t = advance();
-            if (t.type == TokenType::KEYWORD_START) start_level++;
-            if (t.type == TokenType::KEYWORD_END) start_level--;
-        }
-        if (peek().type == TokenType::KEYWORD_ELSE) {
-            advance(); // skip 'else'
-            // The else block does not have its own 'start' keyword
-            // It directly follows 'else' and is terminated by the 'end' of the if statement
-            parseBlock();
-        }
+StmtPtr Parser::parseWhileStatement() {
+    Token keyword = advance(); // skip 'while'
+    StmtPtr stmt = makeStmt(StmtKind::WHILE, keyword);
+    stmt->expr = parseExpression();
+    if (advance().type != TokenType::KEYWORD_START) {
+        throw RuntimeError("Syntax error: expected 'start' after while condition");
     }
+    stmt->body = parseBlock();
+    return stmt;
 }
 
-void Parser::handleWhileStatement() {
-    advance(); // skip 'while'
-
-    
-    // Store the current position to jump back to for the loop
-    size_t condition_start_pos = pos;
-
-    // Keep looping as long as the condition is true
-    while (true) {
-        // Reset position to evaluate the condition
-        pos = condition_start_pos;
-    
-        if (!parseCondition()) {
-
-            break; // Exit loop if condition is false
-        }
-
-        if (peek().type != TokenType::KEYWORD_START) {
-            throw RuntimeError("Syntax error: expected 'start' after while condition");
+StmtPtr Parser::parseParallelStatement() {
+    Token keyword = advance(); // skip 'parallel'
+    StmtPtr stmt = makeStmt(StmtKind::PARALLEL, keyword);
+    Token index = advance();
+    if (index.type != TokenType::IDENTIFIER) {
+        throw RuntimeError("Syntax error: expected loop variable after 'parallel'");
+    }
+    stmt->name = index.text();
+    if (advance().type != TokenType::EQUAL) {
+        throw RuntimeError("Syntax error: expected '=' after parallel loop variable");
+    }
+    stmt->expr = parseExpression();
+    Token to = advance();
+    if (to.type != TokenType::IDENTIFIER || to.text() != "to") {
+        throw RuntimeError("Syntax error: expected 'to' in parallel loop range");
+    }
+    stmt->index = parseExpression();
+
+    // Reduction clauses: `sum name`, `min name` or `max name`
+    while (peek().type == TokenType::IDENTIFIER) {
+        std::string kind = advance().text();
+        ReductionClause clause;
+        if (kind == "sum") {
+            clause.kind = Reduction::SUM;
+        } else if (kind == "min") {
+            clause.kind = Reduction::MIN;
+        } else if (kind == "max") {
+            clause.kind = Reduction::MAX;
+        } else {
+            throw RuntimeError("Syntax error: expected 'sum', 'min', 'max' or 'start' after parallel loop range");
         }
-        advance(); // skip 'start'
-
-
-        parseBlock();
-
-
-        if (is_returning) { // Handle return inside loop
-            return;
+        Token name = advance();
+        if (name.type != TokenType::IDENTIFIER) {
+            throw RuntimeError("Syntax error: expected variable name after '" + kind + "'");
         }
+        clause.name = name.text();
+        stmt->reductions.push_back(std::move(clause));
     }
-
-    // After the loop, skip the condition and the block
-    // First, skip the condition part
-    pos = condition_start_pos;
-    // Find the matching 'start' for the block
-    while (peek().type != TokenType::KEYWORD_START && peek().type != TokenType::END_OF_FILE) {
-        advance();
-    }
-
-    if (peek().type == TokenType::KEYWORD_START) {
-        advance(); // skip 'start'
-        int start_level = 1;
-        while (start_level > 0 && peek().type != TokenType::END_OF_FILE) {
-            Token t = advance();
-            if (t.type == TokenType::KEYWORD_START) start_level++;
-            if (t.type == TokenType::KEYWORD_END) start_level--;
-        }
+    if (advance().type != TokenType::KEYWORD_START) {
+        throw RuntimeError("Syntax error: expected 'start' before parallel loop body");
     }
-
+    stmt->body = parseBlock();
+    return stmt;
 }
 
-
-
-void Parser::handleFunctionDeclaration() {
-    advance(); // skip 'fun'
+StmtPtr Parser::parseFunctionDeclaration() {
+    Token keyword = advance(); // skip 'fun'
     if (advance().type != TokenType::COLON) {
         throw RuntimeError("Syntax error: expected ':' after 'fun'");
     }
-    Token return_type = advance();
-    if (return_type.type != TokenType::IDENTIFIER && return_type.type != TokenType::KEYWORD_STRING && return_type.type != TokenType::KEYWORD_NUM && return_type.type != TokenType::KEYWORD_BOOL) {
-        throw RuntimeError("Syntax error: expected return type");
-    }
+    TokenType return_type = parseAnnotation("expected return type");
 
     Token name = advance();
     if (name.type != TokenType::IDENTIFIER) {
         throw RuntimeError("Syntax error: expected function name");
     }
 
-    Function func;
-    func.return_type = return_type.value;
+    // Reserve the index before parsing the body so nested declarations come after it
+    size_t index = output.functions.size();
+    output.functions.emplace_back();
+    std::unique_ptr<FunctionDecl> func(new FunctionDecl());
+    func->name = name.text();
+    func->line = name.line;
+    func->return_type = return_type;
 
     while (peek().type != TokenType::KEYWORD_START && peek().type != TokenType::END_OF_FILE) {
         Token param_name = advance();
@@ -425,132 +474,99 @@ void Parser::handleFunctionDeclaration() {
         if (advance().type != TokenType::COLON) {
             throw RuntimeError("Syntax error: expected ':' after parameter name");
         }
-        Token param_type = advance();
-        if (param_type.type != TokenType::IDENTIFIER && param_type.type != TokenType::KEYWORD_STRING && param_type.type != TokenType::KEYWORD_NUM && param_type.type != TokenType::KEYWORD_BOOL && param_type.type != TokenType::KEYWORD_FLOAT && param_type.type != TokenType::KEYWORD_CHAR) {
-            throw RuntimeError("Syntax error: expected parameter type");
-        }
-
-        bool current_has_default_value = false;
-        Value current_default_value;
+        ParameterDecl param;
+        param.name = param_name.text();
+        param.type = parseAnnotation("expected parameter type");
         if (peek().type == TokenType::EQUAL) {
             advance(); // consume '='
-            current_default_value = parseExpression();
-            current_has_default_value = true;
+            param.default_value = parseExpression();
         }
-        func.parameters.push_back(Parameter(param_name.value, param_type.value, current_has_default_value, current_default_value));
+        func->parameters.push_back(std::move(param));
     }
 
     if (peek().type != TokenType::KEYWORD_START) {
         throw RuntimeError("Syntax error: expected 'start' before function body");
     }
     advance(); // consume 'start'
+    func->body = parseBlock();
 
-    int start_level = 1;
-    while (start_level > 0 && peek().type != TokenType::END_OF_FILE) {
-        func.body.push_back(peek());
-        if (peek().type == TokenType::KEYWORD_START) start_level++;
-        if (peek().type == TokenType::KEYWORD_END) start_level--;
-        advance();
-    }
-    if (!func.body.empty()) {
-        func.body.pop_back(); // remove the last 'end'
-    }
-
-    functions[name.value] = func;
+    StmtPtr stmt = makeStmt(StmtKind::FUN_DECL, keyword);
+    stmt->name = func->name;
+    stmt->function = index;
+    output.functions[index] = std::move(func);
+    return stmt;
 }
 
-void Parser::handleReturnStatement() {
-    advance(); // skip 'return'
-    return_value = parseExpression();
-    is_returning = true;
+StmtPtr Parser::parseReturnStatement() {
+    Token keyword = advance(); // skip 'return'
+    StmtPtr stmt = makeStmt(StmtKind::RETURN, keyword);
+    stmt->expr = parseExpression();
+    return stmt;
 }
 
-Value Parser::handleFunctionCall(const std::string& name) {
-    if (!functions.count(name)) {
-        throw RuntimeError("Undefined function '" + name + "'");
-    }
-
-    Function func = functions[name];
-    std::unordered_map<std::string, Value> named_args;
-
-    // Parse named arguments: identifier : expression
-    while (peek().type == TokenType::IDENTIFIER && peekNextToken().type == TokenType::COLON) {
-        Token param_name_token = advance(); // Consume parameter name (e.g., 'a')
-        advance(); // Consume COLON ':'
-
-        Value arg_value = parseExpression(); // Parse the argument value (e.g., '3')
-        named_args[param_name_token.value] = arg_value;
-    }
-
-    std::vector<Value> ordered_args;
-    ordered_args.reserve(func.parameters.size()); // Pre-allocate space
-
-    // Populate ordered_args based on function's parameter definition order
-    for (const auto& param : func.parameters) {
-        if (named_args.count(param.name)) {
-            ordered_args.push_back(named_args[param.name]);
-        } else if (param.has_default_value) { // Check for default value
-            ordered_args.push_back(param.default_value);
-        } else {
-            throw RuntimeError("Missing argument for parameter '" + param.name + "' in function '" + name + "'");
-        }
-    }
-
-    if (ordered_args.size() != func.parameters.size()) {
-        // This check should ideally be covered by the loop above, but good for safety.
-        throw RuntimeError("Incorrect number of arguments for function '" + name + "'");
+StmtPtr Parser::parseSpawnStatement() {
+    Token keyword = advance(); // skip 'spawn'
+    StmtPtr stmt = makeStmt(StmtKind::SPAWN, keyword);
+    stmt->expr = parseExpression();
+    if (stmt->expr->kind != ExprKind::CALL) {
+        throw RuntimeError("Syntax error: expected a function call after 'spawn'");
     }
+    return stmt;
+}
 
-    // Create a new parser for the function body
-    Parser func_parser(func.body);
-    func_parser.functions = functions;
-
-    // Set up the function's local variables
-    for (size_t i = 0; i < func.parameters.size(); ++i) {
-        func_parser.setVariable(func.parameters[i].name, ordered_args[i]);
+StmtPtr Parser::parseStatement() {
+    StmtPtr stmt = parseSimpleStatement();
+    if (pending_appends > 0) {
+        throw RuntimeError("Syntax error: '.append' must be a statement of its own, as in 'xs.append(1)'");
     }
-
-    // Execute the function body
-    func_parser.run();
-
-    if (func_parser.is_returning) {
-        return func_parser.return_value;
+    if (pending_sends > 0) {
+        throw RuntimeError("Syntax error: '.send' must be a statement of its own, as in 'c.send(1)'");
     }
-
-    return Value();
+    return stmt;
 }
 
-void Parser::run_single_statement() {
-    if (is_returning) return;
+StmtPtr Parser::parseSimpleStatement() {
     Token current = peek();
     if (current.type == TokenType::SHOW) {
-        handleShow();
+        return parseShow();
     } else if (current.type == TokenType::KEYWORD_IF) {
-        handleIfStatement();
+        return parseIfStatement();
     } else if (current.type == TokenType::KEYWORD_WHILE) {
-        handleWhileStatement();
+        return parseWhileStatement();
+    } else if (current.type == TokenType::KEYWORD_PARALLEL) {
+        return parseParallelStatement();
+    } else if (current.type == TokenType::KEYWORD_SPAWN) {
+        return parseSpawnStatement();
     } else if (current.type == TokenType::KEYWORD_FUN) {
-        handleFunctionDeclaration();
+        return parseFunctionDeclaration();
     } else if (current.type == TokenType::KEYWORD_RETURN) {
-        handleReturnStatement();
+        return parseReturnStatement();
     } else if (current.type == TokenType::IDENTIFIER) {
         if (peekNextToken().type == TokenType::COLON) {
-            handleVariableDeclaration();
+            return parseVariableDeclaration();
         } else if (peekNextToken().type == TokenType::EQUAL) {
-            handleAssignmentStatement();
-        } else {
-            // Expression statement (e.g., function call or just an identifier)
-            parseExpression();
+            return parseAssignment();
         }
-    } else {
-        // Fallback for other expression statements that don't start with IDENTIFIER
-        parseExpression();
     }
+    // Expression statement (e.g., function call or just an identifier)
+    StmtPtr stmt = makeStmt(StmtKind::EXPRESSION, current);
+    stmt->expr = parseExpression();
+    Expr& expr = *stmt->expr;
+    bool on_variable = expr.lhs && expr.lhs->kind == ExprKind::VARIABLE;
+    if (expr.kind == ExprKind::METHOD && expr.method == Method::APPEND && on_variable) {
+        // `xs.append(v)` changes xs itself
+        stmt->kind = StmtKind::APPEND;
+        stmt->name = expr.lhs->name;
+        stmt->expr = std::move(expr.rhs);
+        pending_appends--;
+    } else if (expr.kind == ExprKind::METHOD && expr.method == Method::SEND) {
+        pending_sends--; // stays an expression statement that leaves no value
+    } else if (expr.kind == ExprKind::INDEX && on_variable && peek().type == TokenType::EQUAL) {
+        advance(); // consume '='
+        stmt->kind = StmtKind::STORE_INDEX;
+        stmt->name = expr.lhs->name;
+        stmt->index = std::move(expr.rhs);
+        stmt->expr = parseExpression();
+    }
+    return stmt;
 }
-
-void Parser::run() {
-    while (peek().type != TokenType::END_OF_FILE) {
-        if (is_returning) return;
-        run_single_statement();
-    }
-}
\ No newline at end of file
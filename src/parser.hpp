@@ -1,68 +1,68 @@
 #pragma once
+#include "ast.hpp"
+#include "error.hpp"
 #include "lexer.hpp"
-#include "value.hpp"
 #include <vector>
-#include <unordered_map>
+#include <unordered_set>
 #include <string>
 
-#include <stdexcept>
-
-class RuntimeError : public std::runtime_error {
-public:
-    explicit RuntimeError(const std::string& message) : std::runtime_error(message) {}
-};
-
-struct Parameter {
-    std::string name;
-    std::string type;
-    bool has_default_value = false;
-    Value default_value;
-
-    // Explicit constructor
-    Parameter(std::string name, std::string type, bool has_default_value = false, Value default_value = Value())
-        : name(std::move(name)), type(std::move(type)), has_default_value(has_default_value), default_value(std::move(default_value)) {}
-};
-
-struct Function {
-    std::string return_type;
-    std::vector<Parameter> parameters;
-    std::vector<Token> body;
-};
-
+// Builds the syntax tree for a whole program in a single pass. Tokens are
+// either pulled on demand from a Lexer or read from a pre-tokenized vector.
 class Parser {
 public:
     explicit Parser(const std::vector<Token>& tokens);
-    void run();
+    explicit Parser(Lexer& lexer);
+    Program parse();
+
+    // Incremental parsing for streaming compilation: returns the next
+    // top-level statement, or null at the end of the input. Function
+    // declarations it contains are added to program().functions.
+    StmtPtr parseNext();
+    Program& program() { return output; }
 
 private:
-    std::vector<Token> tokens;
-    size_t pos = 0;
-    std::vector<std::unordered_map<std::string, Value>> scopes;
-    std::unordered_map<std::string, Function> functions;
-    bool is_returning = false;
-    Value return_value;
+    Lexer* lexer = nullptr;
+    const std::vector<Token>* tokens = nullptr;
+    size_t next_index = 0;
+    Token lookahead[2];
+    int lookahead_count = 0;
+    std::unordered_set<std::string> function_names;
+    Program output;
+    bool started = false;
+    int pending_appends = 0; // `.append` calls not yet made statements
+    int pending_sends = 0;   // `.send` calls not yet found to be statements
 
-    Token peek() const;
-    Token peekNextToken() const;
+    void start();
+    void fill();
+    const Token& peek();
+    const Token& peekNextToken();
     Token advance();
 
-    void enterScope();
-    void exitScope();
-    Value getVariable(const std::string& name);
-    void setVariable(const std::string& name, const Value& value);
+    void collectFunctionNames();
+
+    ExprPtr makeExpr(ExprKind kind, const Token& token);
+    StmtPtr makeStmt(StmtKind kind, const Token& token);
+    ExprPtr makeBinary(TokenType op, ExprPtr lhs, ExprPtr rhs);
 
-    void handleShow();
-    void handleVariableDeclaration();
-    void handleIfStatement();
-    void handleWhileStatement();
-    void handleFunctionDeclaration();
-    void handleReturnStatement();
-    Value handleFunctionCall(const std::string& name);
-    void handleAssignmentStatement();
-    void parseBlock();
-    bool parseCondition();
-    Value parseFactor();
-    Value parseTerm();
-    Value parseExpression();
-    void run_single_statement();
-};
\ No newline at end of file
+    TokenType parseAnnotation(const char* error);
+    StmtPtr parseStatement();
+    StmtPtr parseSimpleStatement();
+    StmtPtr parseShow();
+    StmtPtr parseVariableDeclaration();
+    StmtPtr parseAssignment();
+    StmtPtr parseIfStatement();
+    StmtPtr parseWhileStatement();
+    StmtPtr parseParallelStatement();
+    StmtPtr parseFunctionDeclaration();
+    StmtPtr parseReturnStatement();
+    StmtPtr parseSpawnStatement();
+    std::vector<StmtPtr> parseBlock();
+    ExprPtr parseFunctionCall(const std::string& name, const Token& token);
+    ExprPtr parseArray(const Token& bracket);
+    ExprPtr parsePostfix(ExprPtr expr);
+    ExprPtr parsePrimary();
+    ExprPtr parseFactor();
+    ExprPtr parseTerm();
+    ExprPtr parseAdditive();
+    ExprPtr parseExpression();
+};
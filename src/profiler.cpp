@@ -0,0 +1,161 @@
+#include "profiler.hpp"
+#include <algorithm>
+
+static const size_t SCRIPT = 0;
+static const size_t NO_NODE = static_cast<size_t>(-1);
+static const size_t REPORTED_LINES = 20;
+
+static double milliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+Profiler::Profiler() {
+    functions.resize(1);
+    functions[SCRIPT].name = "<script>";
+    functions[SCRIPT].line = 0;
+}
+
+void Profiler::addFunction(const std::string& name, uint32_t line) {
+    FunctionStats stats;
+    stats.name = name;
+    stats.line = line;
+    functions.push_back(stats);
+}
+
+void Profiler::start() {
+    started = Clock::now();
+    push(SCRIPT);
+}
+
+void Profiler::enterFunction(size_t function) {
+    push(function + 1);
+}
+
+void Profiler::push(size_t function) {
+    size_t parent = frames.empty() ? NO_NODE : frames.back().node;
+    uint64_t key = (static_cast<uint64_t>(parent + 1) << 32) | function;
+    auto found = children.find(key);
+    size_t node;
+    if (found != children.end()) {
+        node = found->second;
+    } else {
+        node = nodes.size();
+        StackNode created;
+        created.parent = parent;
+        created.function = function;
+        nodes.push_back(created);
+        children.emplace(key, node);
+    }
+
+    FunctionStats& stats = functions[function];
+    stats.calls++;
+    stats.active++;
+
+    Frame frame;
+    frame.function = function;
+    frame.node = node;
+    frame.start = Clock::now();
+    frames.push_back(frame);
+}
+
+void Profiler::exitFunction() {
+    Clock::duration elapsed = Clock::now() - frames.back().start;
+    const Frame& frame = frames.back();
+    Clock::duration self = elapsed - frame.children;
+
+    FunctionStats& stats = functions[frame.function];
+    if (--stats.active == 0) {
+        stats.inclusive += elapsed; // outermost activation of a recursive function
+    }
+    stats.exclusive += self;
+    nodes[frame.node].self += self;
+
+    frames.pop_back();
+    if (!frames.empty()) {
+        frames.back().children += elapsed;
+    }
+}
+
+void Profiler::swapStack(TaskStack& stack) {
+    Clock::time_point now = Clock::now();
+    for (auto& frame : stack.frames) {
+        frame.start += now - stack.paused;
+    }
+    frames.swap(stack.frames);
+    stack.paused = now;
+}
+
+void Profiler::finish() {
+    while (!frames.empty()) {
+        exitFunction();
+    }
+    total = Clock::now() - started;
+}
+
+void Profiler::report(FILE* stream) const {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        if (functions[i].calls > 0) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return functions[a].exclusive > functions[b].exclusive;
+    });
+
+    std::fprintf(stream, "\n== Profile: %.3f ms ==\n", milliseconds(total));
+    std::fprintf(stream, "Functions by exclusive time:\n");
+    std::fprintf(stream, "%12s %14s %14s  %s\n", "calls", "inclusive ms", "exclusive ms", "function");
+    for (size_t i : order) {
+        const FunctionStats& stats = functions[i];
+        std::fprintf(stream, "%12llu %14.3f %14.3f  %s", static_cast<unsigned long long>(stats.calls),
+                     milliseconds(stats.inclusive), milliseconds(stats.exclusive), stats.name.c_str());
+        if (i != SCRIPT) {
+            std::fprintf(stream, " (line %u)", stats.line);
+        }
+        std::fputc('\n', stream);
+    }
+
+    std::vector<uint32_t> lines;
+    for (size_t line = 0; line < line_counts.size(); ++line) {
+        if (line_counts[line] > 0) {
+            lines.push_back(static_cast<uint32_t>(line));
+        }
+    }
+    std::stable_sort(lines.begin(), lines.end(), [this](uint32_t a, uint32_t b) {
+        return line_counts[a] > line_counts[b];
+    });
+    if (lines.size() > REPORTED_LINES) {
+        lines.resize(REPORTED_LINES);
+    }
+
+    std::fprintf(stream, "Hottest lines by statements executed:\n");
+    std::fprintf(stream, "%12s  %s\n", "statements", "line");
+    for (uint32_t line : lines) {
+        std::fprintf(stream, "%12llu  %u\n", static_cast<unsigned long long>(line_counts[line]), line);
+    }
+}
+
+bool Profiler::writeCollapsedStacks(const std::string& path) const {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    std::vector<const std::string*> names;
+    for (const StackNode& node : nodes) {
+        long long micros = std::chrono::duration_cast<std::chrono::microseconds>(node.self).count();
+        if (micros <= 0) {
+            continue;
+        }
+        names.clear();
+        for (size_t n = &node - nodes.data(); n != NO_NODE; n = nodes[n].parent) {
+            names.push_back(&functions[nodes[n].function].name);
+        }
+        for (size_t i = names.size(); i-- > 0;) {
+            std::fputs(names[i]->c_str(), file);
+            std::fputc(i == 0 ? ' ' : ';', file);
+        }
+        std::fprintf(file, "%lld\n", micros);
+    }
+    return std::fclose(file) == 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Collects what `--profile` reports: calls, inclusive and exclusive time of
+// every user function, and how many statements ran on each source line.
+// Engines only talk to a Profiler when one is attached, so a normal run pays
+// nothing beyond a null check per call.
+//
+// Function ids are the declaration indices of the program; the top-level
+// script is tracked separately as the root of every call stack. A spawned
+// task keeps a call stack of its own, rooted at the function it runs.
+class Profiler {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame {
+        size_t function;
+        size_t node;
+        Clock::time_point start;
+        Clock::duration children = Clock::duration::zero();
+    };
+
+public:
+    // The open frames of a task while another one runs; the time in between
+    // counts for none of them.
+    struct TaskStack {
+        std::vector<Frame> frames;
+        Clock::time_point paused;
+    };
+
+    Profiler();
+
+    void addFunction(const std::string& name, uint32_t line);
+
+    // Opens the script's frame; called when execution starts.
+    void start();
+    void enterFunction(size_t function);
+    void exitFunction();
+    void countStatement(uint32_t line) {
+        if (line >= line_counts.size()) {
+            line_counts.resize(line + 1);
+        }
+        line_counts[line]++;
+    }
+
+    // Makes `stack` the current call stack and keeps the current one in it.
+    void swapStack(TaskStack& stack);
+
+    // Closes the script and any frames a runtime error left open.
+    void finish();
+
+    // Sorted report of the hottest functions and lines.
+    void report(FILE* stream) const;
+    // One "script;caller;callee <microseconds>" line per distinct call
+    // stack, the collapsed format read by flame-graph tools.
+    bool writeCollapsedStacks(const std::string& path) const;
+
+private:
+    struct FunctionStats {
+        std::string name;
+        uint32_t line;
+        uint64_t calls = 0;
+        Clock::duration inclusive = Clock::duration::zero();
+        Clock::duration exclusive = Clock::duration::zero();
+        uint32_t active = 0; // frames currently on the stack; recursion counts once
+    };
+
+    // Node of the call tree: one per distinct stack of function ids.
+    struct StackNode {
+        size_t parent;
+        size_t function;
+        Clock::duration self = Clock::duration::zero();
+    };
+
+    std::vector<FunctionStats> functions; // script first, then by declaration index
+    std::vector<StackNode> nodes;
+    std::unordered_map<uint64_t, size_t> children; // (parent node, function) -> node
+    std::vector<Frame> frames;
+    std::vector<uint64_t> line_counts;
+    Clock::time_point started;
+    Clock::duration total = Clock::duration::zero();
+
+    void push(size_t function);
+};
@@ -0,0 +1,304 @@
+#include "program_cache.hpp"
+#include "source_file.hpp"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+static const char MAGIC[4] = { 'N', 'V', 'C', '\0' };
+static const size_t HEADER_SIZE = 4 + 4 + 8 + 8 + 8; // magic, version, source hash, payload size, checksum
+
+std::string programCachePath(const std::string& source_path) {
+    if (source_path.size() >= 3 && source_path.compare(source_path.size() - 3, 3, ".nv") == 0) {
+        return source_path + "c";
+    }
+    return source_path + ".nvc";
+}
+
+// Word-at-a-time multiplicative hash: only has to tell versions of the same
+// script apart, and runs on every start.
+uint64_t hashSource(const char* data, size_t size) {
+    const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    uint64_t hash = size * multiplier;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    hash = (hash ^ tail) * multiplier;
+    return hash ^ (hash >> 32);
+}
+
+static uint64_t checksum(const uint8_t* data, size_t size) {
+    return hashSource(reinterpret_cast<const char*>(data), size);
+}
+
+namespace {
+
+// Little-endian encoder for the payload.
+class Writer {
+public:
+    std::vector<uint8_t> bytes;
+
+    void u8(uint8_t value) { bytes.push_back(value); }
+    void u32(uint32_t value) { integer(value, 4); }
+    void u64(uint64_t value) { integer(value, 8); }
+    void raw(const void* data, size_t size) {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+    void string(const std::string& text) {
+        u32(static_cast<uint32_t>(text.size()));
+        raw(text.data(), text.size());
+    }
+
+    void value(const Value& value) {
+        u8(static_cast<uint8_t>(value.type));
+        switch (value.type) {
+            case ValueType::NUMBER: u32(static_cast<uint32_t>(value.i_value)); break;
+            case ValueType::FLOAT: {
+                uint32_t bits;
+                std::memcpy(&bits, &value.f_value, sizeof(bits));
+                u32(bits);
+                break;
+            }
+            case ValueType::BOOLEAN: u8(value.b_value ? 1 : 0); break;
+            case ValueType::CHAR: u8(static_cast<uint8_t>(value.c_value)); break;
+            case ValueType::STRING: string(value.str()); break;
+            case ValueType::NONE:
+            case ValueType::ARRAY:
+            case ValueType::CHANNEL: break; // never a constant
+        }
+    }
+
+    void function(const CompiledFunction& function) {
+        u32(function.name);
+        u32(function.line);
+        u8(function.is_pure ? 1 : 0);
+        u64(function.slot_count);
+        u32(static_cast<uint32_t>(function.parameters.size()));
+        for (const auto& param : function.parameters) {
+            u32(param.name);
+            u8(param.has_default_value ? 1 : 0);
+            u8(static_cast<uint8_t>(param.type));
+        }
+        u32(static_cast<uint32_t>(function.chunk.code.size()));
+        raw(function.chunk.code.data(), function.chunk.code.size());
+        u32(static_cast<uint32_t>(function.chunk.constants.size()));
+        for (const auto& constant : function.chunk.constants) {
+            value(constant);
+        }
+    }
+
+private:
+    void integer(uint64_t value, int size) {
+        for (int i = 0; i < size; ++i) {
+            bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+};
+
+// Bounds-checked decoder: once anything is out of range it stays failed and
+// yields zeros.
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    bool failed = false;
+    bool atEnd() const { return position == size; }
+
+    uint8_t u8() { return static_cast<uint8_t>(integer(1)); }
+    uint32_t u32() { return static_cast<uint32_t>(integer(4)); }
+    uint64_t u64() { return integer(8); }
+
+    const uint8_t* raw(size_t count) {
+        if (failed || count > size - position) {
+            failed = true;
+            return nullptr;
+        }
+        const uint8_t* start = data + position;
+        position += count;
+        return start;
+    }
+
+    // A count of items that each take at least `item_size` bytes.
+    uint32_t count(size_t item_size) {
+        uint32_t n = u32();
+        if (static_cast<uint64_t>(n) * item_size > size - position) {
+            failed = true;
+            return 0;
+        }
+        return n;
+    }
+
+    std::string string() {
+        uint32_t length = count(1);
+        const uint8_t* chars = raw(length);
+        return chars ? std::string(reinterpret_cast<const char*>(chars), length) : std::string();
+    }
+
+    Value value() {
+        switch (static_cast<ValueType>(u8())) {
+            case ValueType::NUMBER: return Value(static_cast<int>(u32()));
+            case ValueType::FLOAT: {
+                uint32_t bits = u32();
+                float f;
+                std::memcpy(&f, &bits, sizeof(f));
+                return Value(f);
+            }
+            case ValueType::BOOLEAN: return Value(u8() != 0);
+            case ValueType::CHAR: return Value(static_cast<char>(u8()));
+            case ValueType::STRING: return Value(string());
+            case ValueType::NONE: return Value();
+            case ValueType::ARRAY:
+            case ValueType::CHANNEL: break;
+        }
+        failed = true;
+        return Value();
+    }
+
+    void function(CompiledFunction& function, size_t name_count) {
+        function.name = u32();
+        function.line = u32();
+        function.is_pure = u8() != 0;
+        function.slot_count = static_cast<size_t>(u64());
+        uint32_t parameters = count(4);
+        function.parameters.resize(parameters);
+        for (auto& param : function.parameters) {
+            param.name = u32();
+            param.has_default_value = u8() != 0;
+            param.type = static_cast<TokenType>(u8());
+            if (param.name >= name_count) failed = true;
+        }
+        if (function.name >= name_count || function.slot_count < parameters) {
+            failed = true;
+        }
+        uint32_t code_size = count(1);
+        const uint8_t* code = raw(code_size);
+        if (code) {
+            function.chunk.code.assign(code, code + code_size);
+        }
+        uint32_t constants = count(1);
+        function.chunk.constants.reserve(constants);
+        for (uint32_t i = 0; i < constants && !failed; ++i) {
+            function.chunk.constants.push_back(value());
+        }
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position = 0;
+
+    uint64_t integer(int bytes) {
+        const uint8_t* start = raw(static_cast<size_t>(bytes));
+        uint64_t value = 0;
+        for (int i = 0; start && i < bytes; ++i) {
+            value |= static_cast<uint64_t>(start[i]) << (8 * i);
+        }
+        return value;
+    }
+};
+
+} // namespace
+
+bool loadProgramCache(const std::string& path, uint64_t source_hash, CompiledProgram& program) {
+    SourceFile file;
+    std::string error;
+    if (!file.open(path, error)) {
+        return false;
+    }
+    return decodeProgram(reinterpret_cast<const uint8_t*>(file.data()), file.size(), source_hash, program);
+}
+
+bool decodeProgram(const uint8_t* bytes, size_t size, uint64_t source_hash, CompiledProgram& program) {
+    if (size < HEADER_SIZE) {
+        return false;
+    }
+    Reader header(bytes, HEADER_SIZE);
+    const uint8_t* magic = header.raw(4);
+    if (std::memcmp(magic, MAGIC, 4) != 0 || header.u32() != PROGRAM_CACHE_VERSION || header.u64() != source_hash) {
+        return false;
+    }
+    uint64_t payload_size = header.u64();
+    uint64_t expected_checksum = header.u64();
+    if (payload_size != size - HEADER_SIZE || checksum(bytes + HEADER_SIZE, payload_size) != expected_checksum) {
+        return false;
+    }
+
+    Reader reader(bytes + HEADER_SIZE, payload_size);
+    CompiledProgram loaded;
+    uint32_t names = reader.count(4);
+    loaded.names.reserve(names);
+    for (uint32_t i = 0; i < names && !reader.failed; ++i) {
+        loaded.names.push_back(reader.string());
+    }
+    loaded.call_sites = static_cast<size_t>(reader.u64());
+    loaded.loop_count = static_cast<size_t>(reader.u64());
+    reader.function(loaded.script, loaded.names.size());
+    uint32_t functions = reader.count(1);
+    loaded.functions.resize(functions);
+    for (uint32_t i = 0; i < functions && !reader.failed; ++i) {
+        reader.function(loaded.functions[i], loaded.names.size());
+    }
+    if (reader.failed || !reader.atEnd()) {
+        return false;
+    }
+    program = std::move(loaded);
+    return true;
+}
+
+std::vector<uint8_t> encodeProgram(uint64_t source_hash, const CompiledProgram& program) {
+    Writer payload;
+    payload.u32(static_cast<uint32_t>(program.names.size()));
+    for (const auto& name : program.names) {
+        payload.string(name);
+    }
+    payload.u64(program.call_sites);
+    payload.u64(program.loop_count);
+    payload.function(program.script);
+    payload.u32(static_cast<uint32_t>(program.functions.size()));
+    for (const auto& function : program.functions) {
+        payload.function(function);
+    }
+
+    Writer encoded;
+    encoded.bytes.reserve(HEADER_SIZE + payload.bytes.size());
+    encoded.raw(MAGIC, 4);
+    encoded.u32(PROGRAM_CACHE_VERSION);
+    encoded.u64(source_hash);
+    encoded.u64(payload.bytes.size());
+    encoded.u64(checksum(payload.bytes.data(), payload.bytes.size()));
+    encoded.raw(payload.bytes.data(), payload.bytes.size());
+    return std::move(encoded.bytes);
+}
+
+bool saveProgramCache(const std::string& path, uint64_t source_hash, const CompiledProgram& program) {
+    std::vector<uint8_t> bytes = encodeProgram(source_hash, program);
+
+    // Written next to the cache and renamed over it
+    std::string temporary = path + ".tmp" + std::to_string(getpid());
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    written = std::fclose(file) == 0 && written;
+#ifdef _WIN32
+    std::remove(path.c_str()); // rename does not replace existing files here
+#endif
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "bytecode.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiled programs cached on disk next to their source ("job.nv" is cached
+// in "job.nvc"), so later runs of an unchanged script skip lexing, parsing
+// and compiling. The file holds a header (magic, format version, hash and
+// size of the source, checksum of the rest) followed by the names, the
+// functions with their bytecode and constants, and the script.
+//
+// A cache whose source hash or version differs, or that fails any check
+// while being read, is ignored; the caller compiles again and overwrites it.
+
+// Bumped whenever the bytecode or the file layout changes.
+const uint32_t PROGRAM_CACHE_VERSION = 7;
+
+std::string programCachePath(const std::string& source_path);
+uint64_t hashSource(const char* data, size_t size);
+
+// Reads the cache at `path` into `program` if it was written for this source.
+bool loadProgramCache(const std::string& path, uint64_t source_hash, CompiledProgram& program);
+
+// Writes the cache atomically: readers see either the old file or the new one.
+bool saveProgramCache(const std::string& path, uint64_t source_hash, const CompiledProgram& program);
+
+// The bytes of a cache file, built and read in memory. The --serve daemon's
+// children hand the programs they compile back to it this way.
+std::vector<uint8_t> encodeProgram(uint64_t source_hash, const CompiledProgram& program);
+bool decodeProgram(const uint8_t* bytes, size_t size, uint64_t source_hash, CompiledProgram& program);
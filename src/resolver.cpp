@@ -0,0 +1,452 @@
+#include "resolver.hpp"
+#include "error.hpp"
+
+Resolver::Resolver(Program& program)
+    : program(program), signatures(program.function_names.size()), declared(program.function_names.size(), false), pure(program.function_names.size(), false) {
+    for (size_t i = 0; i < program.function_names.size(); ++i) {
+        auto inserted = function_indices.insert(std::make_pair(program.function_names[i], i));
+        if (!inserted.second) {
+            inserted.first->second = DYNAMIC_FUNCTION;
+        }
+    }
+    pushScope(); // Global scope
+    for (const InputDecl& input : program.inputs) {
+        if (lookup(input.name) != UNRESOLVED_SLOT) {
+            throw RuntimeError("Error: input '" + input.name + "' is declared twice");
+        }
+        bind(input.name);
+    }
+}
+
+void Resolver::resolve() {
+    for (auto& stmt : program.statements) {
+        resolveTopLevel(*stmt);
+    }
+    finish();
+}
+
+void Resolver::resolveTopLevel(Stmt& stmt) {
+    resolveStatement(stmt);
+}
+
+void Resolver::finish() {
+    program.slot_count = max_slots;
+}
+
+// Scopes are kept when they close and cleared, which keeps their buckets,
+// so resolving a block does not allocate a new table each time.
+void Resolver::pushScope() {
+    if (open_scopes == scopes.size()) {
+        scopes.emplace_back();
+    }
+    open_scopes++;
+}
+
+void Resolver::popScope() {
+    scopes[--open_scopes].clear();
+}
+
+int Resolver::lookup(const std::string& name) const {
+    for (size_t i = open_scopes; i-- > function_scope;) {
+        auto found = scopes[i].find(name);
+        if (found != scopes[i].end()) {
+            return found->second;
+        }
+    }
+    return UNRESOLVED_SLOT;
+}
+
+int Resolver::bind(const std::string& name) {
+    int slot = lookup(name);
+    if (slot != UNRESOLVED_SLOT) {
+        return slot;
+    }
+    // If not found in any parent scope, create it in the current scope
+    slot = static_cast<int>(next_slot++);
+    if (next_slot > max_slots) max_slots = next_slot;
+    scopes[open_scopes - 1][name] = slot;
+    return slot;
+}
+
+void Resolver::resolveFunction(FunctionDecl& function) {
+    size_t enclosing_scope = function_scope;
+    size_t enclosing_next = next_slot;
+    size_t enclosing_max = max_slots;
+
+    // Function bodies only see their own parameters and locals
+    function_scope = open_scopes;
+    pushScope();
+    next_slot = 0;
+    max_slots = 0;
+    for (const auto& param : function.parameters) {
+        bind(param.name);
+    }
+    for (auto& stmt : function.body) {
+        resolveStatement(*stmt);
+    }
+    function.slot_count = max_slots;
+
+    popScope();
+    function_scope = enclosing_scope;
+    next_slot = enclosing_next;
+    max_slots = enclosing_max;
+}
+
+void Resolver::resolveBlock(std::vector<StmtPtr>& body) {
+    size_t block_start = next_slot;
+    pushScope();
+    for (auto& stmt : body) {
+        resolveStatement(*stmt);
+    }
+    popScope();
+    next_slot = block_start;
+}
+
+[[noreturn]] static void parallelError(uint32_t line, const std::string& message) {
+    throw RuntimeError("Syntax error on line " + std::to_string(line) + ": " + message);
+}
+
+void Resolver::resolveStatement(Stmt& stmt) {
+    if (!parallel_loops.empty()) {
+        checkParallelBody(stmt);
+    }
+    switch (stmt.kind) {
+        case StmtKind::VAR_DECL:
+        case StmtKind::ASSIGN:
+            // The value is evaluated before the name is bound
+            resolveExpression(*stmt.expr);
+            stmt.slot = bind(stmt.name);
+            stmt.in_place = stmt.kind == StmtKind::ASSIGN && canAssignInPlace(*stmt.expr, stmt.slot);
+            checkParallelWrite(stmt.line, stmt.name, stmt.slot, stmt.expr.get(), nullptr);
+            break;
+        case StmtKind::IF:
+            resolveExpression(*stmt.expr);
+            resolveBlock(stmt.body);
+            if (stmt.has_else) {
+                resolveBlock(stmt.else_body);
+            }
+            break;
+        case StmtKind::WHILE:
+            resolveExpression(*stmt.expr);
+            resolveBlock(stmt.body);
+            break;
+        case StmtKind::BLOCK:
+            resolveBlock(stmt.body);
+            break;
+        case StmtKind::FUN_DECL: {
+            // Defaults are evaluated in the declaring scope
+            FunctionDecl& function = *program.functions[stmt.function];
+            for (auto& param : function.parameters) {
+                if (param.default_value) {
+                    resolveExpression(*param.default_value);
+                }
+                signatures[stmt.function].push_back({ param.name, param.default_value != nullptr });
+            }
+            declared[stmt.function] = true; // recursive calls bind directly
+            resolveFunction(function);
+            function.is_pure = pure[stmt.function] = isPureFunction(function, stmt.function);
+            break;
+        }
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND:
+            // Changes an existing array, so it never declares one
+            if (stmt.index) {
+                resolveExpression(*stmt.index);
+            }
+            resolveExpression(*stmt.expr);
+            stmt.slot = lookup(stmt.name);
+            checkParallelWrite(stmt.line, stmt.name, stmt.slot, nullptr, nullptr);
+            break;
+        case StmtKind::PARALLEL:
+            resolveParallel(stmt);
+            break;
+        case StmtKind::SHOW:
+        case StmtKind::RETURN:
+        case StmtKind::EXPRESSION:
+        case StmtKind::SPAWN:
+            resolveExpression(*stmt.expr);
+            break;
+    }
+}
+
+void Resolver::resolveExpression(Expr& expr) {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            break;
+        case ExprKind::VARIABLE:
+            expr.slot = lookup(expr.name);
+            break;
+        case ExprKind::BINARY:
+            resolveExpression(*expr.lhs);
+            resolveExpression(*expr.rhs);
+            break;
+        case ExprKind::CALL:
+            for (auto& arg : expr.args) {
+                resolveExpression(*arg.value);
+            }
+            resolveCall(expr);
+            if (!parallel_loops.empty() && (expr.function == DYNAMIC_FUNCTION || !pure[expr.function])) {
+                parallelError(expr.line, "'" + expr.name + "' is not pure, so it cannot be called in a parallel loop");
+            }
+            break;
+        case ExprKind::ARRAY:
+            for (auto& element : expr.elements) {
+                resolveExpression(*element);
+            }
+            break;
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            if (!parallel_loops.empty() && expr.kind == ExprKind::METHOD
+                && (expr.method == Method::SEND || expr.method == Method::RECEIVE)) {
+                parallelError(expr.line, "channels cannot be used in a parallel loop");
+            }
+            resolveExpression(*expr.lhs);
+            if (expr.rhs) {
+                resolveExpression(*expr.rhs);
+            }
+            break;
+        case ExprKind::CHANNEL:
+            if (!parallel_loops.empty()) {
+                parallelError(expr.line, "channels cannot be used in a parallel loop");
+            }
+            resolveExpression(*expr.rhs);
+            break;
+    }
+}
+
+static bool isArithmetic(TokenType op) {
+    return op == TokenType::PLUS || op == TokenType::MINUS || op == TokenType::STAR || op == TokenType::SLASH;
+}
+
+static bool readsSlot(const Expr& expr, int slot) {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            return false;
+        case ExprKind::VARIABLE:
+            return expr.slot == slot;
+        case ExprKind::BINARY:
+            return readsSlot(*expr.lhs, slot) || readsSlot(*expr.rhs, slot);
+        case ExprKind::CALL:
+            for (const auto& arg : expr.args) {
+                if (readsSlot(*arg.value, slot)) return true;
+            }
+            return false;
+        case ExprKind::ARRAY:
+            for (const auto& element : expr.elements) {
+                if (readsSlot(*element, slot)) return true;
+            }
+            return false;
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            return readsSlot(*expr.lhs, slot) || (expr.rhs && readsSlot(*expr.rhs, slot));
+        case ExprKind::CHANNEL:
+            return readsSlot(*expr.rhs, slot);
+    }
+    return false;
+}
+
+// `x = x op a op b ...` evaluates left to right starting from x, so it can be
+// run as `x op= a; x op= b; ...` as long as none of the operands read x.
+bool Resolver::canAssignInPlace(const Expr& value, int slot) const {
+    const Expr* spine = &value;
+    if (spine->kind != ExprKind::BINARY) {
+        return false;
+    }
+    while (spine->kind == ExprKind::BINARY) {
+        if (!isArithmetic(spine->op) || readsSlot(*spine->rhs, slot)) {
+            return false;
+        }
+        spine = spine->lhs.get();
+    }
+    return spine->kind == ExprKind::VARIABLE && spine->slot == slot;
+}
+
+// The range and the reduction variables belong to the enclosing scope; the
+// loop variable and the body get a block of their own.
+void Resolver::resolveParallel(Stmt& stmt) {
+    resolveExpression(*stmt.expr);
+    resolveExpression(*stmt.index);
+    for (size_t i = 0; i < stmt.reductions.size(); ++i) {
+        ReductionClause& clause = stmt.reductions[i];
+        clause.slot = lookup(clause.name);
+        if (clause.slot == UNRESOLVED_SLOT) {
+            parallelError(stmt.line, "'" + clause.name + "' must be declared before the parallel loop that reduces into it");
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (stmt.reductions[j].slot == clause.slot) {
+                parallelError(stmt.line, "'" + clause.name + "' is reduced more than once");
+            }
+        }
+        // Writing the result back is a write in the enclosing loop, if any
+        checkParallelWrite(stmt.line, clause.name, clause.slot, nullptr, &clause);
+    }
+    if (lookup(stmt.name) != UNRESOLVED_SLOT) {
+        parallelError(stmt.line, "the parallel loop variable '" + stmt.name + "' is already a variable");
+    }
+
+    size_t block_start = next_slot;
+    pushScope();
+    stmt.slot = bind(stmt.name);
+    next_slot++; // end of the chunk, see Stmt::slot
+    if (next_slot > max_slots) max_slots = next_slot;
+    parallel_loops.push_back({ next_slot, stmt.slot, &stmt.reductions });
+    for (auto& body : stmt.body) {
+        resolveStatement(*body);
+    }
+    parallel_loops.pop_back();
+    popScope();
+    next_slot = block_start;
+}
+
+void Resolver::checkParallelBody(const Stmt& stmt) const {
+    switch (stmt.kind) {
+        case StmtKind::SHOW:
+            parallelError(stmt.line, "'show' cannot be used in a parallel loop");
+        case StmtKind::FUN_DECL:
+            parallelError(stmt.line, "functions cannot be declared in a parallel loop");
+        case StmtKind::RETURN:
+            parallelError(stmt.line, "'return' cannot be used in a parallel loop");
+        case StmtKind::SPAWN:
+            parallelError(stmt.line, "'spawn' cannot be used in a parallel loop");
+        default:
+            break;
+    }
+}
+
+// `x = x + a - b ...`, with no other operand reading x.
+static bool isSumUpdate(const Expr& value, int slot) {
+    const Expr* spine = &value;
+    if (spine->kind != ExprKind::BINARY) {
+        return false;
+    }
+    while (spine->kind == ExprKind::BINARY) {
+        if ((spine->op != TokenType::PLUS && spine->op != TokenType::MINUS) || readsSlot(*spine->rhs, slot)) {
+            return false;
+        }
+        spine = spine->lhs.get();
+    }
+    return spine->kind == ExprKind::VARIABLE && spine->slot == slot;
+}
+
+// Only the innermost loop matters: its floor is above every enclosing one's.
+// `value` is the assigned expression, null for changes to an array and for
+// the results of a nested loop, which reduces into the variable as `nested`.
+void Resolver::checkParallelWrite(uint32_t line, const std::string& name, int slot, const Expr* value,
+                                  const ReductionClause* nested) const {
+    if (parallel_loops.empty() || slot == UNRESOLVED_SLOT || static_cast<size_t>(slot) >= parallel_loops.back().floor) {
+        return;
+    }
+    const ParallelLoop& loop = parallel_loops.back();
+    if (slot == loop.index) {
+        parallelError(line, "the parallel loop variable '" + name + "' cannot be changed");
+    }
+    static const char* const kinds[] = { "sum", "min", "max" };
+    for (const auto& clause : *loop.reductions) {
+        if (clause.slot != slot) {
+            continue;
+        }
+        const char* kind = kinds[static_cast<int>(clause.kind)];
+        if (nested && nested->kind != clause.kind) {
+            parallelError(line, "'" + name + "' is a " + kind + " reduction, so a nested loop can only reduce into it with '"
+                          + kind + " " + name + "'");
+        }
+        if (!nested && clause.kind == Reduction::SUM && (!value || !isSumUpdate(*value, slot))) {
+            parallelError(line, "'" + name + "' is a sum reduction, so it can only be updated as '" + name + " = " + name + " + ...'");
+        }
+        return;
+    }
+    parallelError(line, "'" + name + "' is declared outside the parallel loop, so it is read-only there;"
+                  " reduce into it with 'sum " + name + "', 'min " + name + "' or 'max " + name + "'");
+}
+
+void Resolver::resolveCall(Expr& call) {
+    auto found = function_indices.find(call.name);
+    if (found == function_indices.end() || found->second == DYNAMIC_FUNCTION || !declared[found->second]) {
+        call.call_site = static_cast<uint32_t>(program.call_sites++);
+        return;
+    }
+    const std::vector<ParameterSignature>& parameters = signatures[found->second];
+    call.function = found->second;
+    call.bindings.assign(parameters.size(), MISSING_ARGUMENT);
+    call.in_order = call.args.size() == parameters.size();
+
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        const ParameterSignature& param = parameters[i];
+        // The last argument with a matching name wins
+        for (size_t a = call.args.size(); a-- > 0;) {
+            if (call.args[a].name == param.name) {
+                call.bindings[i] = static_cast<int>(a);
+                break;
+            }
+        }
+        if (call.bindings[i] == MISSING_ARGUMENT && param.has_default_value) {
+            call.bindings[i] = DEFAULT_ARGUMENT;
+        }
+        if (call.bindings[i] != static_cast<int>(i)) {
+            call.in_order = false;
+        }
+    }
+}
+
+bool Resolver::isPureExpression(const Expr& expr, size_t self) const {
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+        case ExprKind::VARIABLE:
+            return true;
+        case ExprKind::BINARY:
+            return isPureExpression(*expr.lhs, self) && isPureExpression(*expr.rhs, self);
+        case ExprKind::CALL:
+            if (expr.function == DYNAMIC_FUNCTION || (expr.function != self && !pure[expr.function])) {
+                return false;
+            }
+            for (const auto& arg : expr.args) {
+                if (!isPureExpression(*arg.value, self)) return false;
+            }
+            return true;
+        case ExprKind::ARRAY:
+            for (const auto& element : expr.elements) {
+                if (!isPureExpression(*element, self)) return false;
+            }
+            return true;
+        case ExprKind::INDEX:
+        case ExprKind::METHOD:
+            if (expr.kind == ExprKind::METHOD && (expr.method == Method::SEND || expr.method == Method::RECEIVE)) {
+                return false;
+            }
+            return isPureExpression(*expr.lhs, self) && (!expr.rhs || isPureExpression(*expr.rhs, self));
+        case ExprKind::CHANNEL:
+            return false; // a new channel every time
+    }
+    return false;
+}
+
+bool Resolver::isPureBlock(const std::vector<StmtPtr>& body, size_t self) const {
+    for (const auto& stmt : body) {
+        switch (stmt->kind) {
+            case StmtKind::SHOW:
+            case StmtKind::FUN_DECL:
+            case StmtKind::SPAWN:
+                return false;
+            case StmtKind::IF:
+                if (!isPureBlock(stmt->else_body, self)) return false;
+                break;
+            default:
+                break;
+        }
+        if ((stmt->expr && !isPureExpression(*stmt->expr, self)) || (stmt->index && !isPureExpression(*stmt->index, self))
+            || !isPureBlock(stmt->body, self)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Resolver::isPureFunction(const FunctionDecl& function, size_t self) const {
+    for (const auto& param : function.parameters) {
+        // Other defaults are evaluated where the declaration runs and may differ each time
+        if (param.default_value && param.default_value->kind != ExprKind::LITERAL) {
+            return false;
+        }
+    }
+    return isPureBlock(function.body, self);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ast.hpp"
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+// Assigns every local variable and parameter a fixed slot in its function's
+// frame. Blocks only exist at resolve time: a name declared in a block is
+// visible until the block ends and its slot is then reused by later blocks.
+//
+// Nova has no shadowing inside a function. A declaration or assignment of a
+// name that is already visible writes to that variable; otherwise it creates
+// a new one in the innermost block. Reads that no declaration reaches keep
+// UNRESOLVED_SLOT and fail at runtime with "Undefined variable".
+// Program::inputs are declared before the first statement.
+//
+// Calls to a function name declared exactly once are bound to that
+// declaration here, including which argument feeds each parameter, as long
+// as the declaration precedes the call in the source.
+//
+// A function is marked pure when its body has no `show`, `spawn`, channel
+// operations or nested declarations, every call in it is bound to itself or
+// to an earlier pure function, and its default values are literals. Since functions only see
+// their own parameters and locals, a pure call's result depends on nothing
+// but its arguments, and the engines may memoize it.
+//
+// The body of a `parallel` loop runs on several threads at once, so it may
+// only read the variables declared outside it, except those it names as
+// reductions; the loop variable is read-only too. It cannot `show`, declare
+// functions, return, spawn or use channels, and may only call pure
+// functions. A `sum` variable can only be updated as `x = x + ...`, since
+// every chunk adds up its own part starting from zero.
+class Resolver {
+public:
+    explicit Resolver(Program& program);
+    void resolve();
+
+    // Streaming use: resolve top-level statements as they are parsed, then
+    // finish() to record the script's frame size.
+    void resolveTopLevel(Stmt& stmt);
+    void finish();
+
+private:
+    struct ParameterSignature {
+        std::string name;
+        bool has_default_value;
+    };
+
+    // A `parallel` loop being resolved: slots below `floor` are outside it.
+    struct ParallelLoop {
+        size_t floor;
+        int index;
+        const std::vector<ReductionClause>* reductions;
+    };
+
+    Program& program;
+    std::vector<std::vector<ParameterSignature>> signatures; // by function index, once declared
+    std::vector<bool> declared;
+    std::vector<bool> pure;
+    std::vector<std::unordered_map<std::string, int>> scopes; // the first open_scopes are open, innermost last
+    size_t open_scopes = 0;
+    size_t function_scope = 0; // first scope the function being resolved sees
+    std::unordered_map<std::string, size_t> function_indices; // DYNAMIC_FUNCTION when redeclared
+    size_t next_slot = 0;
+    size_t max_slots = 0;
+    std::vector<ParallelLoop> parallel_loops; // innermost last
+
+    void pushScope();
+    void popScope();
+    int lookup(const std::string& name) const;
+    int bind(const std::string& name);
+    void resolveFunction(FunctionDecl& function);
+    void resolveBlock(std::vector<StmtPtr>& body);
+    void resolveStatement(Stmt& stmt);
+    void resolveExpression(Expr& expr);
+    void resolveCall(Expr& call);
+    void resolveParallel(Stmt& stmt);
+    void checkParallelBody(const Stmt& stmt) const;
+    void checkParallelWrite(uint32_t line, const std::string& name, int slot, const Expr* value,
+                            const ReductionClause* nested) const;
+    bool canAssignInPlace(const Expr& value, int slot) const;
+    bool isPureExpression(const Expr& expr, size_t self) const;
+    bool isPureBlock(const std::vector<StmtPtr>& body, size_t self) const;
+    bool isPureFunction(const FunctionDecl& function, size_t self) const;
+};
@@ -0,0 +1,551 @@
+#include "server.hpp"
+#include "driver.hpp"
+#include "program_cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Longest request accepted: the working directory and the arguments.
+static const uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+// How long a client may take to send its request.
+static const int REQUEST_TIMEOUT_SECONDS = 5;
+
+static bool socketAddress(const std::string& path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static int connectTo(const std::string& path) {
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = read(fd, data, size);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// A client whose request is still coming in. A request is the size of its
+// payload, sent along with the client's stdout and stderr, then the
+// payload: the working directory and the arguments, each ended by a NUL.
+struct PendingClient {
+    int descriptors[2]; // stdout and stderr, -1 until received
+    std::string request; // as far as received
+    std::chrono::steady_clock::time_point deadline;
+};
+
+enum class RequestState { INCOMPLETE, COMPLETE, INVALID };
+
+// Reads what has arrived of a request without waiting for more.
+static RequestState readRequest(int fd, PendingClient& client) {
+    uint32_t size = 0;
+    size_t wanted = sizeof(size) - client.request.size();
+    if (client.request.size() >= sizeof(size)) {
+        std::memcpy(&size, client.request.data(), sizeof(size));
+        wanted = sizeof(size) + size - client.request.size();
+    }
+    char data[4096];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    iovec part;
+    part.iov_base = data;
+    part.iov_len = std::min(wanted, sizeof(data));
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received = recvmsg(fd, &message, 0);
+    if (received < 0) {
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ? RequestState::INCOMPLETE : RequestState::INVALID;
+    }
+    // The descriptors come with the first bytes, and only then
+    bool valid = received > 0 && !(message.msg_flags & MSG_CTRUNC);
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        bool expected = count == 2 && client.request.empty() && client.descriptors[0] < 0;
+        for (size_t k = 0; k < count; ++k) {
+            int descriptor;
+            std::memcpy(&descriptor, CMSG_DATA(header) + k * sizeof(int), sizeof(int));
+            if (expected) {
+                client.descriptors[k] = descriptor;
+            } else {
+                close(descriptor);
+            }
+        }
+        valid = valid && expected;
+    }
+    if (!valid || client.descriptors[0] < 0) {
+        return RequestState::INVALID;
+    }
+    client.request.append(data, static_cast<size_t>(received));
+    if (client.request.size() < sizeof(size)) {
+        return RequestState::INCOMPLETE;
+    }
+    std::memcpy(&size, client.request.data(), sizeof(size));
+    if (size > MAX_REQUEST_SIZE) {
+        return RequestState::INVALID;
+    }
+    return client.request.size() == sizeof(size) + size ? RequestState::COMPLETE : RequestState::INCOMPLETE;
+}
+
+// The working directory and the arguments of a complete request.
+static bool requestFields(const std::string& request, std::vector<std::string>& fields) {
+    size_t start = sizeof(uint32_t);
+    for (size_t end; (end = request.find('\0', start)) != std::string::npos; start = end + 1) {
+        fields.push_back(request.substr(start, end - start));
+    }
+    return !fields.empty() && start == request.size();
+}
+
+// Runs a request in the forked child and returns the exit status.
+static int runRequest(const std::vector<std::string>& fields, const int descriptors[2], LoadedPrograms& programs) {
+    FILE* out = fdopen(descriptors[0], "w");
+    FILE* err = fdopen(descriptors[1], "w");
+    int status = 1;
+    if (out && err) {
+        RunOptions options;
+        std::vector<std::string> args(fields.begin() + 1, fields.end());
+        if (!parseRunOptions(args, options)) {
+            printUsage(out);
+        } else {
+            options.resolvePaths(fields[0]);
+            try {
+                status = runCommand(options, out, err, &programs);
+            } catch (const std::exception& e) {
+                std::fprintf(err, "Error: %s\n", e.what());
+            }
+        }
+    }
+    if (out) {
+        std::fclose(out);
+    }
+    if (err) {
+        std::fclose(err);
+    }
+    return status;
+}
+
+// The path of the program a request runs from the daemon's programs, or
+// an empty string if it runs from the source.
+static std::string loadedPath(const std::vector<std::string>& fields) {
+    RunOptions options;
+    std::vector<std::string> args(fields.begin() + 1, fields.end());
+    if (!parseRunOptions(args, options) || !usesLoadedPrograms(options)) {
+        return std::string();
+    }
+    options.resolvePaths(fields[0]);
+    return options.path;
+}
+
+// Compiles the program at `path` in the child and writes it to `fd` for the
+// daemon to keep. Errors are left for the run to report.
+static void sendProgram(const std::string& path, int fd, LoadedPrograms& programs) {
+    std::string error;
+    try {
+        std::shared_ptr<const CompiledProgram> program = programs.load(path, error);
+        if (program) {
+            std::vector<uint8_t> bytes = encodeProgram(0, *program);
+            writeAll(fd, reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        }
+    } catch (const std::exception&) {
+    }
+    close(fd);
+}
+
+// A client whose run is going on in a child process: its socket, to send
+// the exit status on, and its stderr, to report a crash on.
+struct RunningClient {
+    int socket;
+    int err;
+};
+
+// A program a child compiles for the daemon: the file's stamp from before
+// the child read it, and the bytes received so far from the child's pipe.
+struct CompilingProgram {
+    std::string path;
+    int64_t modified;
+    int64_t size;
+    std::vector<uint8_t> bytes;
+};
+
+// Everything the daemon waits on. It stays on one thread, so it can fork at
+// any time, and never blocks on a client: requests are read as they come
+// and programs are compiled in the children.
+struct Daemon {
+    int listener;
+    int wakeup[2];
+    LoadedPrograms programs;
+    std::unordered_map<int, PendingClient> pending;         // by socket
+    std::unordered_map<pid_t, RunningClient> running;       // by child
+    std::unordered_map<int, CompilingProgram> compiling;    // by read end of the child's pipe
+};
+
+static void finishClient(const RunningClient& client, int32_t status) {
+    writeAll(client.socket, reinterpret_cast<const char*>(&status), sizeof(status));
+    close(client.socket);
+    close(client.err);
+}
+
+static void dropClient(int fd, PendingClient& client) {
+    for (int descriptor : client.descriptors) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+    close(fd);
+}
+
+// Forks a child to run a complete request. A run that crashes, or runs out
+// of memory, takes only its child with it. If the daemon does not have the
+// program yet, the child compiles it and sends it back before running it.
+static void startRun(Daemon& daemon, int fd, PendingClient& client) {
+    std::vector<std::string> fields;
+    if (!requestFields(client.request, fields)) {
+        dropClient(fd, client);
+        return;
+    }
+    std::string path = loadedPath(fields);
+    CompilingProgram compiled;
+    int result[2] = { -1, -1 };
+    if (!path.empty() && !daemon.programs.has(path) && LoadedPrograms::stamp(path, compiled.modified, compiled.size)
+        && pipe(result) == 0) {
+        compiled.path = path;
+        fcntl(result[0], F_SETFL, fcntl(result[0], F_GETFL) | O_NONBLOCK);
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(daemon.listener);
+        close(daemon.wakeup[0]);
+        close(daemon.wakeup[1]);
+        std::signal(SIGCHLD, SIG_DFL);
+        close(fd);
+        for (auto& other : daemon.pending) {
+            if (other.first != fd) {
+                dropClient(other.first, other.second);
+            }
+        }
+        for (auto& other : daemon.compiling) {
+            close(other.first);
+        }
+        if (result[0] >= 0) {
+            close(result[0]);
+            sendProgram(path, result[1], daemon.programs);
+        }
+        _exit(runRequest(fields, client.descriptors, daemon.programs));
+    }
+    close(client.descriptors[0]);
+    RunningClient running = { fd, client.descriptors[1] };
+    if (result[0] >= 0) {
+        close(result[1]);
+        if (child < 0) {
+            close(result[0]);
+        } else {
+            daemon.compiling[result[0]] = std::move(compiled);
+        }
+    }
+    // Only the exit status is left to send, which fits the socket's buffer
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    if (child < 0) {
+        dprintf(running.err, "Error: cannot start the run: %s\n", std::strerror(errno));
+        finishClient(running, 1);
+        return;
+    }
+    daemon.running[child] = running;
+}
+
+// Reads what a child sent of the program it compiled, and keeps the program
+// once the child closes its pipe.
+static void receiveProgram(Daemon& daemon, int fd) {
+    CompilingProgram& program = daemon.compiling[fd];
+    char data[65536];
+    ssize_t received;
+    while ((received = read(fd, data, sizeof(data))) > 0) {
+        program.bytes.insert(program.bytes.end(), data, data + received);
+    }
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    std::shared_ptr<CompiledProgram> decoded = std::make_shared<CompiledProgram>();
+    if (received == 0 && decodeProgram(program.bytes.data(), program.bytes.size(), 0, *decoded)) {
+        daemon.programs.store(program.path, program.modified, program.size, decoded);
+    }
+    close(fd);
+    daemon.compiling.erase(fd);
+}
+
+// Sends each client whose child ended its exit status, like a shell would
+// give it: 128 plus the signal number for a child that was killed.
+static void reapChildren(std::unordered_map<pid_t, RunningClient>& running) {
+    int result;
+    pid_t child;
+    while ((child = waitpid(-1, &result, WNOHANG)) > 0) {
+        auto found = running.find(child);
+        if (found == running.end()) {
+            continue;
+        }
+        int32_t status = 1;
+        if (WIFEXITED(result)) {
+            status = WEXITSTATUS(result);
+        } else if (WIFSIGNALED(result)) {
+            int signal = WTERMSIG(result);
+            dprintf(found->second.err, "Error: the run was killed by signal %d (%s)\n", signal, strsignal(signal));
+            status = 128 + signal;
+        }
+        finishClient(found->second, status);
+        running.erase(found);
+    }
+}
+
+// Write end of the pipe that wakes the daemon when a child exits.
+static int child_exited = -1;
+
+static void onChildExit(int) {
+    int saved = errno;
+    ssize_t ignored = write(child_exited, "x", 1);
+    (void)ignored;
+    errno = saved;
+}
+
+int serve(const std::string& socket_path) {
+    // A client that goes away must not take the daemon with it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address;
+    if (!socketAddress(socket_path, address)) {
+        std::fprintf(stderr, "Error: socket path '%s' is too long\n", socket_path.c_str());
+        return 1;
+    }
+    int running_server = connectTo(socket_path);
+    if (running_server >= 0) {
+        close(running_server);
+        std::fprintf(stderr, "Error: a server is already listening on '%s'\n", socket_path.c_str());
+        return 1;
+    }
+    unlink(socket_path.c_str()); // left behind by a server that stopped
+    Daemon daemon;
+    daemon.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (daemon.listener < 0 || bind(daemon.listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(daemon.listener, SOMAXCONN) != 0) {
+        std::fprintf(stderr, "Error: cannot listen on '%s': %s\n", socket_path.c_str(), std::strerror(errno));
+        return 1;
+    }
+    if (pipe(daemon.wakeup) != 0) {
+        std::fprintf(stderr, "Error: cannot create a pipe: %s\n", std::strerror(errno));
+        return 1;
+    }
+    for (int fd : { daemon.listener, daemon.wakeup[0], daemon.wakeup[1] }) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    child_exited = daemon.wakeup[1];
+    std::signal(SIGCHLD, onChildExit);
+
+    std::vector<pollfd> events;
+    for (;;) {
+        // Clients that stop halfway through their request are dropped
+        auto now = std::chrono::steady_clock::now();
+        int timeout = -1;
+        for (auto it = daemon.pending.begin(); it != daemon.pending.end();) {
+            if (it->second.deadline <= now) {
+                dropClient(it->first, it->second);
+                it = daemon.pending.erase(it);
+                continue;
+            }
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(it->second.deadline - now).count() + 1;
+            timeout = timeout < 0 ? static_cast<int>(left) : std::min(timeout, static_cast<int>(left));
+            ++it;
+        }
+
+        events.clear();
+        events.push_back(pollfd{ daemon.listener, POLLIN, 0 });
+        events.push_back(pollfd{ daemon.wakeup[0], POLLIN, 0 });
+        for (const auto& client : daemon.pending) {
+            events.push_back(pollfd{ client.first, POLLIN, 0 });
+        }
+        for (const auto& program : daemon.compiling) {
+            events.push_back(pollfd{ program.first, POLLIN, 0 });
+        }
+        if (poll(events.data(), events.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::fprintf(stderr, "Error: cannot wait for clients: %s\n", std::strerror(errno));
+            return 1;
+        }
+        for (size_t i = 2; i < events.size(); ++i) {
+            if (!events[i].revents) {
+                continue;
+            }
+            int fd = events[i].fd;
+            auto client = daemon.pending.find(fd);
+            if (client == daemon.pending.end()) {
+                receiveProgram(daemon, fd);
+                continue;
+            }
+            RequestState state = readRequest(fd, client->second);
+            if (state == RequestState::INCOMPLETE) {
+                continue;
+            }
+            if (state == RequestState::COMPLETE) {
+                startRun(daemon, fd, client->second);
+            } else {
+                dropClient(fd, client->second);
+            }
+            daemon.pending.erase(client);
+        }
+        if (events[1].revents) {
+            char drained[64];
+            while (read(daemon.wakeup[0], drained, sizeof(drained)) > 0) {
+            }
+            reapChildren(daemon.running);
+        }
+        if (events[0].revents) {
+            int client = accept(daemon.listener, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED
+                    || errno == EMFILE || errno == ENFILE) {
+                    continue;
+                }
+                std::fprintf(stderr, "Error: cannot accept clients on '%s': %s\n", socket_path.c_str(), std::strerror(errno));
+                return 1;
+            }
+            // Not inherited from the listener everywhere
+            fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+            PendingClient& pending = daemon.pending[client];
+            pending.descriptors[0] = -1;
+            pending.descriptors[1] = -1;
+            pending.deadline = std::chrono::steady_clock::now() + std::chrono::seconds(REQUEST_TIMEOUT_SECONDS);
+        }
+    }
+}
+
+int runClient(const std::string& socket_path, const std::vector<std::string>& args) {
+    int fd = connectTo(socket_path);
+    if (fd < 0) {
+        std::fprintf(stderr, "Error: cannot connect to '%s': %s\n", socket_path.c_str(), std::strerror(errno));
+        return 1;
+    }
+    char directory[PATH_MAX];
+    if (!getcwd(directory, sizeof(directory))) {
+        std::fprintf(stderr, "Error: cannot find the working directory: %s\n", std::strerror(errno));
+        close(fd);
+        return 1;
+    }
+    std::string payload(directory, std::strlen(directory) + 1);
+    for (const std::string& arg : args) {
+        payload.append(arg.c_str(), arg.size() + 1);
+    }
+    uint32_t size = static_cast<uint32_t>(payload.size());
+
+    std::fflush(stdout);
+    int descriptors[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(descriptors))];
+    std::memset(control, 0, sizeof(control));
+    iovec part;
+    part.iov_base = &size;
+    part.iov_len = sizeof(size);
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(descriptors));
+    std::memcpy(CMSG_DATA(header), descriptors, sizeof(descriptors));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+    int32_t status = 1;
+    if (sent < 0 || !writeAll(fd, reinterpret_cast<const char*>(&size) + sent, sizeof(size) - static_cast<size_t>(sent))
+        || !writeAll(fd, payload.data(), payload.size())
+        || !readAll(fd, reinterpret_cast<char*>(&status), sizeof(status))) {
+        std::fprintf(stderr, "Error: lost the connection to '%s'\n", socket_path.c_str());
+        status = 1;
+    }
+    close(fd);
+    return status;
+}
+
+#else
+
+int serve(const std::string&) {
+    std::fprintf(stderr, "Error: --serve needs Unix domain sockets, which this platform lacks\n");
+    return 1;
+}
+
+int runClient(const std::string&, const std::vector<std::string>&) {
+    std::fprintf(stderr, "Error: --client needs Unix domain sockets, which this platform lacks\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// `supernova --serve <socket>` is a daemon that keeps compiled programs in
+// memory and runs command lines sent over a Unix domain socket by
+// `supernova --client <socket> ...`, so that scripts run over and over skip
+// lexing, parsing and compiling. For each request the daemon forks a child
+// process that runs it with its own VM, memo cache, thread pool and output,
+// so a run that crashes takes nothing else with it. A child that finds no
+// program for its script compiles it and sends the bytecode back for the
+// daemon to keep. The daemon itself stays on one thread and never blocks on
+// a client: requests are read from its poll loop as they arrive.
+//
+// A client sends its working directory and command line, and passes its
+// stdout and stderr descriptors along, so the daemon writes to them
+// directly and output streams as the program runs. The daemon answers
+// with the exit status once the run is over.
+
+// Listens on `socket_path` until killed and returns 1 if it cannot.
+int serve(const std::string& socket_path);
+
+// Runs `args` as a command line in the daemon at `socket_path` and returns
+// its exit status.
+int runClient(const std::string& socket_path, const std::vector<std::string>& args);
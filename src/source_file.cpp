@@ -0,0 +1,91 @@
+#include "source_file.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::~SourceFile() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char*>(bytes), length);
+    }
+#endif
+}
+
+#ifdef _WIN32
+
+bool SourceFile::open(const std::string& path, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open '" + path + "'";
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    bytes = contents.data();
+    length = contents.size();
+    return true;
+}
+
+#else
+
+bool SourceFile::open(const std::string& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open '" + path + "': " + std::strerror(errno);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = "cannot read '" + path + "': " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    if (S_ISDIR(info.st_mode)) {
+        error = "cannot read '" + path + "': " + std::strerror(EISDIR);
+        ::close(fd);
+        return false;
+    }
+
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(address);
+            length = static_cast<size_t>(info.st_size);
+            mapped = true;
+            ::close(fd);
+            return true;
+        }
+    }
+
+    // Not mappable (empty, pipe, device): read it instead
+    char buffer[65536];
+    for (;;) {
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count == 0) break;
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            error = "cannot read '" + path + "': " + std::strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        contents.append(buffer, static_cast<size_t>(count));
+    }
+    ::close(fd);
+    bytes = contents.data();
+    length = contents.size();
+    return true;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only contents of a Nova source file. On POSIX systems the file is
+// memory-mapped and lexed in place; elsewhere, and for inputs that cannot be
+// mapped (pipes, character devices), it is read into memory once.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Returns false and describes the problem in `error` if the file cannot be read.
+    bool open(const std::string& path, std::string& error);
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = "";
+    size_t length = 0;
+    bool mapped = false;
+    std::string contents; // used when the file is not mapped
+};
@@ -0,0 +1,209 @@
+#include "tasks.hpp"
+#include "error.hpp"
+
+// Finished tasks kept for reuse(); more are deleted.
+static const size_t MAX_FINISHED_TASKS = 256;
+
+Value makeChannel(const Value& capacity) {
+    if (capacity.type != ValueType::NUMBER || capacity.i_value < 1) {
+        throw RuntimeError("The capacity of a channel must be a num of at least 1.");
+    }
+    return Value(new ChannelObject(static_cast<size_t>(capacity.i_value)));
+}
+
+static ChannelObject& channelOf(const Value& value, const char* error) {
+    if (value.type != ValueType::CHANNEL) {
+        throw RuntimeError(error);
+    }
+    return *value.channel_object;
+}
+
+// Wakes the first task of `waiting`, if any; the caller holds the channel's lock.
+static void wakeFirst(std::deque<Task*>& waiting) {
+    if (!waiting.empty()) {
+        Task* task = waiting.front();
+        waiting.pop_front();
+        task->scheduler->wake(task);
+    }
+}
+
+bool trySend(const Value& channel, Value& item) {
+    ChannelObject& target = channelOf(channel, "Can only send to a channel.");
+    std::lock_guard<std::mutex> lock(target.mutex);
+    if (target.items.size() >= target.capacity) {
+        return false;
+    }
+    target.items.push_back(std::move(item));
+    wakeFirst(target.receivers);
+    return true;
+}
+
+bool tryReceive(const Value& channel, Value& item) {
+    ChannelObject& source = channelOf(channel, "Can only receive from a channel.");
+    std::lock_guard<std::mutex> lock(source.mutex);
+    if (source.items.empty()) {
+        return false;
+    }
+    item = std::move(source.items.front());
+    source.items.pop_front();
+    wakeFirst(source.senders);
+    return true;
+}
+
+void TaskStats::print(FILE* stream) const {
+    std::fprintf(stream, "Tasks: %llu spawned, %llu finished, %llu switches, peak run queue %zu\n",
+                 static_cast<unsigned long long>(spawned), static_cast<unsigned long long>(finished),
+                 static_cast<unsigned long long>(switches), peak_queue);
+}
+
+Scheduler::Scheduler(ThreadPool* pool, TaskStats& stats) : pool(pool), stats(stats) {}
+
+Scheduler::~Scheduler() {
+    while (Task* task = tasks) {
+        tasks = task->next;
+        delete task;
+    }
+    for (Task* task : finished_tasks) {
+        delete task;
+    }
+}
+
+void Scheduler::spawn(Task* task) {
+    task->scheduler = this;
+    std::lock_guard<std::mutex> lock(mutex);
+    link(task);
+    stats.spawned++;
+    enqueue(task);
+}
+
+Task* Scheduler::reuse() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished_tasks.empty()) {
+        return nullptr;
+    }
+    Task* task = finished_tasks.back();
+    finished_tasks.pop_back();
+    return task;
+}
+
+void Scheduler::wake(Task* task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    enqueue(task);
+}
+
+// The caller holds the lock, as for the two below.
+void Scheduler::link(Task* task) {
+    task->previous = nullptr;
+    task->next = tasks;
+    if (tasks) {
+        tasks->previous = task;
+    }
+    tasks = task;
+}
+
+void Scheduler::unlink(Task* task) {
+    (task->previous ? task->previous->next : tasks) = task->next;
+    if (task->next) {
+        task->next->previous = task->previous;
+    }
+}
+
+void Scheduler::enqueue(Task* task) {
+    ready.push_back(task);
+    if (ready.size() > stats.peak_queue) {
+        stats.peak_queue = ready.size();
+    }
+    changed.notify_one();
+}
+
+void Scheduler::run(Task* first, const Runner& runner) {
+    first->scheduler = this;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        main = first;
+        link(first);
+        ready.push_front(first);
+    }
+    if (pool && pool->size() > 1) {
+        pool->run(pool->size(), [&](size_t worker, size_t) { work(worker, runner); });
+    } else {
+        work(0, runner);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void Scheduler::work(size_t worker, const Runner& runner) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        changed.wait(lock, [this] { return stopped || !ready.empty(); });
+        if (stopped) {
+            return;
+        }
+        Task* task = ready.front();
+        ready.pop_front();
+        running++;
+        stats.switches++;
+        lock.unlock();
+
+        std::exception_ptr failure;
+        try {
+            runner(worker, *task);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+        // Parked before it stops counting as running, so that no other
+        // thread takes the program for deadlocked in between. Once parked,
+        // another thread may be running it already.
+        bool finished = !failure && !task->waiting_for;
+        if (!failure && !finished) {
+            park(task);
+        }
+
+        lock.lock();
+        running--;
+        if (failure) {
+            if (!error) {
+                error = failure;
+            }
+            stopped = true;
+        } else if (finished) {
+            if (task == main) {
+                main = nullptr;
+            } else {
+                stats.finished++;
+            }
+            unlink(task);
+            if (finished_tasks.size() < MAX_FINISHED_TASKS) {
+                finished_tasks.push_back(task);
+            } else {
+                delete task;
+            }
+        }
+        if (!stopped && ready.empty() && running == 0) {
+            // Nothing can wake the tasks still waiting
+            if (main && !error) {
+                error = std::make_exception_ptr(RuntimeError(DEADLOCK_ERROR));
+            }
+            stopped = true;
+        }
+        if (stopped) {
+            changed.notify_all();
+        }
+    }
+}
+
+// Files a task that stopped to wait under its channel, unless the channel
+// changed since and the task can go on right away.
+void Scheduler::park(Task* task) {
+    ChannelObject& channel = *task->waiting_for;
+    std::unique_lock<std::mutex> channel_lock(channel.mutex);
+    bool can_go_on = task->sending ? channel.items.size() < channel.capacity : !channel.items.empty();
+    if (!can_go_on) {
+        (task->sending ? channel.senders : channel.receivers).push_back(task);
+        return;
+    }
+    channel_lock.unlock();
+    wake(task);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "parallel.hpp"
+#include "value.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Tasks started by `spawn` and the bounded channels they talk through.
+//
+// Tasks are scheduled cooperatively: a task runs until it finishes or has to
+// wait, to receive from an empty channel or to send to a full one, and its
+// thread then takes the next ready task. Engines keep everything a task needs
+// to resume (its value stack and frames) in its Task, so a waiting task holds
+// no native stack and costs little more than its locals. Ready tasks start
+// and resume in the order they became ready.
+
+class Scheduler;
+
+// Raised when a task waits on a channel and no other task could ever wake it.
+const char* const DEADLOCK_ERROR = "Deadlock: every task is waiting on a channel.";
+
+// One task as the Scheduler sees it; engines derive their task state from it.
+struct Task {
+    Scheduler* scheduler = nullptr;
+    // Set by the engine when the task stops: the channel it waits for, or
+    // null once it finished
+    ChannelObject* waiting_for = nullptr;
+    bool sending = false; // waits for room rather than for an item
+    Task* previous = nullptr; // neighbours in the Scheduler's list of tasks
+    Task* next = nullptr;
+
+    virtual ~Task() {}
+};
+
+// `channel(capacity)`: raises unless the capacity is a num of at least 1.
+Value makeChannel(const Value& capacity);
+
+// Sends `item` and wakes a task waiting to receive, unless the channel is
+// full; then returns false and leaves `item` alone.
+bool trySend(const Value& channel, Value& item);
+
+// Takes the oldest item into `item` and wakes a task waiting to send, unless
+// the channel is empty; then returns false.
+bool tryReceive(const Value& channel, Value& item);
+
+// What `--task-stats` prints.
+struct TaskStats {
+    uint64_t spawned = 0;
+    uint64_t finished = 0; // spawned tasks that ran to their end
+    uint64_t switches = 0; // times a thread started or resumed a task
+    size_t peak_queue = 0; // most tasks ready to run but waiting for a thread
+
+    void print(FILE* stream) const;
+};
+
+// Runs the tasks of one program on the threads of a pool, or on the calling
+// thread without one.
+class Scheduler {
+public:
+    // Starts or resumes `task` on pool worker `worker` and returns once it
+    // finished or has to wait, see Task::waiting_for.
+    typedef std::function<void(size_t worker, Task& task)> Runner;
+
+    Scheduler(ThreadPool* pool, TaskStats& stats);
+    ~Scheduler(); // deletes the tasks left waiting and those kept for reuse()
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    size_t workers() const { return parallelWorkers(pool); }
+
+    // Queues a new task and takes ownership of it; any thread may call it.
+    void spawn(Task* task);
+    // A task that finished, for the engine to reset and spawn again instead
+    // of allocating a new one, or null; any thread may call it.
+    Task* reuse();
+    // Makes a task that waited on a channel ready again.
+    void wake(Task* task);
+
+    // Runs tasks, starting with `main`, until `main` finished and no other
+    // task can go on; tasks still waiting then are dropped. Raises the first
+    // error of any task, and a deadlock error when `main` waits and no task
+    // can run.
+    void run(Task* main, const Runner& runner);
+
+private:
+    ThreadPool* pool;
+    TaskStats& stats;
+    std::mutex mutex; // guards the fields below
+    std::condition_variable changed;
+    std::deque<Task*> ready;
+    Task* tasks = nullptr; // every task not finished yet, linked through Task::next
+    std::vector<Task*> finished_tasks; // kept for reuse()
+    Task* main = nullptr;
+    size_t running = 0;
+    bool stopped = false;
+    std::exception_ptr error;
+
+    void enqueue(Task* task);
+    void link(Task* task);
+    void unlink(Task* task);
+    void work(size_t worker, const Runner& runner);
+    void park(Task* task);
+};
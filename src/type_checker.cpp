@@ -0,0 +1,582 @@
+#include "type_checker.hpp"
+#include <algorithm>
+
+static StaticType join(StaticType a, StaticType b) {
+    return a == b ? a : StaticType::DYNAMIC;
+}
+
+static bool isNumeric(StaticType type) {
+    return type == StaticType::NUM || type == StaticType::FLOAT;
+}
+
+static bool isArray(StaticType type) {
+    return type == StaticType::NUM_ARRAY || type == StaticType::FLOAT_ARRAY;
+}
+
+static StaticType elementType(StaticType array) {
+    return array == StaticType::NUM_ARRAY ? StaticType::NUM : StaticType::FLOAT;
+}
+
+static const char* typeName(StaticType type) {
+    switch (type) {
+        case StaticType::NUM: return "num";
+        case StaticType::FLOAT: return "float";
+        case StaticType::BOOL: return "bool";
+        case StaticType::STRING: return "string";
+        case StaticType::CHAR: return "char";
+        case StaticType::NUM_ARRAY: return "num[]";
+        case StaticType::FLOAT_ARRAY: return "float[]";
+        case StaticType::CHANNEL: return "channel";
+        default: return "value";
+    }
+}
+
+static const char* operatorName(TokenType op) {
+    switch (op) {
+        case TokenType::PLUS: return "+";
+        case TokenType::MINUS: return "-";
+        case TokenType::STAR: return "*";
+        case TokenType::SLASH: return "/";
+        case TokenType::EQUAL_EQUAL: return "==";
+        case TokenType::NOT_EQUAL: return "!=";
+        case TokenType::GREATER: return ">";
+        case TokenType::GREATER_EQUAL: return ">=";
+        case TokenType::LESS: return "<";
+        default: return "<=";
+    }
+}
+
+static StaticType literalType(const Value& value) {
+    switch (value.type) {
+        case ValueType::NUMBER: return StaticType::NUM;
+        case ValueType::FLOAT: return StaticType::FLOAT;
+        case ValueType::BOOLEAN: return StaticType::BOOL;
+        case ValueType::STRING: return StaticType::STRING;
+        case ValueType::CHAR: return StaticType::CHAR;
+        case ValueType::NONE:
+        case ValueType::ARRAY:
+        case ValueType::CHANNEL: return StaticType::DYNAMIC;
+    }
+    return StaticType::DYNAMIC;
+}
+
+// Type of every value convertForDeclaration returns for an annotation;
+// DYNAMIC for type names that are not keywords, which convert nothing.
+static StaticType keywordType(TokenType annotation) {
+    switch (annotation) {
+        case TokenType::KEYWORD_NUM: return StaticType::NUM;
+        case TokenType::KEYWORD_FLOAT: return StaticType::FLOAT;
+        case TokenType::KEYWORD_BOOL: return StaticType::BOOL;
+        case TokenType::KEYWORD_STRING: return StaticType::STRING;
+        case TokenType::KEYWORD_CHAR: return StaticType::CHAR;
+        case TokenType::KEYWORD_NUM_ARRAY: return StaticType::NUM_ARRAY;
+        case TokenType::KEYWORD_FLOAT_ARRAY: return StaticType::FLOAT_ARRAY;
+        case TokenType::KEYWORD_CHANNEL: return StaticType::CHANNEL;
+        default: return StaticType::DYNAMIC;
+    }
+}
+
+// Whether a value of `type` may be declared with `annotation`: nums and
+// floats convert into each other, and so do their arrays; everything else
+// must match.
+static bool convertible(TokenType annotation, StaticType type) {
+    StaticType declared = keywordType(annotation);
+    return declared == StaticType::DYNAMIC || type == StaticType::DYNAMIC || declared == type
+           || (isNumeric(declared) && isNumeric(type)) || (isArray(declared) && isArray(type));
+}
+
+static std::string article(StaticType type) {
+    return std::string(type == StaticType::DYNAMIC ? "" : "a ") + typeName(type);
+}
+
+static StaticType slotType(const std::vector<StaticType>& slots, int slot) {
+    return static_cast<size_t>(slot) < slots.size() ? slots[slot] : StaticType::DYNAMIC;
+}
+
+void TypeChecker::Flow::set(int slot, StaticType type) {
+    if (static_cast<size_t>(slot) >= slots.size()) {
+        slots.resize(slot + 1, StaticType::DYNAMIC);
+    }
+    if (open > 0) {
+        log.push_back(SlotType{ slot, slots[slot] });
+    }
+    slots[slot] = type;
+}
+
+size_t TypeChecker::Flow::begin() {
+    open++;
+    return log.size();
+}
+
+void TypeChecker::Flow::end() {
+    if (--open == 0) {
+        log.clear();
+    }
+}
+
+void TypeChecker::Flow::rollback(size_t start, std::vector<SlotType>& changes) {
+    changes.clear();
+    for (size_t i = start; i < log.size(); ++i) {
+        changes.push_back(SlotType{ log[i].slot, slots[log[i].slot] });
+    }
+    for (size_t i = log.size(); i > start; --i) {
+        slots[log[i - 1].slot] = log[i - 1].type;
+    }
+    log.resize(start);
+    std::sort(changes.begin(), changes.end(), [](const SlotType& a, const SlotType& b) { return a.slot < b.slot; });
+    changes.erase(std::unique(changes.begin(), changes.end(), [](const SlotType& a, const SlotType& b) {
+        return a.slot == b.slot;
+    }), changes.end());
+}
+
+TypeChecker::TypeChecker(Program& program) : program(program), signatures(program.function_names.size()) {
+    // Inputs are converted like declarations before the script starts
+    for (size_t i = 0; i < program.inputs.size(); ++i) {
+        script.set(static_cast<int>(i), keywordType(program.inputs[i].type));
+    }
+}
+
+void TypeChecker::check() {
+    for (auto& stmt : program.statements) {
+        checkTopLevel(*stmt);
+    }
+}
+
+void TypeChecker::checkTopLevel(Stmt& stmt) {
+    checkStatement(stmt, script);
+}
+
+void TypeChecker::error(uint32_t line, const std::string& message) {
+    std::string text = "Type error on line " + std::to_string(line) + ": " + message;
+    if (quiet == 0) {
+        throw RuntimeError(text);
+    }
+    if (pending.empty()) {
+        pending = text;
+    }
+}
+
+// Recursive calls are first assumed to have the annotated type. If the
+// returns disagree, the body is checked again assuming what they returned,
+// and finally with recursive calls DYNAMIC.
+void TypeChecker::checkFunction(size_t index, FunctionDecl& decl) {
+    Signature& signature = signatures[index];
+    signature.declared = true;
+    signature.parameters.clear();
+    for (const auto& param : decl.parameters) {
+        signature.parameters.push_back(param.type);
+    }
+
+    const FunctionDecl* enclosing = function;
+    StaticType enclosing_result = result;
+    bool enclosing_returned = returned;
+    std::string enclosing_pending;
+    enclosing_pending.swap(pending);
+    function = &decl;
+
+    quiet++;
+    StaticType assumed = keywordType(decl.return_type);
+    for (int pass = 0;; ++pass) {
+        signature.result = assumed;
+        pending.clear();
+        result = StaticType::DYNAMIC;
+        returned = false;
+        Flow flow;
+        flow.slots.assign(decl.slot_count, StaticType::DYNAMIC);
+        for (size_t i = 0; i < decl.parameters.size(); ++i) {
+            flow.slots[i] = keywordType(decl.parameters[i].type);
+        }
+        checkBlock(decl.body, flow);
+
+        StaticType found = flow.reachable || !returned ? StaticType::DYNAMIC : result;
+        if (found == assumed || assumed == StaticType::DYNAMIC) {
+            signature.result = found;
+            break;
+        }
+        assumed = pass == 0 ? found : StaticType::DYNAMIC;
+    }
+    quiet--;
+
+    function = enclosing;
+    result = enclosing_result;
+    returned = enclosing_returned;
+    if (!enclosing_pending.empty()) {
+        pending.swap(enclosing_pending);
+    }
+    if (quiet == 0 && !pending.empty()) {
+        throw RuntimeError(pending);
+    }
+}
+
+void TypeChecker::checkBlock(std::vector<StmtPtr>& body, Flow& flow) {
+    for (auto& stmt : body) {
+        checkStatement(*stmt, flow);
+    }
+}
+
+void TypeChecker::checkStatement(Stmt& stmt, Flow& flow) {
+    switch (stmt.kind) {
+        case StmtKind::SHOW:
+        case StmtKind::EXPRESSION:
+        case StmtKind::SPAWN:
+            checkExpression(*stmt.expr, flow);
+            break;
+        case StmtKind::VAR_DECL: {
+            StaticType value = checkExpression(*stmt.expr, flow);
+            if (!convertible(stmt.type, value)) {
+                error(stmt.line, "cannot store " + article(value) + " in '" + stmt.name + "', declared "
+                      + typeName(keywordType(stmt.type)));
+            }
+            StaticType declared = keywordType(stmt.type);
+            flow.set(stmt.slot, declared != StaticType::DYNAMIC ? declared : value);
+            break;
+        }
+        case StmtKind::ASSIGN:
+            flow.set(stmt.slot, checkExpression(*stmt.expr, flow));
+            break;
+        case StmtKind::IF: {
+            // Each branch starts from the types before the `if`; the slots
+            // either one set take the type after whichever can fall through
+            checkExpression(*stmt.expr, flow);
+            bool reachable = flow.reachable;
+            size_t start = flow.begin();
+            checkBlock(stmt.body, flow);
+            bool then_reachable = flow.reachable;
+            std::vector<SlotType> then_types;
+            flow.rollback(start, then_types);
+            flow.reachable = reachable;
+            checkBlock(stmt.else_body, flow);
+            bool else_reachable = flow.reachable;
+            std::vector<SlotType> else_types;
+            flow.rollback(start, else_types);
+            size_t t = 0;
+            size_t e = 0;
+            while (t < then_types.size() || e < else_types.size()) {
+                int slot = e == else_types.size() || (t < then_types.size() && then_types[t].slot < else_types[e].slot)
+                           ? then_types[t].slot : else_types[e].slot;
+                StaticType before = slotType(flow.slots, slot);
+                StaticType then_type = t < then_types.size() && then_types[t].slot == slot ? then_types[t++].type : before;
+                StaticType else_type = e < else_types.size() && else_types[e].slot == slot ? else_types[e++].type : before;
+                StaticType after = !then_reachable && else_reachable ? else_type
+                                   : then_reachable && else_reachable ? join(then_type, else_type) : then_type;
+                if (after != before) {
+                    flow.set(slot, after);
+                }
+            }
+            flow.reachable = then_reachable || else_reachable;
+            flow.end();
+            break;
+        }
+        case StmtKind::WHILE:
+            checkWhile(stmt, flow);
+            break;
+        case StmtKind::PARALLEL:
+            checkParallel(stmt, flow);
+            break;
+        case StmtKind::STORE_INDEX:
+        case StmtKind::APPEND: {
+            // The slot keeps its type: elements are converted to it
+            bool store = stmt.kind == StmtKind::STORE_INDEX;
+            if (store) {
+                checkIndex(*stmt.index, flow);
+            }
+            StaticType element = checkExpression(*stmt.expr, flow);
+            StaticType array = stmt.slot == UNRESOLVED_SLOT ? StaticType::DYNAMIC : slotType(flow.slots, stmt.slot);
+            if (array != StaticType::DYNAMIC && !isArray(array)) {
+                error(stmt.line, std::string(store ? "cannot index " : "cannot append to ") + article(array) + " '" + stmt.name + "'");
+            }
+            if (element != StaticType::DYNAMIC && !isNumeric(element)) {
+                error(stmt.expr->line, "cannot store " + article(element) + " in an array");
+            }
+            break;
+        }
+        case StmtKind::BLOCK:
+            checkBlock(stmt.body, flow);
+            break;
+        case StmtKind::FUN_DECL: {
+            FunctionDecl& decl = *program.functions[stmt.function];
+            for (auto& param : decl.parameters) {
+                if (!param.default_value) continue;
+                StaticType value = checkExpression(*param.default_value, flow);
+                if (!convertible(param.type, value)) {
+                    error(param.default_value->line, "cannot use " + article(value) + " as the default of '" + param.name
+                          + "' in '" + decl.name + "', declared " + typeName(keywordType(param.type)));
+                }
+            }
+            checkFunction(stmt.function, decl);
+            break;
+        }
+        case StmtKind::RETURN: {
+            StaticType value = checkExpression(*stmt.expr, flow);
+            if (function) {
+                if (!convertible(function->return_type, value)) {
+                    error(stmt.line, "cannot return " + article(value) + " from '" + function->name + "', declared "
+                          + typeName(keywordType(function->return_type)));
+                }
+                result = returned ? join(result, value) : value;
+                returned = true;
+            }
+            flow.reachable = false;
+            break;
+        }
+    }
+}
+
+// Joins the types a pass over a loop body ended with into those at its
+// head, which `flow` holds again; the `pinned` slot keeps its type. Returns
+// whether any changed.
+bool TypeChecker::mergeLoopBody(Flow& flow, bool reachable, const std::vector<SlotType>& body, bool body_reachable,
+                                int pinned) {
+    bool changed = false;
+    for (const SlotType& change : body) {
+        StaticType head = slotType(flow.slots, change.slot);
+        StaticType next = !body_reachable || change.slot == pinned ? head : reachable ? join(head, change.type) : change.type;
+        if (next != head) {
+            flow.set(change.slot, next);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// The body runs with the slot types at the loop's head, which are those
+// before the loop joined with those at the end of the body.
+void TypeChecker::checkWhile(Stmt& stmt, Flow& flow) {
+    bool reachable = flow.reachable;
+    bool head_reachable = reachable;
+    flow.begin();
+    std::vector<SlotType> body;
+    std::string enclosing_pending;
+    enclosing_pending.swap(pending);
+    quiet++;
+    for (;;) {
+        size_t pass = flow.log.size();
+        checkExpression(*stmt.expr, flow);
+        checkBlock(stmt.body, flow);
+        bool body_reachable = flow.reachable;
+        flow.rollback(pass, body);
+        flow.reachable = head_reachable;
+        if (!mergeLoopBody(flow, head_reachable, body, body_reachable, UNRESOLVED_SLOT)) {
+            break;
+        }
+        head_reachable = head_reachable || body_reachable;
+        flow.reachable = head_reachable;
+    }
+    quiet--;
+    pending.swap(enclosing_pending);
+
+    StaticType condition = checkExpression(*stmt.expr, flow);
+    if (condition == StaticType::FLOAT || condition == StaticType::CHAR || isArray(condition)) {
+        error(stmt.expr->line, std::string("a while condition cannot be a ") + typeName(condition));
+    }
+    size_t pass = flow.log.size();
+    checkBlock(stmt.body, flow);
+    flow.rollback(pass, body);
+    flow.reachable = reachable;
+    flow.end();
+}
+
+// Chunks run the body any number of times, each starting its reductions
+// from a value of the type they had before the loop, so the body is checked
+// like a while body; the combined results have the types at its head.
+void TypeChecker::checkParallel(Stmt& stmt, Flow& flow) {
+    for (Expr* bound : { stmt.expr.get(), stmt.index.get() }) {
+        StaticType type = checkExpression(*bound, flow);
+        if (type != StaticType::DYNAMIC && type != StaticType::NUM) {
+            error(bound->line, "a parallel loop range must be nums, not " + article(type));
+        }
+    }
+    for (const auto& clause : stmt.reductions) {
+        StaticType type = slotType(flow.slots, clause.slot);
+        if (type != StaticType::DYNAMIC && !isNumeric(type)) {
+            error(stmt.line, "cannot reduce into " + article(type) + " '" + clause.name + "'");
+        }
+    }
+
+    bool reachable = flow.reachable;
+    bool head_reachable = reachable;
+    flow.begin();
+    flow.set(stmt.slot, StaticType::NUM);
+    flow.set(stmt.slot + 1, StaticType::NUM);
+    std::vector<SlotType> body;
+    std::string enclosing_pending;
+    enclosing_pending.swap(pending);
+    quiet++;
+    for (;;) {
+        size_t pass = flow.log.size();
+        checkBlock(stmt.body, flow);
+        bool body_reachable = flow.reachable;
+        flow.rollback(pass, body);
+        flow.reachable = head_reachable;
+        if (!mergeLoopBody(flow, head_reachable, body, body_reachable, stmt.slot)) {
+            break;
+        }
+        head_reachable = head_reachable || body_reachable;
+        flow.reachable = head_reachable;
+    }
+    quiet--;
+    pending.swap(enclosing_pending);
+
+    size_t pass = flow.log.size();
+    checkBlock(stmt.body, flow);
+    flow.rollback(pass, body);
+    flow.reachable = reachable;
+    flow.end();
+}
+
+StaticType TypeChecker::checkExpression(Expr& expr, const Flow& flow) {
+    StaticType type = StaticType::DYNAMIC;
+    switch (expr.kind) {
+        case ExprKind::LITERAL:
+            type = literalType(expr.literal);
+            break;
+        case ExprKind::VARIABLE:
+            if (expr.slot != UNRESOLVED_SLOT) {
+                type = slotType(flow.slots, expr.slot);
+            }
+            break;
+        case ExprKind::BINARY:
+            checkExpression(*expr.lhs, flow);
+            checkExpression(*expr.rhs, flow);
+            type = binaryType(expr);
+            break;
+        case ExprKind::CALL:
+            for (auto& arg : expr.args) {
+                checkExpression(*arg.value, flow);
+            }
+            type = callType(expr);
+            break;
+        case ExprKind::ARRAY:
+            type = arrayType(expr, flow);
+            break;
+        case ExprKind::INDEX: {
+            StaticType array = checkExpression(*expr.lhs, flow);
+            checkIndex(*expr.rhs, flow);
+            if (isArray(array)) {
+                type = elementType(array);
+            } else if (array != StaticType::DYNAMIC) {
+                error(expr.line, "cannot index " + article(array));
+            }
+            break;
+        }
+        case ExprKind::METHOD:
+            type = methodType(expr, flow);
+            break;
+        case ExprKind::CHANNEL: {
+            StaticType capacity = checkExpression(*expr.rhs, flow);
+            if (capacity != StaticType::DYNAMIC && capacity != StaticType::NUM) {
+                error(expr.rhs->line, "the capacity of a channel must be a num, not " + article(capacity));
+            }
+            type = StaticType::CHANNEL;
+            break;
+        }
+    }
+    expr.static_type = type;
+    return type;
+}
+
+// Following makeArray: a num[] unless some element is a float.
+StaticType TypeChecker::arrayType(Expr& array, const Flow& flow) {
+    StaticType type = StaticType::NUM_ARRAY;
+    for (auto& element : array.elements) {
+        StaticType value = checkExpression(*element, flow);
+        if (value == StaticType::FLOAT) {
+            type = StaticType::FLOAT_ARRAY;
+        } else if (value == StaticType::DYNAMIC) {
+            type = type == StaticType::FLOAT_ARRAY ? type : StaticType::DYNAMIC;
+        } else if (value != StaticType::NUM) {
+            error(element->line, "an array element cannot be " + article(value));
+        }
+    }
+    return type;
+}
+
+void TypeChecker::checkIndex(Expr& index, const Flow& flow) {
+    StaticType type = checkExpression(index, flow);
+    if (type != StaticType::DYNAMIC && type != StaticType::NUM) {
+        error(index.line, "an array index must be a num, not " + article(type));
+    }
+}
+
+StaticType TypeChecker::methodType(Expr& method, const Flow& flow) {
+    static const char* const names[] = { "length", "sum", "min", "max", "dot", "append", "send", "receive" };
+    StaticType array = checkExpression(*method.lhs, flow);
+    StaticType argument = method.rhs ? checkExpression(*method.rhs, flow) : StaticType::DYNAMIC;
+    const char* name = names[static_cast<int>(method.method)];
+    if (method.method == Method::SEND || method.method == Method::RECEIVE) {
+        // Channels carry values of any type
+        if (array != StaticType::DYNAMIC && array != StaticType::CHANNEL) {
+            error(method.line, std::string("cannot use '.") + name + "' on " + article(array));
+        }
+        return StaticType::DYNAMIC;
+    }
+    if (array != StaticType::DYNAMIC && !isArray(array)) {
+        error(method.line, std::string("cannot use '.") + name + "' on " + article(array));
+    }
+    if (argument != StaticType::DYNAMIC && !isArray(argument)) {
+        error(method.rhs->line, std::string("the argument of '.") + name + "' must be an array, not " + article(argument));
+    }
+    switch (method.method) {
+        case Method::LENGTH:
+            return StaticType::NUM;
+        case Method::DOT:
+            if (!isArray(array) || !isArray(argument)) return StaticType::DYNAMIC;
+            return array == StaticType::NUM_ARRAY && argument == StaticType::NUM_ARRAY ? StaticType::NUM : StaticType::FLOAT;
+        default:
+            return isArray(array) ? elementType(array) : StaticType::DYNAMIC;
+    }
+}
+
+// Result of an operator following applyBinary: comparisons and arithmetic
+// take nums and floats, `+` also two strings, and arithmetic also an array
+// with an array or a number.
+StaticType TypeChecker::binaryType(const Expr& binary) {
+    StaticType lhs = binary.lhs->static_type;
+    StaticType rhs = binary.rhs->static_type;
+    bool arithmetic = binary.op == TokenType::PLUS || binary.op == TokenType::MINUS
+                      || binary.op == TokenType::STAR || binary.op == TokenType::SLASH;
+    if (isNumeric(lhs) && isNumeric(rhs)) {
+        if (!arithmetic) return StaticType::BOOL;
+        return lhs == StaticType::NUM && rhs == StaticType::NUM ? StaticType::NUM : StaticType::FLOAT;
+    }
+    if (binary.op == TokenType::PLUS && lhs == StaticType::STRING && rhs == StaticType::STRING) {
+        return StaticType::STRING;
+    }
+    bool lhs_elements = isNumeric(lhs) || isArray(lhs);
+    bool rhs_elements = isNumeric(rhs) || isArray(rhs);
+    if (arithmetic && lhs_elements && rhs_elements) {
+        bool floats = lhs == StaticType::FLOAT || lhs == StaticType::FLOAT_ARRAY || rhs == StaticType::FLOAT
+                      || rhs == StaticType::FLOAT_ARRAY;
+        return floats ? StaticType::FLOAT_ARRAY : StaticType::NUM_ARRAY;
+    }
+
+    // With one side DYNAMIC, the other fails only if no value could pair with it
+    auto usable = [&binary, arithmetic](StaticType type) {
+        return type == StaticType::DYNAMIC || isNumeric(type) || (binary.op == TokenType::PLUS && type == StaticType::STRING)
+               || (arithmetic && isArray(type));
+    };
+    bool fails = lhs != StaticType::DYNAMIC && rhs != StaticType::DYNAMIC;
+    if (fails || !usable(lhs) || !usable(rhs)) {
+        std::string operands = fails ? article(lhs) + " and " + article(rhs)
+                                     : article(usable(lhs) ? rhs : lhs);
+        error(binary.line, std::string("cannot apply '") + operatorName(binary.op) + "' to " + operands);
+    }
+    return arithmetic ? StaticType::DYNAMIC : StaticType::BOOL;
+}
+
+StaticType TypeChecker::callType(const Expr& call) {
+    if (call.function == DYNAMIC_FUNCTION || !signatures[call.function].declared) {
+        return StaticType::DYNAMIC;
+    }
+    const Signature& signature = signatures[call.function];
+    for (size_t i = 0; i < call.bindings.size() && i < signature.parameters.size(); ++i) {
+        int binding = call.bindings[i];
+        if (binding < 0) continue;
+        const Argument& arg = call.args[binding];
+        if (!convertible(signature.parameters[i], arg.value->static_type)) {
+            error(arg.value->line, "cannot pass " + article(arg.value->static_type) + " as '" + arg.name + "' to '"
+                  + call.name + "', declared " + typeName(keywordType(signature.parameters[i])));
+        }
+    }
+    return signature.result;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "ast.hpp"
+#include "error.hpp"
+#include <string>
+#include <vector>
+
+// Infers the type of every expression of a resolved Program and rejects
+// operations that could only fail, before anything runs. The result is left
+// in Expr::static_type, from which the Compiler picks typed instructions.
+//
+// Types follow the control flow of each frame: a declaration or assignment
+// gives its slot the type of the stored value, an `if` whose branches
+// disagree leaves the slot DYNAMIC, and a loop is checked again until the
+// types at its head settle. Parameters annotated with a type keyword have
+// that type, since the engines convert arguments like declarations when a
+// call starts. A call bound to an earlier declaration has the type that all
+// returns of the callee share; DYNAMIC if they differ or if the body can end
+// without `return`.
+//
+// Only operands whose type is known can be wrong: a DYNAMIC operand is left
+// to the runtime checks, which still apply to it.
+class TypeChecker {
+public:
+    explicit TypeChecker(Program& program);
+    void check();
+
+    // Streaming use: check resolved top-level statements in order.
+    void checkTopLevel(Stmt& stmt);
+
+private:
+    struct SlotType {
+        int slot;
+        StaticType type;
+    };
+
+    // Slot types at one point of a frame's code. While a branch or loop is
+    // checked, every slot set is logged with its type before, so the types
+    // at its start come back by undoing only the slots it set, not by
+    // copying the whole frame.
+    struct Flow {
+        std::vector<StaticType> slots;
+        bool reachable = true;
+        std::vector<SlotType> log; // while open > 0
+        size_t open = 0;
+
+        void set(int slot, StaticType type);
+        // Starts logging; returns the position to roll back to.
+        size_t begin();
+        void end();
+        // Undoes the slots set since `start`, listing their types before
+        // the undo in `changes`, once each and by slot.
+        void rollback(size_t start, std::vector<SlotType>& changes);
+    };
+
+    // What calls need to know about a declaration once it has been checked;
+    // the declaration itself may be released by then.
+    struct Signature {
+        bool declared = false;
+        std::vector<TokenType> parameters; // annotations
+        StaticType result = StaticType::DYNAMIC;
+    };
+
+    Program& program;
+    std::vector<Signature> signatures; // by function index
+    Flow script;
+    const FunctionDecl* function = nullptr; // being checked, null for the script
+    StaticType result = StaticType::DYNAMIC; // join of its returns so far
+    bool returned = false;                   // any return seen
+    int quiet = 0;       // > 0 while checking provisionally
+    std::string pending; // first error found while quiet
+
+    void error(uint32_t line, const std::string& message);
+    void checkFunction(size_t index, FunctionDecl& decl);
+    void checkBlock(std::vector<StmtPtr>& body, Flow& flow);
+    void checkStatement(Stmt& stmt, Flow& flow);
+    void checkWhile(Stmt& stmt, Flow& flow);
+    void checkParallel(Stmt& stmt, Flow& flow);
+    bool mergeLoopBody(Flow& flow, bool reachable, const std::vector<SlotType>& body, bool body_reachable, int pinned);
+    StaticType checkExpression(Expr& expr, const Flow& flow);
+    StaticType arrayType(Expr& array, const Flow& flow);
+    void checkIndex(Expr& index, const Flow& flow);
+    StaticType methodType(Expr& method, const Flow& flow);
+    StaticType binaryType(const Expr& binary);
+    StaticType callType(const Expr& call);
+};
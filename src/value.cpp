@@ -0,0 +1,5 @@
+#include "value.hpp"
+
+void destroyChannel(ChannelObject* channel) {
+    delete channel;
+}
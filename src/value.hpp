@@ -1,29 +1,155 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 
-enum class ValueType {
+enum class ValueType : uint8_t {
     NUMBER,
     STRING,
     BOOLEAN,
     FLOAT,
     CHAR,
-    NONE
+    NONE,
+    ARRAY,
+    CHANNEL
 };
 
+// Out-of-line payload of a string Value, shared between copies.
+struct StringObject {
+    std::atomic<uint32_t> refs;
+    std::string chars;
+
+    explicit StringObject(std::string chars) : refs(1), chars(std::move(chars)) {}
+};
+
+// Out-of-line elements of an array Value, unboxed and contiguous. Shared
+// between copies like a string; changing a shared array copies it first.
+struct ArrayObject {
+    std::atomic<uint32_t> refs;
+    ValueType element_type;    // NUMBER or FLOAT
+    std::vector<int> nums;     // elements of a num[]
+    std::vector<float> floats; // elements of a float[]
+
+    explicit ArrayObject(ValueType element_type) : refs(1), element_type(element_type) {}
+    ArrayObject(const ArrayObject& other)
+        : refs(1), element_type(other.element_type), nums(other.nums), floats(other.floats) {}
+
+    size_t size() const { return element_type == ValueType::NUMBER ? nums.size() : floats.size(); }
+};
+
+// Out-of-line state of a channel Value, shared between copies; defined
+// below Value, whose queue it holds.
+struct ChannelObject;
+inline void retainChannel(ChannelObject* channel);
+inline void releaseChannel(ChannelObject* channel);
+
+// Tagged union: the scalar payloads share one word next to the tag, strings,
+// arrays and channels are reference counted so copying a Value never copies them.
 struct Value {
     ValueType type;
-    int i_value;
-    std::string s_value;
-    bool b_value;
-    float f_value;
-    char c_value;
-
-    Value() : type(ValueType::NONE), i_value(0), b_value(false), f_value(0.0f), c_value('\0') {}
-    explicit Value(int i) : type(ValueType::NUMBER), i_value(i), b_value(false), f_value(0.0f), c_value('\0') {}
-    explicit Value(const std::string& s) : type(ValueType::STRING), s_value(s), i_value(0), b_value(false), f_value(0.0f), c_value('\0') {}
-    explicit Value(bool b) : type(ValueType::BOOLEAN), b_value(b), i_value(0), f_value(0.0f), c_value('\0') {}
-    explicit Value(float f) : type(ValueType::FLOAT), f_value(f), i_value(0), b_value(false), c_value('\0') {}
-    explicit Value(char c) : type(ValueType::CHAR), c_value(c), i_value(0), b_value(false), f_value(0.0f) {}
-};
\ No newline at end of file
+    union {
+        int i_value;
+        bool b_value;
+        float f_value;
+        char c_value;
+        StringObject* string_object;
+        ArrayObject* array_object;
+        ChannelObject* channel_object;
+    };
+
+    Value() : type(ValueType::NONE), string_object(nullptr) {}
+    explicit Value(int i) : type(ValueType::NUMBER), string_object(nullptr) { i_value = i; }
+    explicit Value(std::string s) : type(ValueType::STRING), string_object(new StringObject(std::move(s))) {}
+    explicit Value(const char* s) : Value(std::string(s)) {}
+    explicit Value(bool b) : type(ValueType::BOOLEAN), string_object(nullptr) { b_value = b; }
+    explicit Value(float f) : type(ValueType::FLOAT), string_object(nullptr) { f_value = f; }
+    explicit Value(char c) : type(ValueType::CHAR), string_object(nullptr) { c_value = c; }
+    explicit Value(ArrayObject* array) : type(ValueType::ARRAY), array_object(array) {} // takes the reference
+    explicit Value(ChannelObject* channel) : type(ValueType::CHANNEL), channel_object(channel) {} // takes the reference
+
+    Value(const Value& other) : type(other.type), string_object(other.string_object) {
+        retain();
+    }
+
+    Value(Value&& other) : type(other.type), string_object(other.string_object) {
+        other.type = ValueType::NONE;
+    }
+
+    Value& operator=(const Value& other) {
+        if (this != &other) {
+            other.retain();
+            release();
+            type = other.type;
+            string_object = other.string_object;
+        }
+        return *this;
+    }
+
+    Value& operator=(Value&& other) {
+        if (this != &other) {
+            release();
+            type = other.type;
+            string_object = other.string_object;
+            other.type = ValueType::NONE;
+        }
+        return *this;
+    }
+
+    ~Value() { release(); }
+
+    const std::string& str() const { return string_object->chars; }
+
+private:
+    void retain() const {
+        if (type == ValueType::STRING) {
+            string_object->refs.fetch_add(1, std::memory_order_relaxed);
+        } else if (type == ValueType::ARRAY) {
+            array_object->refs.fetch_add(1, std::memory_order_relaxed);
+        } else if (type == ValueType::CHANNEL) {
+            retainChannel(channel_object);
+        }
+    }
+
+    void release() {
+        if (type == ValueType::STRING && string_object->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete string_object;
+        } else if (type == ValueType::ARRAY && array_object->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete array_object;
+        } else if (type == ValueType::CHANNEL) {
+            releaseChannel(channel_object);
+        }
+    }
+};
+
+static_assert(sizeof(Value) <= 16, "Value must stay within two machine words");
+
+struct Task; // see tasks.hpp
+
+struct ChannelObject {
+    std::atomic<uint32_t> refs;
+    size_t capacity;
+    std::mutex mutex; // guards the fields below
+    std::deque<Value> items;
+    std::deque<Task*> receivers; // waiting for an item
+    std::deque<Task*> senders;   // waiting for room
+
+    explicit ChannelObject(size_t capacity) : refs(1), capacity(capacity) {}
+};
+
+inline void retainChannel(ChannelObject* channel) {
+    channel->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Out of line, so that the code releasing every Value stays small.
+void destroyChannel(ChannelObject* channel);
+
+inline void releaseChannel(ChannelObject* channel) {
+    if (channel->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        destroyChannel(channel);
+    }
+}
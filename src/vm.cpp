@@ -0,0 +1,896 @@
+#include "vm.hpp"
+#include "arrays.hpp"
+#include "lexer.hpp"
+#include "operations.hpp"
+#include <algorithm>
+#include <iterator>
+
+static inline uint16_t readShort(const uint8_t* ip) {
+    return static_cast<uint16_t>(ip[0] | (ip[1] << 8));
+}
+
+static inline uint32_t readLong(const uint8_t* ip) {
+    return readShort(ip) | (static_cast<uint32_t>(readShort(ip + 2)) << 16);
+}
+
+static const size_t NO_FUNCTION = static_cast<size_t>(-1);
+
+// Operands of the typed instructions, which the TypeChecker proved to be of
+// the right type.
+static inline int popNum(std::vector<Value>& stack) {
+    int value = stack.back().i_value;
+    stack.pop_back();
+    return value;
+}
+
+static inline float popFloat(std::vector<Value>& stack) {
+    float value = stack.back().f_value;
+    stack.pop_back();
+    return value;
+}
+
+// Room a new task's stack gets beyond its locals, for the values its
+// expressions push, so that it rarely has to grow.
+static const size_t TASK_STACK_HEADROOM = 16;
+
+VM::VM(const CompiledProgram& program, Output& output, Profiler* profiler)
+    : program(program), output(output), profiler(profiler), functions(program.functions.size()), functions_by_name(program.names.size(), NO_FUNCTION),
+      call_sites(program.call_sites, CallSite{ NO_FUNCTION, std::vector<uint8_t>() }), max_call_depth(DEFAULT_MAX_CALL_DEPTH),
+      jit(jitSupported()), hot_loops(program.loop_count), hot_functions(program.functions.size()) {
+    if (profiler) {
+        for (const auto& function : program.functions) {
+            profiler->addFunction(program.names[function.name], function.line);
+        }
+    }
+}
+
+Value VM::pop() {
+    Value value = std::move(stack.back());
+    stack.pop_back();
+    return value;
+}
+
+void VM::defineFunction(uint32_t index) {
+    const CompiledFunction& function = program.functions[index];
+    size_t default_count = 0;
+    for (const auto& param : function.parameters) {
+        if (param.has_default_value) default_count++;
+    }
+
+    BoundFunction bound;
+    bound.function = &function;
+    bound.defaults.resize(function.parameters.size());
+    size_t next = stack.size() - default_count;
+    for (size_t i = 0; i < function.parameters.size(); ++i) {
+        if (function.parameters[i].has_default_value) {
+            bound.defaults[i] = std::move(stack[next++]);
+        }
+    }
+    stack.resize(stack.size() - default_count);
+    functions[index] = std::move(bound);
+    functions_by_name[function.name] = index;
+    function_table.reset();
+}
+
+const VM::BoundFunction& VM::boundFunction(size_t index, uint32_t name) const {
+    if (index == NO_FUNCTION || !functions[index].function) {
+        throw RuntimeError("Undefined function '" + program.names[name] + "'");
+    }
+    return functions[index];
+}
+
+// Call whose callee name has several declarations: match arguments to
+// parameters by name against whichever declaration ran last. The match is
+// cached per call site and redone only when the name refers to another
+// declaration than last time.
+const CompiledFunction& VM::bindByName(uint32_t name, const uint8_t* arg_names, uint8_t argc, uint32_t call_site) {
+    size_t index = functions_by_name[name];
+    const BoundFunction& bound = boundFunction(index, name);
+    const CompiledFunction& function = *bound.function;
+
+    CallSite& site = call_sites[call_site];
+    if (site.function != index) {
+        site.function = index;
+        site.bindings.resize(function.parameters.size());
+        for (size_t i = 0; i < function.parameters.size(); ++i) {
+            const CompiledParameter& param = function.parameters[i];
+            site.bindings[i] = param.has_default_value ? BIND_DEFAULT : BIND_MISSING;
+            for (size_t a = argc; a-- > 0;) {
+                if (readLong(arg_names + 4 * a) == param.name) {
+                    site.bindings[i] = static_cast<uint8_t>(a);
+                    break;
+                }
+            }
+        }
+    }
+
+    bindArguments(bound, stack.size() - argc, site.bindings.data());
+    return function;
+}
+
+// Binds the arguments at args_base of the call instruction `op`, whose
+// operands start at `ip`, and moves `ip` past the instruction.
+inline const CompiledFunction& VM::bindCall(OpCode op, const uint8_t*& ip, size_t args_base) {
+    uint32_t operand = readLong(ip);
+    uint8_t argc = ip[4];
+    if (op == OpCode::CALL) {
+        uint32_t call_site = readLong(ip + 5);
+        const CompiledFunction& callee = bindByName(operand, ip + 9, argc, call_site);
+        ip += 9 + 4 * argc;
+        return callee;
+    }
+    const BoundFunction& bound = boundFunction(operand, program.functions[operand].name);
+    if (op == OpCode::CALL_BIND) {
+        bindArguments(bound, args_base, ip + 5);
+        ip += 5 + bound.function->parameters.size();
+    } else {
+        ip += 5;
+    }
+    return *bound.function;
+}
+
+// Rearranges the arguments at args_base into parameter order, filling in defaults.
+void VM::bindArguments(const BoundFunction& bound, size_t args_base, const uint8_t* bindings) {
+    const CompiledFunction& function = *bound.function;
+    arguments.assign(function.parameters.size(), Value());
+    for (size_t i = 0; i < function.parameters.size(); ++i) {
+        if (bindings[i] == BIND_MISSING) {
+            throw RuntimeError("Missing argument for parameter '" + program.names[function.parameters[i].name] + "' in function '" + program.names[function.name] + "'");
+        }
+        arguments[i] = bindings[i] == BIND_DEFAULT ? bound.defaults[i] : stack[args_base + bindings[i]];
+    }
+    stack.resize(args_base);
+    for (auto& value : arguments) {
+        stack.push_back(std::move(value));
+    }
+}
+
+// The arguments at args_base become the first slots of the callee's frame.
+void VM::pushFrame(const CompiledFunction& function, size_t args_base) {
+    if (frames.size() > max_call_depth) {
+        throwCallDepthExceeded(max_call_depth);
+    }
+    stack.resize(args_base + function.slot_count);
+    convertParameters(function, args_base);
+
+    CallFrame frame;
+    frame.function = &function;
+    frame.ip = function.chunk.code.data();
+    frame.base = args_base;
+    frame.memoized = false;
+    frames.push_back(frame);
+    if (profiler) {
+        profiler->enterFunction(static_cast<size_t>(&function - program.functions.data()));
+    }
+}
+
+// Tail call: the arguments at args_base replace the running frame's slots.
+void VM::replaceFrame(const CompiledFunction& function, size_t args_base) {
+    CallFrame& frame = frames.back();
+    size_t parameter_count = function.parameters.size();
+    for (size_t i = 0; i < parameter_count; ++i) {
+        stack[frame.base + i] = std::move(stack[args_base + i]);
+    }
+    stack.resize(frame.base + parameter_count);
+    stack.resize(frame.base + function.slot_count);
+    convertParameters(function, frame.base);
+
+    frame.function = &function;
+    frame.ip = function.chunk.code.data();
+    if (profiler) {
+        profiler->exitFunction();
+        profiler->enterFunction(static_cast<size_t>(&function - program.functions.data()));
+    }
+}
+
+void VM::convertParameters(const CompiledFunction& function, size_t base) {
+    for (size_t i = 0; i < function.parameters.size(); ++i) {
+        convertParameter(function.parameters[i].type, stack[base + i]);
+    }
+}
+
+// Counts one execution of a region and returns its native code if it is hot,
+// compiled and valid for the current frame's locals.
+const NativeCode* VM::hotCode(HotRegion& region, const Chunk& chunk, size_t start, size_t end, size_t base) {
+    if (!region.native) {
+        if (region.failed || ++region.count < JIT_THRESHOLD) {
+            return nullptr;
+        }
+        region.native = compileRegion(chunk, start, end, stack.data() + base, stack.size() - base);
+        if (!region.native) {
+            region.failed = true;
+            return nullptr;
+        }
+    }
+    return region.native->matches(stack.data() + base) ? region.native.get() : nullptr;
+}
+
+void VM::run(const std::vector<Value>& inputs) {
+    // Another run starts with no declarations but keeps the inline caches
+    // and native code of the ones before
+    stack.clear();
+    frames.clear();
+    memo_calls.clear();
+    memo_args.clear();
+    for (BoundFunction& function : functions) {
+        function = BoundFunction();
+    }
+    std::fill(functions_by_name.begin(), functions_by_name.end(), NO_FUNCTION);
+    function_table.reset();
+
+    is_paused = false;
+    CallFrame script;
+    script.function = &program.script;
+    script.ip = program.script.chunk.code.data();
+    script.base = 0;
+    script.memoized = false;
+    frames.push_back(script);
+    stack.resize(program.script.slot_count);
+    std::copy(inputs.begin(), inputs.end(), stack.begin());
+    if (profiler) {
+        profiler->start();
+    }
+    execute();
+}
+
+void VM::resume() {
+    is_paused = false;
+    grow();
+    for (auto& worker : parallel_workers) {
+        worker->grow();
+    }
+    stack.resize(program.script.slot_count);
+    frames.back().ip = program.script.chunk.code.data() + pause_offset;
+    execute();
+}
+
+// Makes room for the names, call sites and loops compiled since the last
+// pause; the functions were all counted before the first statement.
+void VM::grow() {
+    functions_by_name.resize(program.names.size(), NO_FUNCTION);
+    call_sites.resize(program.call_sites, CallSite{ NO_FUNCTION, std::vector<uint8_t>() });
+    hot_loops.resize(program.loop_count);
+}
+
+// Runs until the script returns or pauses or, in a worker VM, until the
+// chunk of a parallel loop it started ends or the task it runs ends or waits.
+void VM::execute() {
+    CallFrame* frame = &frames.back();
+    size_t base = frame->base;
+    const uint8_t* ip = frame->ip;
+    const Value* constants = frame->function->chunk.constants.data();
+
+    for (;;) {
+        OpCode op = static_cast<OpCode>(*ip++);
+        switch (op) {
+            case OpCode::CONSTANT:
+                stack.push_back(constants[readShort(ip)]);
+                ip += 2;
+                break;
+            case OpCode::CONSTANT_LONG:
+                stack.push_back(constants[readLong(ip)]);
+                ip += 4;
+                break;
+            case OpCode::GET_LOCAL:
+                stack.push_back(stack[base + readLong(ip)]);
+                ip += 4;
+                break;
+            case OpCode::SET_LOCAL:
+                stack[base + readLong(ip)] = pop();
+                ip += 4;
+                break;
+            case OpCode::DECLARE_LOCAL: {
+                TokenType type = static_cast<TokenType>(ip[4]);
+                stack[base + readLong(ip)] = convertForDeclaration(type, pop());
+                ip += 5;
+                break;
+            }
+            case OpCode::UPDATE_LOCAL: {
+                Value rhs = pop();
+                Value& target = stack[base + readLong(ip)];
+                TokenType update = static_cast<TokenType>(ip[4]);
+                if (target.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER && update != TokenType::SLASH) {
+                    if (update == TokenType::PLUS) target.i_value = wrappingAdd(target.i_value, rhs.i_value);
+                    else if (update == TokenType::MINUS) target.i_value = wrappingSubtract(target.i_value, rhs.i_value);
+                    else target.i_value = wrappingMultiply(target.i_value, rhs.i_value);
+                } else {
+                    applyBinaryInPlace(update, target, rhs);
+                }
+                ip += 5;
+                break;
+            }
+            case OpCode::UNDEFINED_VARIABLE:
+                throw RuntimeError("Undefined variable '" + program.names[readLong(ip)] + "'");
+            case OpCode::ADD:
+            case OpCode::SUBTRACT:
+            case OpCode::MULTIPLY:
+            case OpCode::DIVIDE:
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL: {
+                static const TokenType operators[] = {
+                    TokenType::PLUS, TokenType::MINUS, TokenType::STAR, TokenType::SLASH,
+                    TokenType::EQUAL_EQUAL, TokenType::NOT_EQUAL, TokenType::GREATER,
+                    TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL
+                };
+                Value& rhs = stack.back();
+                Value& lhs = stack[stack.size() - 2];
+                if (lhs.type == ValueType::NUMBER && rhs.type == ValueType::NUMBER && op <= OpCode::MULTIPLY) {
+                    // Integer fast path; everything else goes through the shared semantics
+                    if (op == OpCode::ADD) lhs.i_value = wrappingAdd(lhs.i_value, rhs.i_value);
+                    else if (op == OpCode::SUBTRACT) lhs.i_value = wrappingSubtract(lhs.i_value, rhs.i_value);
+                    else lhs.i_value = wrappingMultiply(lhs.i_value, rhs.i_value);
+                } else {
+                    applyBinaryInPlace(operators[static_cast<int>(op) - static_cast<int>(OpCode::ADD)], lhs, rhs);
+                }
+                stack.pop_back();
+                break;
+            }
+            case OpCode::ADD_NUM: {
+                int rhs = popNum(stack);
+                stack.back().i_value = wrappingAdd(stack.back().i_value, rhs);
+                break;
+            }
+            case OpCode::SUBTRACT_NUM: {
+                int rhs = popNum(stack);
+                stack.back().i_value = wrappingSubtract(stack.back().i_value, rhs);
+                break;
+            }
+            case OpCode::MULTIPLY_NUM: {
+                int rhs = popNum(stack);
+                stack.back().i_value = wrappingMultiply(stack.back().i_value, rhs);
+                break;
+            }
+            case OpCode::DIVIDE_NUM: {
+                int rhs = popNum(stack);
+                if (rhs == 0) {
+                    throw RuntimeError("Division by zero.");
+                }
+                stack.back().i_value = wrappingDivide(stack.back().i_value, rhs);
+                break;
+            }
+            case OpCode::EQUAL_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value == rhs);
+                break;
+            }
+            case OpCode::NOT_EQUAL_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value != rhs);
+                break;
+            }
+            case OpCode::GREATER_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value > rhs);
+                break;
+            }
+            case OpCode::GREATER_EQUAL_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value >= rhs);
+                break;
+            }
+            case OpCode::LESS_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value < rhs);
+                break;
+            }
+            case OpCode::LESS_EQUAL_NUM: {
+                int rhs = popNum(stack);
+                stack.back() = Value(stack.back().i_value <= rhs);
+                break;
+            }
+            case OpCode::ADD_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back().f_value += rhs;
+                break;
+            }
+            case OpCode::SUBTRACT_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back().f_value -= rhs;
+                break;
+            }
+            case OpCode::MULTIPLY_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back().f_value *= rhs;
+                break;
+            }
+            case OpCode::DIVIDE_FLOAT: {
+                float rhs = popFloat(stack);
+                if (rhs == 0.0f) {
+                    throw RuntimeError("Division by zero.");
+                }
+                stack.back().f_value /= rhs;
+                break;
+            }
+            case OpCode::EQUAL_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value == rhs);
+                break;
+            }
+            case OpCode::NOT_EQUAL_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value != rhs);
+                break;
+            }
+            case OpCode::GREATER_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value > rhs);
+                break;
+            }
+            case OpCode::GREATER_EQUAL_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value >= rhs);
+                break;
+            }
+            case OpCode::LESS_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value < rhs);
+                break;
+            }
+            case OpCode::LESS_EQUAL_FLOAT: {
+                float rhs = popFloat(stack);
+                stack.back() = Value(stack.back().f_value <= rhs);
+                break;
+            }
+            case OpCode::CONCAT: {
+                Value rhs = pop();
+                concatenate(stack.back(), rhs);
+                break;
+            }
+            case OpCode::NUM_TO_FLOAT:
+                stack.back() = Value(static_cast<float>(stack.back().i_value));
+                break;
+            case OpCode::FLOAT_TO_NUM:
+                stack.back() = Value(static_cast<int>(stack.back().f_value));
+                break;
+            case OpCode::UPDATE_LOCAL_NUM: {
+                int rhs = popNum(stack);
+                int& target = stack[base + readLong(ip)].i_value;
+                switch (static_cast<TokenType>(ip[4])) {
+                    case TokenType::PLUS: target = wrappingAdd(target, rhs); break;
+                    case TokenType::MINUS: target = wrappingSubtract(target, rhs); break;
+                    case TokenType::STAR: target = wrappingMultiply(target, rhs); break;
+                    default:
+                        if (rhs == 0) {
+                            throw RuntimeError("Division by zero.");
+                        }
+                        target = wrappingDivide(target, rhs);
+                        break;
+                }
+                ip += 5;
+                break;
+            }
+            case OpCode::UPDATE_LOCAL_FLOAT: {
+                float rhs = popFloat(stack);
+                float& target = stack[base + readLong(ip)].f_value;
+                switch (static_cast<TokenType>(ip[4])) {
+                    case TokenType::PLUS: target += rhs; break;
+                    case TokenType::MINUS: target -= rhs; break;
+                    case TokenType::STAR: target *= rhs; break;
+                    default:
+                        if (rhs == 0.0f) {
+                            throw RuntimeError("Division by zero.");
+                        }
+                        target /= rhs;
+                        break;
+                }
+                ip += 5;
+                break;
+            }
+            case OpCode::SHOW: {
+                Value value = pop();
+                if (output_lock) {
+                    std::lock_guard<std::mutex> lock(*output_lock);
+                    output.show(value);
+                } else {
+                    output.show(value);
+                }
+                break;
+            }
+            case OpCode::POP:
+                stack.pop_back();
+                break;
+            case OpCode::JUMP:
+                ip += 4 + readLong(ip);
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                if (!isTruthy(pop())) {
+                    ip += readLong(ip);
+                }
+                ip += 4;
+                break;
+            case OpCode::JUMP_IF_FALSE_BOOL:
+                if (!stack.back().b_value) {
+                    ip += readLong(ip);
+                }
+                stack.pop_back();
+                ip += 4;
+                break;
+            case OpCode::LOOP_IF_FALSE:
+                if (!loopCondition(pop())) {
+                    ip += readLong(ip);
+                }
+                ip += 4;
+                break;
+            case OpCode::LOOP: {
+                const uint8_t* target = ip + 4 - readLong(ip);
+                uint32_t loop = readLong(ip + 4);
+                const uint8_t* code = frame->function->chunk.code.data();
+                const NativeCode* native = jit ? hotCode(hot_loops[loop], frame->function->chunk,
+                                                         target - code, ip + 8 - code, base) : nullptr;
+                if (!native) {
+                    ip = target;
+                    break;
+                }
+                Value result;
+                ip = code + native->run(stack.data() + base, &result);
+                if (static_cast<OpCode>(*ip) == OpCode::RETURN) {
+                    stack.push_back(std::move(result));
+                }
+                break;
+            }
+            case OpCode::DEFINE_FUNCTION:
+                defineFunction(readLong(ip));
+                ip += 4;
+                break;
+            case OpCode::CALL:
+            case OpCode::CALL_DIRECT:
+            case OpCode::CALL_BIND: {
+                size_t args_base = stack.size() - ip[4];
+                const CompiledFunction* callee = &bindCall(op, ip, args_base);
+                // `return f ...` inside a function runs f in the caller's frame
+                if (static_cast<OpCode>(*ip) == OpCode::RETURN && frames.size() > 1) {
+                    replaceFrame(*callee, args_base);
+                } else {
+                    bool memoized = memo && callee->is_pure;
+                    if (memoized) {
+                        size_t index = static_cast<size_t>(callee - program.functions.data());
+                        const Value* args = stack.data() + args_base;
+                        size_t count = callee->parameters.size();
+                        Value cached;
+                        if (memo->lookup(index, args, count, cached)) {
+                            stack.resize(args_base);
+                            stack.push_back(std::move(cached));
+                            break;
+                        }
+                        memo_calls.push_back({ index, memo_args.size() });
+                        memo_args.insert(memo_args.end(), args, args + count);
+                    }
+                    frame->ip = ip;
+                    pushFrame(*callee, args_base);
+                    frames.back().memoized = memoized;
+                }
+                frame = &frames.back();
+                ip = frame->ip;
+                base = frame->base;
+                constants = frame->function->chunk.constants.data();
+                if (jit) {
+                    const Chunk& chunk = callee->chunk;
+                    size_t index = static_cast<size_t>(callee - program.functions.data());
+                    const NativeCode* native = hotCode(hot_functions[index], chunk, 0, chunk.code.size(), base);
+                    if (native) {
+                        Value result;
+                        ip += native->run(stack.data() + base, &result);
+                        if (static_cast<OpCode>(*ip) == OpCode::RETURN) {
+                            stack.push_back(std::move(result));
+                        }
+                    }
+                }
+                break;
+            }
+            case OpCode::RETURN:
+            case OpCode::RETURN_NONE: {
+                Value result;
+                if (op == OpCode::RETURN) {
+                    result = pop();
+                }
+                if (frame->memoized) {
+                    const MemoizedCall& call = memo_calls.back();
+                    memo->store(call.function, memo_args.data() + call.args, memo_args.size() - call.args, result);
+                    memo_args.resize(call.args);
+                    memo_calls.pop_back();
+                }
+                stack.resize(frame->base);
+                frames.pop_back();
+                if (profiler) {
+                    profiler->exitFunction();
+                }
+                if (frames.empty()) {
+                    return; // `return` at top level ends the program
+                }
+                stack.push_back(std::move(result));
+                frame = &frames.back();
+                ip = frame->ip;
+                base = frame->base;
+                constants = frame->function->chunk.constants.data();
+                break;
+            }
+            case OpCode::COUNT_LINE:
+                profiler->countStatement(readLong(ip));
+                ip += 4;
+                break;
+            case OpCode::ARRAY: {
+                size_t count = readLong(ip);
+                Value array = makeArray(stack.data() + stack.size() - count, count);
+                stack.resize(stack.size() - count);
+                stack.push_back(std::move(array));
+                ip += 4;
+                break;
+            }
+            case OpCode::INDEX: {
+                Value index = pop();
+                stack.back() = arrayIndex(stack.back(), index);
+                break;
+            }
+            case OpCode::ARRAY_LENGTH:
+                stack.back() = arrayLength(stack.back());
+                break;
+            case OpCode::ARRAY_SUM:
+                stack.back() = arraySum(stack.back());
+                break;
+            case OpCode::ARRAY_MIN:
+                stack.back() = arrayMin(stack.back());
+                break;
+            case OpCode::ARRAY_MAX:
+                stack.back() = arrayMax(stack.back());
+                break;
+            case OpCode::ARRAY_DOT: {
+                Value other = pop();
+                stack.back() = arrayDot(stack.back(), other);
+                break;
+            }
+            case OpCode::STORE_INDEX: {
+                Value element = pop();
+                Value index = pop();
+                arrayStore(stack[base + readLong(ip)], index, element);
+                ip += 4;
+                break;
+            }
+            case OpCode::APPEND: {
+                Value element = pop();
+                arrayAppend(stack[base + readLong(ip)], element);
+                ip += 4;
+                break;
+            }
+            case OpCode::PARALLEL:
+                ip = runParallel(*frame->function, ip, base);
+                break;
+            case OpCode::PARALLEL_END:
+                return;
+            case OpCode::SPAWN: {
+                TaskState* task = newTask(ip);
+                if (scheduler) {
+                    scheduler->spawn(task);
+                    break;
+                }
+                frame->ip = ip;
+                runTasks(task);
+                return;
+            }
+            case OpCode::CHANNEL:
+                stack.back() = makeChannel(stack.back());
+                break;
+            case OpCode::SEND: {
+                Value& channel = stack[stack.size() - 2];
+                if (!trySend(channel, stack.back())) {
+                    frame->ip = ip - 1;
+                    wait(channel, true);
+                    return;
+                }
+                stack.resize(stack.size() - 2);
+                break;
+            }
+            case OpCode::RECEIVE: {
+                Value item;
+                if (!tryReceive(stack.back(), item)) {
+                    frame->ip = ip - 1;
+                    wait(stack.back(), false);
+                    return;
+                }
+                stack.back() = std::move(item);
+                break;
+            }
+            case OpCode::PAUSE:
+                // Only the script is compiled in parts; its code may move
+                // before it resumes
+                pause_offset = static_cast<size_t>(ip - 1 - frame->function->chunk.code.data());
+                is_paused = true;
+                return;
+        }
+    }
+}
+
+// The declarations in effect, copied once after each change for the tasks
+// that start or stop meanwhile.
+std::shared_ptr<const VM::FunctionTable> VM::functionTable() {
+    if (!function_table) {
+        std::shared_ptr<FunctionTable> table = std::make_shared<FunctionTable>();
+        table->functions = functions;
+        table->functions_by_name = functions_by_name;
+        function_table = table;
+    }
+    return function_table;
+}
+
+// SPAWN: binds the call at `ip` and moves `ip` past it, but moves the
+// arguments into the first frame of a new task instead of calling.
+VM::TaskState* VM::newTask(const uint8_t*& ip) {
+    OpCode op = static_cast<OpCode>(*ip++);
+    size_t args_base = stack.size() - ip[4];
+    const CompiledFunction& callee = bindCall(op, ip, args_base);
+    // A finished task keeps the stack and frames it grew, so reusing it
+    // spares their allocations
+    std::unique_ptr<TaskState> task(scheduler ? static_cast<TaskState*>(scheduler->reuse()) : nullptr);
+    if (task) {
+        task->reset();
+    } else {
+        task.reset(new TaskState());
+        task->stack.reserve(callee.slot_count + TASK_STACK_HEADROOM);
+    }
+    task->stack.assign(std::make_move_iterator(stack.begin() + args_base), std::make_move_iterator(stack.end()));
+    stack.resize(args_base);
+    task->stack.resize(callee.slot_count);
+    for (size_t i = 0; i < callee.parameters.size(); ++i) {
+        convertParameter(callee.parameters[i].type, task->stack[i]);
+    }
+
+    CallFrame frame;
+    frame.function = &callee;
+    frame.ip = callee.chunk.code.data();
+    frame.base = 0;
+    frame.memoized = false;
+    task->frames.push_back(frame);
+    task->functions = functionTable();
+    task->function = static_cast<size_t>(&callee - program.functions.data());
+    return task.release();
+}
+
+// The first `spawn`: the rest of the script becomes the main task, which the
+// Scheduler runs along with `first` and every task spawned later.
+void VM::runTasks(TaskState* first) {
+    std::unique_ptr<TaskState> script(new TaskState());
+    script->stack.swap(stack);
+    script->frames.swap(frames);
+    script->memo_calls.swap(memo_calls);
+    script->memo_args.swap(memo_args);
+    script->functions = functionTable();
+    script->started = true;
+    if (profiler) {
+        profiler->swapStack(script->profile);
+    }
+
+    // Profiles count into one Profiler, so they keep to this thread
+    TaskStats uncounted;
+    Scheduler tasks(profiler ? nullptr : pool, task_stats ? *task_stats : uncounted);
+    size_t workers = tasks.workers();
+    std::mutex lock;
+    std::vector<std::unique_ptr<VM>> task_workers;
+    for (size_t w = 0; w < workers; ++w) {
+        task_workers.emplace_back(new VM(program, output));
+        VM& worker = *task_workers.back();
+        worker.profiler = profiler;
+        worker.max_call_depth = max_call_depth;
+        worker.memo = workers > 1 ? nullptr : memo;
+        worker.jit = jit;
+        worker.scheduler = &tasks;
+        worker.output_lock = workers > 1 ? &lock : nullptr;
+    }
+    tasks.spawn(first);
+    tasks.run(script.release(), [&](size_t worker, Task& task) {
+        task_workers[worker]->runTask(static_cast<TaskState&>(task));
+    });
+}
+
+// Runs in a worker VM: resumes `task` until it ends or waits on a channel.
+void VM::runTask(TaskState& task) {
+    stack.swap(task.stack);
+    frames.swap(task.frames);
+    memo_calls.swap(task.memo_calls);
+    memo_args.swap(task.memo_args);
+    if (task.functions != function_table) {
+        functions = task.functions->functions;
+        functions_by_name = task.functions->functions_by_name;
+        function_table = task.functions;
+    }
+    if (profiler) {
+        profiler->swapStack(task.profile);
+        if (!task.started) {
+            profiler->enterFunction(task.function);
+        }
+    }
+    task.started = true;
+
+    waiting_for = nullptr;
+    execute();
+    task.waiting_for = waiting_for;
+    task.sending = waiting_to_send;
+    task.functions = functionTable();
+    if (profiler) {
+        profiler->swapStack(task.profile);
+    }
+    stack.swap(task.stack);
+    frames.swap(task.frames);
+    memo_calls.swap(task.memo_calls);
+    memo_args.swap(task.memo_args);
+}
+
+// A channel operation that cannot go on yet; execute() returns and runs it
+// again once the task is woken. Without tasks nothing could ever wake it.
+void VM::wait(const Value& channel, bool sending) {
+    if (!scheduler) {
+        throw RuntimeError(DEADLOCK_ERROR);
+    }
+    waiting_for = channel.channel_object;
+    waiting_to_send = sending;
+}
+
+// Returns the instruction after the loop.
+const uint8_t* VM::runParallel(const CompiledFunction& function, const uint8_t* operands, size_t base) {
+    ParallelBody loop;
+    loop.function = &function;
+    loop.index_slot = readLong(operands);
+    loop.reduction_count = operands[4];
+    loop.reductions = operands + 5;
+    loop.code = loop.reductions + 5 * loop.reduction_count + 4;
+    const uint8_t* end = loop.code + readLong(loop.code - 4);
+
+    Value limit = pop();
+    Value from = pop();
+    std::vector<Reduction> kinds(loop.reduction_count);
+    std::vector<Value> values(loop.reduction_count);
+    for (size_t r = 0; r < loop.reduction_count; ++r) {
+        kinds[r] = static_cast<Reduction>(loop.reductions[5 * r + 4]);
+        values[r] = stack[base + readLong(loop.reductions + 5 * r)];
+    }
+    loop.slots = stack.data() + base;
+    loop.slot_count = stack.size() - base;
+
+    // Profiles count into one Profiler, so they keep to this thread
+    ThreadPool* threads = profiler ? nullptr : pool;
+    size_t workers = parallelWorkers(threads);
+    while (parallel_workers.size() < workers) {
+        parallel_workers.emplace_back(new VM(program, output));
+    }
+    for (size_t w = 0; w < workers; ++w) {
+        VM& worker = *parallel_workers[w];
+        worker.profiler = profiler;
+        worker.functions = functions;
+        worker.functions_by_name = functions_by_name;
+        worker.max_call_depth = max_call_depth;
+        worker.memo = workers > 1 ? nullptr : memo;
+        worker.jit = jit;
+    }
+    runParallelLoop(threads, from, limit, kinds, values.data(), [&](size_t worker, int first, int last, Value* partials) {
+        parallel_workers[worker]->runChunk(loop, first, last, partials);
+    });
+    for (size_t r = 0; r < loop.reduction_count; ++r) {
+        stack[base + readLong(loop.reductions + 5 * r)] = std::move(values[r]);
+    }
+    return end;
+}
+
+// Runs in a worker VM: the iterations [first, last) on a copy of the loop's
+// frame whose reduction variables start as `partials`.
+void VM::runChunk(const ParallelBody& loop, int first, int last, Value* partials) {
+    stack.assign(loop.slots, loop.slots + loop.slot_count);
+    for (size_t r = 0; r < loop.reduction_count; ++r) {
+        stack[readLong(loop.reductions + 5 * r)] = partials[r];
+    }
+    stack[loop.index_slot] = Value(first);
+    stack[loop.index_slot + 1] = Value(last);
+    CallFrame body;
+    body.function = loop.function;
+    body.ip = loop.code;
+    body.base = 0;
+    body.memoized = false;
+    frames.assign(1, body);
+    memo_calls.clear();
+    memo_args.clear();
+    execute();
+    for (size_t r = 0; r < loop.reduction_count; ++r) {
+        partials[r] = std::move(stack[readLong(loop.reductions + 5 * r)]);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include "bytecode.hpp"
+#include "memo_cache.hpp"
+#include "error.hpp"
+#include "jit.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "tasks.hpp"
+#include "value.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Stack-based virtual machine executing a CompiledProgram. Nova calls push a
+// CallFrame instead of recursing on the native stack; a frame's local slots
+// live on the value stack starting at its base. A call directly followed by
+// RETURN is a tail call and reuses the caller's frame.
+//
+// Loops and functions that run often enough are compiled to native code
+// (see jit.hpp) and run there whenever their locals have the right types.
+//
+// A `parallel` loop runs its body on worker VMs, one per thread of the pool,
+// each with a copy of the frame the loop is in. Memoization is off while
+// they run on several threads; with a profiler they run on this thread.
+//
+// The first `spawn` makes the running script a task too and hands both to a
+// Scheduler, which runs tasks on worker VMs, one per thread of the pool. A
+// task is just a value stack and frames, swapped into a worker VM while it
+// runs; a channel operation that has to wait saves them and returns from
+// execute(), and the operation runs again when the task resumes. Tasks run
+// their parallel loops serially, and take turns on one thread when
+// memoizing or profiling.
+class VM {
+public:
+    VM(const CompiledProgram& program, Output& output, Profiler* profiler = nullptr);
+    void setMaxCallDepth(size_t depth) { max_call_depth = depth; }
+    // Calls to pure functions are answered from `memo` when it is set.
+    void setMemoCache(MemoCache* cache) { memo = cache; }
+    void setJitEnabled(bool enabled) { jit = enabled && jitSupported(); }
+    // Parallel loops run on `workers` when it is set, on this thread otherwise.
+    void setThreadPool(ThreadPool* workers) { pool = workers; }
+    // Counts of the tasks that run() spawns go to `stats` when it is set.
+    void setTaskStats(TaskStats* stats) { task_stats = stats; }
+    // Runs the script with `inputs` in the first slots of its frame, see
+    // Program::inputs. May be called again to run it anew.
+    void run(const std::vector<Value>& inputs = std::vector<Value>());
+    // run() and resume() return at PAUSE when the script is compiled one
+    // statement at a time (see SourceCompiler); once the program has grown
+    // past it, resume() goes on from there. Tasks are never paused.
+    bool paused() const { return is_paused; }
+    void resume();
+
+private:
+    struct BoundFunction {
+        const CompiledFunction* function = nullptr;
+        std::vector<Value> defaults; // evaluated when the declaration runs
+    };
+
+    struct CallFrame {
+        const CompiledFunction* function;
+        const uint8_t* ip;
+        size_t base;
+        bool memoized; // stores its result under memo_calls.back() on return
+    };
+
+    // Inline cache of a CALL: the declaration its name referred to last time
+    // and the matching argument bindings, as CALL_BIND would encode them.
+    struct CallSite {
+        size_t function;
+        std::vector<uint8_t> bindings;
+    };
+
+    // Execution count of a loop or function and its native code once hot.
+    struct HotRegion {
+        uint32_t count = 0;
+        bool failed = false; // the JIT could not compile it
+        std::unique_ptr<NativeCode> native;
+    };
+
+    struct MemoizedCall {
+        size_t function;
+        size_t args; // index of its first argument in memo_args
+    };
+
+    // Declarations in effect, shared by the tasks that saw the same ones.
+    struct FunctionTable {
+        std::vector<BoundFunction> functions;
+        std::vector<size_t> functions_by_name;
+    };
+
+    // Everything a task resumes from, swapped into a worker VM while it runs.
+    struct TaskState : Task {
+        std::vector<Value> stack;
+        std::vector<CallFrame> frames;
+        std::vector<MemoizedCall> memo_calls;
+        std::vector<Value> memo_args;
+        std::shared_ptr<const FunctionTable> functions;
+        Profiler::TaskStack profile;
+        size_t function = 0;  // entered in the profile when the task first runs
+        bool started = false;
+
+        // Ready to run another call, keeping the capacity of the vectors.
+        void reset() {
+            waiting_for = nullptr;
+            sending = false;
+            stack.clear();
+            frames.clear();
+            memo_calls.clear();
+            memo_args.clear();
+            functions.reset();
+            profile.frames.clear();
+            started = false;
+        }
+    };
+
+    // A parallel loop as its worker VMs see it.
+    struct ParallelBody {
+        const CompiledFunction* function;
+        const uint8_t* code;       // start of the loop over one chunk
+        uint32_t index_slot;
+        const uint8_t* reductions; // u32 slot and u8 Reduction each
+        size_t reduction_count;
+        const Value* slots;        // the frame of the loop, read-only meanwhile
+        size_t slot_count;
+    };
+
+    const CompiledProgram& program;
+    Output& output;
+    Profiler* profiler;
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::vector<BoundFunction> functions;  // indexed like CompiledProgram::functions
+    std::vector<size_t> functions_by_name; // latest declaration of each name
+    std::vector<CallSite> call_sites;      // indexed by the CALL's call site operand
+    std::vector<Value> arguments; // scratch space for binding call arguments
+    size_t max_call_depth;
+    MemoCache* memo = nullptr;
+    std::vector<MemoizedCall> memo_calls; // of the memoized frames, innermost last
+    std::vector<Value> memo_args;         // their arguments as they were called, one after another
+    bool jit;
+    std::vector<HotRegion> hot_loops;     // indexed by the LOOP's loop operand
+    std::vector<HotRegion> hot_functions; // indexed like CompiledProgram::functions
+    ThreadPool* pool = nullptr;
+    std::vector<std::unique_ptr<VM>> parallel_workers; // indexed by pool worker
+    std::shared_ptr<const FunctionTable> function_table; // copy of the declarations; null once they change
+    Scheduler* scheduler = nullptr; // running the tasks, once the first one was spawned
+    std::mutex* output_lock = nullptr; // taken by `show` while tasks run on several threads
+    ChannelObject* waiting_for = nullptr; // set when execute() returned to wait on a channel
+    bool waiting_to_send = false;
+    TaskStats* task_stats = nullptr;
+    bool is_paused = false;
+    size_t pause_offset = 0; // of the PAUSE in the script's code
+
+    void execute();
+    void grow();
+    Value pop();
+    void defineFunction(uint32_t index);
+    const BoundFunction& boundFunction(size_t index, uint32_t name) const;
+    const CompiledFunction& bindByName(uint32_t name, const uint8_t* arg_names, uint8_t argc, uint32_t call_site);
+    void bindArguments(const BoundFunction& bound, size_t args_base, const uint8_t* bindings);
+    void pushFrame(const CompiledFunction& function, size_t args_base);
+    void replaceFrame(const CompiledFunction& function, size_t args_base);
+    void convertParameters(const CompiledFunction& function, size_t base);
+    const CompiledFunction& bindCall(OpCode op, const uint8_t*& ip, size_t args_base);
+    std::shared_ptr<const FunctionTable> functionTable();
+    TaskState* newTask(const uint8_t*& ip);
+    void runTasks(TaskState* first);
+    void runTask(TaskState& task);
+    void wait(const Value& channel, bool sending);
+    const uint8_t* runParallel(const CompiledFunction& function, const uint8_t* operands, size_t base);
+    void runChunk(const ParallelBody& loop, int first, int last, Value* partials);
+    const NativeCode* hotCode(HotRegion& region, const Chunk& chunk, size_t start, size_t end, size_t base);
+};